@@ -294,6 +294,8 @@ Absyn *newCallStm(char *file, int line,
   node->u.callStm.name = name;
   node->u.callStm.rcvr = rcvr;  
   node->u.callStm.args = args;
+  node->u.callStm.inlineMethod = NULL;
+  node->u.callStm.inlineBase = 0;
   return node;
 }
 
@@ -320,6 +322,7 @@ Absyn *newBinopExp(char *file, int line,
   node->u.binopExp.left = left;
   node->u.binopExp.right = right;
   node->u.binopExp.expType = NULL;
+  node->u.binopExp.unboxed = FALSE;
   return node;
 }
 
@@ -335,6 +338,7 @@ Absyn *newUnopExp(char *file, int line,
   node->u.unopExp.op = op;
   node->u.unopExp.right = right;
   node->u.unopExp.expType = NULL;
+  node->u.unopExp.unboxed = FALSE;
   return node;
 }
 
@@ -391,6 +395,7 @@ Absyn *newIntExp(char *file, int line,
   node->line = line;
   node->u.intExp.value = value;
   node->u.intExp.expType = NULL;
+  node->u.intExp.unboxed = FALSE;
   return node;
 }
 
@@ -405,6 +410,7 @@ Absyn *newBoolExp(char *file, int line,
   node->line = line;
   node->u.boolExp.value = value;
   node->u.boolExp.expType = NULL;
+  node->u.boolExp.unboxed = FALSE;
   return node;
 }
 
@@ -487,6 +493,8 @@ Absyn *newCallExp(char *file, int line,
   node->u.callExp.rcvr = rcvr;
   node->u.callExp.args = args;
   node->u.callExp.expType =  NULL;
+  node->u.callExp.inlineMethod = NULL;
+  node->u.callExp.inlineBase = 0;
   return node;
 }
 
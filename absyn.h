@@ -194,17 +194,21 @@ typedef struct absyn {
       struct absyn *rcvr;	/* receiver expression */
       struct absyn *args;	/* argument expressions */
       Class *rcvrClass;         /* Class of rcvr */
+      struct absyn *inlineMethod; /* method inlined here, see inline.c */
+      int inlineBase;           /* first local holding its arguments */
     } callStm;
     struct {
       int op;			/* operation */
       struct absyn *left;	/* left operand expression */
       struct absyn *right;	/* right operand expression */
       struct type *expType;     /* type of expression */
+      boolean unboxed;          /* raw value on stack, see escape.c */
     } binopExp;
     struct {
       int op;			/* operation */
       struct absyn *right;	/* (right) operand expression */
       struct type *expType;     /* type of expression */
+      boolean unboxed;          /* raw value on stack, see escape.c */
     } unopExp;
     struct {
       struct absyn *exp;	/* expression */
@@ -223,10 +227,12 @@ typedef struct absyn {
     struct {
       int value;		/* the integer literal's value */
       struct type *expType;     /* type of expression */
+      boolean unboxed;          /* raw value on stack, see escape.c */
     } intExp;
     struct {
       int value;		/* the boolean literal's value */
       struct type *expType;     /* type of expression */
+      boolean unboxed;          /* raw value on stack, see escape.c */
     } boolExp;
     struct {
       char value;		/* the character literal's value */
@@ -254,6 +260,8 @@ typedef struct absyn {
       struct absyn *args;	/* argument expressions */
       struct type *expType;     /* type of expression */
       Class *rcvrClass;         /* Class of rcvr */
+      struct absyn *inlineMethod; /* method inlined here, see inline.c */
+      int inlineBase;           /* first local holding its arguments */
     } callExp;
     struct {
       Sym *type;		/* class name */
@@ -0,0 +1,178 @@
+/*
+ * binary.c -- binary code emission
+ *
+ * With --emit-bin the compiler writes the program in the format
+ * of the VM (see 'instrs' and disasm/disasm.c) instead of assembler
+ * text. Every instruction and every .addr is one 32 bit word with
+ * the opcode in the upper 8 bits and a 24 bit immediate; .addr is
+ * just the address. The first pass assigns an address to every
+ * label, the second one encodes the instructions.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "instr.h"
+#include "binary.h"
+
+
+#define IMMEDIATE_MIN	(-(1L << 23))
+#define IMMEDIATE_MAX	((1L << 23) - 1)
+#define ADDRESS_MAX	((1L << 24) - 1)
+
+/* the superclass of Object, no code address can have this value */
+#define NIL_ADDRESS	0xFFFFFFFF
+
+
+typedef struct labelAddress {
+    char *label;
+    unsigned int address;
+    struct labelAddress *next;
+} LabelAddress;
+
+static LabelAddress **buckets;
+static unsigned int numBuckets;
+
+
+static void enterLabel(char *label, unsigned int address) {
+    LabelAddress *entry;
+    unsigned int index;
+
+    index = djb2(label) % numBuckets;
+    for (entry = buckets[index]; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->label, label) == 0) {
+            error("label '%s' defined more than once", label);
+        }
+    }
+    entry = (LabelAddress *) allocate(sizeof(LabelAddress));
+    entry->label = label;
+    entry->address = address;
+    entry->next = buckets[index];
+    buckets[index] = entry;
+}
+
+
+static unsigned int lookupLabel(char *label) {
+    LabelAddress *entry;
+
+    if (strcmp(label, "nil") == 0) {
+        return NIL_ADDRESS;
+    }
+    for (entry = buckets[djb2(label) % numBuckets];
+            entry != NULL;
+            entry = entry->next) {
+        if (strcmp(entry->label, label) == 0) {
+            return entry->address;
+        }
+    }
+    error("undefined label '%s'", label);
+    return 0;
+}
+
+
+static unsigned int immediate(Instr *p) {
+    if (p->immediate < IMMEDIATE_MIN || p->immediate > IMMEDIATE_MAX) {
+        error("immediate %d of '%s' out of range",
+                p->immediate, opcodeMnemonic(p->opcode));
+    }
+    return p->immediate & 0x00FFFFFF;
+}
+
+
+static unsigned int encodeInstr(Instr *p) {
+    unsigned int address;
+
+    switch (p->opcode) {
+        case OP_ADDR:
+            return lookupLabel(p->label);
+        case OP_JMP:
+        case OP_BRF:
+        case OP_BRT:
+        case OP_CALL:
+        case OP_UNBOXBRF:
+            address = lookupLabel(p->label);
+            if (address > ADDRESS_MAX) {
+                error("target '%s' of '%s' out of range",
+                        p->label, opcodeMnemonic(p->opcode));
+            }
+            return (p->opcode << 24) | address;
+        case OP_VMCALL:
+            if (p->immediate < 0 || p->immediate > 0xFF
+                    || p->offset < 0 || p->offset > 0xFFFF) {
+                error("vmcall %d,%d out of range", p->immediate, p->offset);
+            }
+            return (p->opcode << 24) | (p->immediate << 16) | p->offset;
+        case OP_PUSHC:
+        case OP_ASF:
+        case OP_PUSHL:
+        case OP_POPL:
+        case OP_DROP:
+        case OP_NEW:
+        case OP_GETF:
+        case OP_PUTF:
+        case OP_PUSHG:
+        case OP_POPG:
+        case OP_UNBOXL:
+        case OP_DROPR:
+            return (p->opcode << 24) | immediate(p);
+        default:
+            return p->opcode << 24;
+    }
+}
+
+
+static boolean isCode(Instr *p) {
+    return p->opcode != OP_LABEL
+            && p->opcode != OP_COMMENT
+            && p->opcode != OP_DELETED;
+}
+
+
+void writeBinaryProgram(FILE *file, InstrProgram *program) {
+    InstrBuffer *buffer;
+    Instr *p;
+    unsigned int *code;
+    unsigned int address;
+    int i, j;
+
+    /* pass 1: addresses of the labels */
+    numBuckets = 1;
+    for (i = 0; i < program->numBuffers; i++) {
+        numBuckets += program->buffers[i]->numInstrs / 4;
+    }
+    buckets = (LabelAddress **) allocate(numBuckets * sizeof(LabelAddress *));
+    memset(buckets, 0, numBuckets * sizeof(LabelAddress *));
+    address = 0;
+    for (i = 0; i < program->numBuffers; i++) {
+        buffer = program->buffers[i];
+        for (j = 0; j < buffer->numInstrs; j++) {
+            p = &buffer->instrs[j];
+            if (p->opcode == OP_LABEL) {
+                enterLabel(p->label, address);
+            } else if (isCode(p)) {
+                address++;
+            }
+        }
+    }
+
+    /* pass 2: encode the instructions */
+    code = (unsigned int *) allocate((address + 1) * sizeof(unsigned int));
+    address = 0;
+    for (i = 0; i < program->numBuffers; i++) {
+        buffer = program->buffers[i];
+        for (j = 0; j < buffer->numInstrs; j++) {
+            p = &buffer->instrs[j];
+            if (isCode(p)) {
+                code[address++] = encodeInstr(p);
+            }
+        }
+    }
+    if (fwrite(code, sizeof(unsigned int), address, file) != address) {
+        error("cannot write binary output");
+    }
+    release(code);
+}
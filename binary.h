@@ -0,0 +1,10 @@
+/*
+ * binary.h -- binary code emission
+ */
+
+#ifndef BINARY_H
+#define	BINARY_H
+
+void writeBinaryProgram(FILE *file, InstrProgram *program);
+
+#endif	/* BINARY_H */
@@ -0,0 +1,611 @@
+/*
+ * cache.c -- incremental builds with a build cache
+ *
+ * With --cache <dir> every source file is compiled into an object
+ * file of its own (like with -c, see library.c) which is kept in the
+ * cache directory, and the program is linked from these object files.
+ * The index of the cache holds for every file the djb2 hash of its
+ * contents, the hash of its interface (see writeLibrary), the classes
+ * it defines and the classes it refers to (see useClass in semant.c).
+ *
+ * On the next run a file is compiled again if its contents changed,
+ * or if the interface of a file it depends on, directly or through
+ * other files, changed. This is done in rounds: a round checks the
+ * files to compile against the object files of all others, and the
+ * files whose interface turns out to be changed make their dependents
+ * be compiled in the next round. All other files are taken from the
+ * cache without being scanned, parsed or checked.
+ *
+ * The options which influence the code (-O, the library and the
+ * object files given) are part of the index, if they change all
+ * files are compiled again. As for object files, there is no CHA
+ * and no inlining.
+ */
+
+#define _POSIX_C_SOURCE 200112L	/* mkdir */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "utils.h"
+#include "sym.h"
+#include "types.h"
+#include "absyn.h"
+#include "vmt.h"
+#include "instance.h"
+#include "table.h"
+#include "wellknown.h"
+#include "scanner.h"
+#include "parser.h"
+#include "semant.h"
+#include "escape.h"
+#include "instr.h"
+#include "library.h"
+#include "codegen.h"
+#include "cache.h"
+#include "timer.h"
+
+
+#define CACHE_INDEX	"njc.cache"
+#define CACHE_HEADER	"njc cache 1"
+#define MAX_LINE	1024
+
+/* state of an input file */
+#define FILE_CACHED	0	/* its object file in the cache is valid */
+#define FILE_STALE	1	/* it must be compiled */
+#define FILE_BUILT	2	/* it has been compiled in this run */
+
+
+typedef struct {
+    int numNames;
+    int maxNames;
+    char **names;
+} NameList;
+
+typedef struct {
+    char *name;			/* the source file */
+    char *objName;		/* its object file in the cache */
+    unsigned long hash;		/* of the contents */
+    boolean hasInterface;	/* interfaceHash is known */
+    unsigned long interfaceHash;
+    NameList defs;		/* the classes defined, with meta classes */
+    NameList refs;		/* the classes of other files referred to */
+    int state;
+    int round;			/* in which it was compiled */
+} CacheFile;
+
+
+static char *cacheDir;
+static unsigned long optionsHash;
+
+/* the input files */
+static CacheFile *files;
+static int numFiles;
+
+/* the library and object files given, loaded in every round */
+static char **libFileNames;
+static int numLibFiles;
+
+static int numRounds;
+static int numCompiled;
+
+
+/**************************************************************/
+
+/* names and hashes */
+
+
+static void addName(NameList *list, char *name) {
+    char **newNames;
+
+    if (list->numNames == list->maxNames) {
+        list->maxNames = list->maxNames == 0 ? 8 : 2 * list->maxNames;
+        newNames = (char **) allocate(list->maxNames * sizeof(char *));
+        if (list->numNames > 0) {
+            memcpy(newNames, list->names, list->numNames * sizeof(char *));
+            release(list->names);
+        }
+        list->names = newNames;
+    }
+    list->names[list->numNames++] = name;
+}
+
+
+static boolean hasName(NameList *list, char *name) {
+    int i;
+
+    for (i = 0; i < list->numNames; i++) {
+        if (strcmp(list->names[i], name) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+static void clearNames(NameList *list) {
+    list->numNames = 0;
+    list->maxNames = 0;
+    list->names = NULL;
+}
+
+
+/* djb2 (see utils.c) over the bytes of a file */
+static unsigned long hashFile(char *name) {
+    FILE *file;
+    unsigned long hash = 5381;
+    int c;
+
+    file = fopen(name, "rb");
+    if (file == NULL) {
+        error("cannot open input file '%s'", name);
+    }
+    while ((c = getc(file)) != EOF) {
+        hash = ((hash << 5) + hash) + c;
+    }
+    fclose(file);
+    return hash;
+}
+
+
+static boolean fileExists(char *name) {
+    FILE *file;
+
+    file = fopen(name, "rb");
+    if (file == NULL) {
+        return FALSE;
+    }
+    fclose(file);
+    return TRUE;
+}
+
+
+static char *cachePath(char *name) {
+    char *path;
+
+    path = (char *) allocate(strlen(cacheDir) + 1 + strlen(name) + 1);
+    sprintf(path, "%s/%s", cacheDir, name);
+    return path;
+}
+
+
+/**************************************************************/
+
+/* the index */
+
+
+static void writeIndex(void) {
+    FILE *index;
+    CacheFile *f;
+    char *indexName;
+    int i, j;
+
+    indexName = cachePath(CACHE_INDEX);
+    index = fopen(indexName, "w");
+    if (index == NULL) {
+        error("cannot write cache index '%s'", indexName);
+    }
+    fprintf(index, "%s\n", CACHE_HEADER);
+    fprintf(index, "options %lx\n", optionsHash);
+    for (i = 0; i < numFiles; i++) {
+        f = &files[i];
+        /* the object file of a stale file may be overwritten any time */
+        if (f->state == FILE_STALE || !f->hasInterface) {
+            continue;
+        }
+        fprintf(index, "file %lx %lx %s\n", f->hash, f->interfaceHash, f->name);
+        for (j = 0; j < f->defs.numNames; j++) {
+            fprintf(index, "def %s\n", f->defs.names[j]);
+        }
+        for (j = 0; j < f->refs.numNames; j++) {
+            fprintf(index, "ref %s\n", f->refs.names[j]);
+        }
+    }
+    if (ferror(index) || fclose(index) != 0) {
+        error("cannot write cache index '%s'", indexName);
+    }
+}
+
+
+static CacheFile *findFile(char *name) {
+    int i;
+
+    for (i = 0; i < numFiles; i++) {
+        if (strcmp(files[i].name, name) == 0) {
+            return &files[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void badIndex(char *indexName) {
+    error("cache index '%s' is corrupt", indexName);
+}
+
+
+/* take over what is known about the input files from the last run */
+static void readIndex(void) {
+    FILE *index;
+    CacheFile *f;
+    char *indexName;
+    char line[MAX_LINE];
+    unsigned long hash;
+    unsigned long interfaceHash;
+    int length;
+    int n;
+
+    indexName = cachePath(CACHE_INDEX);
+    index = fopen(indexName, "r");
+    if (index == NULL) {
+        /* a new cache */
+        return;
+    }
+    if (fgets(line, MAX_LINE, index) == NULL
+            || strncmp(line, CACHE_HEADER "\n", MAX_LINE) != 0
+            || fgets(line, MAX_LINE, index) == NULL
+            || sscanf(line, "options %lx", &hash) != 1
+            || hash != optionsHash) {
+        /* another compiler or other options */
+        fclose(index);
+        return;
+    }
+    f = NULL;
+    while (fgets(line, MAX_LINE, index) != NULL) {
+        length = strlen(line);
+        if (length == 0 || line[length - 1] != '\n') {
+            badIndex(indexName);
+        }
+        line[length - 1] = '\0';
+        if (sscanf(line, "file %lx %lx %n", &hash, &interfaceHash, &n) == 2) {
+            f = findFile(line + n);
+            if (f != NULL) {
+                /* unchanged if the object file is still there */
+                f->hasInterface = TRUE;
+                f->interfaceHash = interfaceHash;
+                if (f->hash == hash && fileExists(f->objName)) {
+                    f->state = FILE_CACHED;
+                }
+            }
+        } else if (strncmp(line, "def ", 4) == 0) {
+            if (f != NULL) {
+                addName(&f->defs, copyString(line + 4));
+            }
+        } else if (strncmp(line, "ref ", 4) == 0) {
+            if (f != NULL) {
+                addName(&f->refs, copyString(line + 4));
+            }
+        } else {
+            badIndex(indexName);
+        }
+    }
+    fclose(index);
+}
+
+
+/**************************************************************/
+
+/* dependencies */
+
+
+static boolean refersTo(CacheFile *f, NameList *defs) {
+    int i;
+
+    for (i = 0; i < f->refs.numNames; i++) {
+        if (hasName(defs, f->refs.names[i])) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+/*
+ * The interface of the classes in defs has changed, so all files
+ * which depend on them must be compiled again. A file which refers
+ * to them only through another file may use their members as well,
+ * e.g. in a.b().c(), so the dependents of a dependent are included.
+ * Files compiled in this round have seen the new interface.
+ */
+static void markDependents(NameList *defs) {
+    CacheFile *f;
+    int i;
+
+    for (i = 0; i < numFiles; i++) {
+        f = &files[i];
+        if (f->state == FILE_STALE || f->round == numRounds) {
+            continue;
+        }
+        if (refersTo(f, defs)) {
+            f->state = FILE_STALE;
+            markDependents(&f->defs);
+        }
+    }
+}
+
+
+static void collectDefs(Absyn *fileTree, NameList *defs) {
+    Absyn *classList;
+    Sym *name;
+
+    clearNames(defs);
+    for (classList = fileTree->u.file.classes;
+            !classList->u.clsList.isEmpty;
+            classList = classList->u.clsList.tail) {
+        name = classList->u.clsList.head->u.classDec.name;
+        addName(defs, symToString(name));
+        addName(defs, symToString(metaClassName(name)));
+    }
+}
+
+
+static void collectRefs(Bintree *bintree, CacheFile *f) {
+    char *name;
+
+    if (bintree == NULL) {
+        return;
+    }
+    collectRefs(bintree->left, f);
+    name = symToString(bintree->sym);
+    if (!hasName(&f->defs, name)) {
+        addName(&f->refs, name);
+    }
+    collectRefs(bintree->right, f);
+}
+
+
+/*
+ * A cached file must not refer to a class which a stale file does no
+ * longer define, its object file could not be loaded. Returns TRUE
+ * if such files have been found, they are stale now.
+ */
+static boolean markRemovedClassUsers(Absyn *fileTrees[], int numStale,
+        int stale[]) {
+    NameList *newDefs;
+    NameList *oldDefs;
+    CacheFile *g;
+    boolean found;
+    boolean isDefined;
+    char *name;
+    int i, j, k, m;
+
+    newDefs = (NameList *) allocate(numStale * sizeof(NameList));
+    for (k = 0; k < numStale; k++) {
+        collectDefs(fileTrees[k], &newDefs[k]);
+    }
+    found = FALSE;
+    for (k = 0; k < numStale; k++) {
+        oldDefs = &files[stale[k]].defs;
+        for (j = 0; j < oldDefs->numNames; j++) {
+            name = oldDefs->names[j];
+            isDefined = FALSE;
+            for (m = 0; m < numStale && !isDefined; m++) {
+                isDefined = hasName(&newDefs[m], name);
+            }
+            if (isDefined) {
+                continue;
+            }
+            for (i = 0; i < numFiles; i++) {
+                g = &files[i];
+                if (g->state != FILE_STALE && hasName(&g->refs, name)) {
+                    g->state = FILE_STALE;
+                    found = TRUE;
+                }
+            }
+        }
+    }
+    release(newDefs);
+    return found;
+}
+
+
+/**************************************************************/
+
+/* building */
+
+
+/*
+ * Compile the stale files, checked against the object files of all
+ * other files. Their bodies are read when the classes of the stale
+ * files are known, as they may refer to them (see check()).
+ */
+static void compileRound(void) {
+    char *names[MAX_INFILES];
+    int stale[MAX_INFILES];
+    Absyn *fileTrees[MAX_INFILES];
+    char **loadNames;
+    int numStale;
+    int numLoad;
+    Table *globalTable;
+    Table **fileTables;
+    InstrProgram *code;
+    unsigned long interfaceHash;
+    NameList *oldDefs;
+    boolean *changed;
+    CacheFile *f;
+    int i, k;
+
+    numRounds++;
+    useArena(ARENA_PARSE);
+    do {
+        numStale = 0;
+        for (i = 0; i < numFiles; i++) {
+            if (files[i].state == FILE_STALE) {
+                stale[numStale] = i;
+                names[numStale] = files[i].name;
+                numStale++;
+            }
+        }
+        parseFiles(numStale, names, fileTrees);
+    } while (markRemovedClassUsers(fileTrees, numStale, stale));
+    /* the object files of the stale files are about to be overwritten */
+    writeIndex();
+
+    useArena(ARENA_SEMANT);
+    loadNames = (char **) allocate((numLibFiles + numFiles) * sizeof(char *));
+    numLoad = 0;
+    for (i = 0; i < numLibFiles; i++) {
+        loadNames[numLoad++] = libFileNames[i];
+    }
+    for (i = 0; i < numFiles; i++) {
+        if (files[i].state != FILE_STALE) {
+            loadNames[numLoad++] = files[i].objName;
+        }
+    }
+    resetLibraries();
+    globalTable = newGlobalTable();
+    readLibraryHeaders(numLoad, loadNames, globalTable);
+    collectClassRefs = TRUE;
+    fileTables = check(fileTrees, numStale, globalTable, FALSE, TRUE);
+    collectClassRefs = FALSE;
+    if (optimizationLevel >= 2) {
+        startPass(PASS_OPTIMIZE);
+        analyzeEscapes(fileTrees, numStale);
+        endPass(PASS_OPTIMIZE);
+    }
+
+    useArena(ARENA_CODEGEN);
+    oldDefs = (NameList *) allocate(numStale * sizeof(NameList));
+    changed = (boolean *) allocate(numStale * sizeof(boolean));
+    for (k = 0; k < numStale; k++) {
+        f = &files[stale[k]];
+        code = generateLibraryCode(&fileTrees[k], 1, &fileTables[k]);
+        interfaceHash = writeLibrary(f->objName, &fileTrees[k], 1,
+                &fileTables[k], code);
+        oldDefs[k] = f->defs;
+        collectDefs(fileTrees[k], &f->defs);
+        clearNames(&f->refs);
+        collectRefs(referencedClasses(k)->bintree, f);
+        changed[k] = !f->hasInterface || f->interfaceHash != interfaceHash;
+        f->hasInterface = TRUE;
+        f->interfaceHash = interfaceHash;
+        f->state = FILE_BUILT;
+        f->round = numRounds;
+        numCompiled++;
+    }
+    for (k = 0; k < numStale; k++) {
+        if (changed[k]) {
+            /* classes may have been added or removed */
+            markDependents(&oldDefs[k]);
+            markDependents(&files[stale[k]].defs);
+        }
+    }
+    writeIndex();
+    release(changed);
+    release(oldDefs);
+    /* the next round loads and checks the files again */
+    releaseArena(ARENA_SEMANT);
+}
+
+
+static void linkProgram(FILE *outFile, boolean emitBinary) {
+    char **loadNames;
+    int numLoad;
+    Table *globalTable;
+    InstrProgram *program;
+    int i;
+
+    useArena(ARENA_SEMANT);
+    loadNames = (char **) allocate((numLibFiles + numFiles) * sizeof(char *));
+    numLoad = 0;
+    for (i = 0; i < numLibFiles; i++) {
+        loadNames[numLoad++] = libFileNames[i];
+    }
+    for (i = 0; i < numFiles; i++) {
+        loadNames[numLoad++] = files[i].objName;
+    }
+    resetLibraries();
+    globalTable = newGlobalTable();
+    readLibraries(numLoad, loadNames, globalTable);
+    /* check() is not run, the loaded interfaces declare the builtins */
+    initWellKnownTypes(globalTable);
+    useArena(ARENA_CODEGEN);
+    program = generateCode(NULL, 0, NULL, globalTable);
+    /* the loaded files are not needed to write the code */
+    releaseArena(ARENA_SEMANT);
+    writeProgram(program, outFile, emitBinary);
+}
+
+
+void buildWithCache(char *dir, int numInFiles, char *inFileNames[],
+        int numObjFiles, char *objFileNames[],
+        FILE *outFile, boolean emitBinary) {
+    char options[40];
+    char objName[20];
+    CacheFile *f;
+    boolean haveStale;
+    int i, j;
+
+    cacheDir = dir;
+    if (mkdir(cacheDir, 0777) != 0 && errno != EEXIST) {
+        error("cannot create cache directory '%s'", cacheDir);
+    }
+    libFileNames = objFileNames;
+    numLibFiles = numObjFiles;
+    if (sharesIntegers()) {
+        sprintf(options, "-O%d %d,%d", optimizationLevel,
+                intCacheMin, intCacheMax);
+    } else {
+        /* the range may have been taken from a loaded file */
+        sprintf(options, "-O%d", optimizationLevel);
+    }
+    optionsHash = djb2(options);
+    for (i = 0; i < numLibFiles; i++) {
+        optionsHash = ((optionsHash << 5) + optionsHash) + hashFile(libFileNames[i]);
+    }
+
+    numFiles = numInFiles;
+    files = (CacheFile *) allocate(numFiles * sizeof(CacheFile));
+    for (i = 0; i < numFiles; i++) {
+        f = &files[i];
+        f->name = inFileNames[i];
+        sprintf(objName, "%lx.njo", djb2(f->name) & 0xFFFFFFFFUL);
+        f->objName = cachePath(objName);
+        for (j = 0; j < i; j++) {
+            if (strcmp(files[j].objName, f->objName) == 0) {
+                error("input files '%s' and '%s' share a cache entry",
+                        files[j].name, f->name);
+            }
+        }
+        f->hash = hashFile(f->name);
+        f->hasInterface = FALSE;
+        f->interfaceHash = 0;
+        clearNames(&f->defs);
+        clearNames(&f->refs);
+        f->state = FILE_STALE;
+        f->round = 0;
+    }
+    readIndex();
+
+    numRounds = 0;
+    numCompiled = 0;
+    while (1) {
+        haveStale = FALSE;
+        for (i = 0; i < numFiles; i++) {
+            haveStale = haveStale || files[i].state == FILE_STALE;
+        }
+        if (!haveStale) {
+            break;
+        }
+        if (numRounds == numFiles) {
+            /* the interfaces do not settle, compile all files together */
+            for (i = 0; i < numFiles; i++) {
+                files[i].state = FILE_STALE;
+            }
+        }
+        compileRound();
+    }
+    linkProgram(outFile, emitBinary);
+}
+
+
+void showCacheStats(FILE *file) {
+    fprintf(file, "Build cache:\n");
+    fprintf(file, "  %-28s %d of %d\n", "files compiled", numCompiled, numFiles);
+    fprintf(file, "  %-28s %d\n", "rounds", numRounds);
+}
@@ -0,0 +1,13 @@
+/*
+ * cache.h -- incremental builds with a build cache
+ */
+
+#ifndef CACHE_H
+#define	CACHE_H
+
+void buildWithCache(char *dir, int numInFiles, char *inFileNames[],
+        int numObjFiles, char *objFileNames[],
+        FILE *outFile, boolean emitBinary);
+void showCacheStats(FILE *file);
+
+#endif	/* CACHE_H */
@@ -0,0 +1,106 @@
+/*
+ * cha.c -- class hierarchy analysis
+ *
+ * All classes of the program are known after the semantic analysis.
+ * A virtual call is monomorphic if the receiver's static class and all
+ * of its subclasses share the same implementation of the method. Such
+ * a call can be bound at compile time: codegen emits a direct 'call'
+ * instead of dispatching through the VMT with 'vmcall'.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "sym.h"
+#include "types.h"
+#include "absyn.h"
+#include "table.h"
+#include "vmt.h"
+#include "instr.h"
+#include "library.h"
+#include "cha.h"
+
+
+static ClassList *allClasses = NULL;
+
+
+void analyzeClassHierarchy(Absyn *fileTrees[], int numInFiles, Table **fileTables) {
+    Absyn *classList;
+    Entry *classEntry;
+    Class *class;
+    int i;
+
+    allClasses = emptyClassList();
+    for (i = 0; i < numInFiles; i++) {
+        for (classList = fileTrees[i]->u.file.classes;
+                !classList->u.clsList.isEmpty;
+                classList = classList->u.clsList.tail) {
+            classEntry = lookupClass(&fileTables[i], fileTables[i]->outerScope,
+                    classList->u.clsList.head->u.classDec.name);
+            class = classEntry->u.classEntry.class;
+            allClasses = newClassList(allClasses, class);
+            allClasses = newClassList(allClasses, class->metaClass);
+        }
+    }
+    for (i = 0; i < library.numClasses; i++) {
+        allClasses = newClassList(allClasses, library.classes[i]);
+    }
+}
+
+
+static boolean isSameMethod(VMTEntry *method1, VMTEntry *method2) {
+    return method1 != NULL && method2 != NULL
+            && strcmp(method1->className, method2->className) == 0
+            && strcmp(method1->fileName, method2->fileName) == 0;
+}
+
+
+static VMTEntry *findMonomorphicTarget(Class *rcvrClass, Sym *name) {
+    ClassList *classList;
+    VMTEntry *target;
+
+    target = lookupVMT(rcvrClass->vmt, name);
+    if (target == NULL) {
+        return NULL;
+    }
+    for (classList = allClasses;
+            !classList->isEmpty;
+            classList = classList->tail) {
+        if (isSameOrSubclassOf(classList->head, rcvrClass)
+                && !isSameMethod(lookupVMT(classList->head->vmt, name), target)) {
+            /* overridden in a subclass */
+            return NULL;
+        }
+    }
+    return target;
+}
+
+
+/*
+ * The target of a call is known at compile time for static methods
+ * and super calls, and for virtual calls with a single implementation.
+ * A super call must not reach an override of the receiver's class, it
+ * is bound at every level, also without the analysis.
+ */
+VMTEntry *findCallTarget(Absyn *rcvr, Class *rcvrClass, Sym *name,
+        Entry *methodEntry, Entry *currentMethod) {
+    Entry *superEntry;
+
+    if (!methodEntry->u.methodEntry.isStatic && rcvr->type == ABSYN_SUPEREXP) {
+        superEntry = lookupMember(currentMethod->u.methodEntry.class->superClass,
+                name, ENTRY_KIND_METHOD);
+        return lookupVMT(superEntry->u.methodEntry.class->vmt, name);
+    }
+    if (allClasses == NULL) {
+        /* no analysis, every other call stays virtual */
+        return NULL;
+    }
+    if (methodEntry->u.methodEntry.isStatic) {
+        return lookupVMT(methodEntry->u.methodEntry.class->vmt, name);
+    }
+    return findMonomorphicTarget(rcvrClass, name);
+}
@@ -0,0 +1,12 @@
+/*
+ * cha.h -- class hierarchy analysis
+ */
+
+#ifndef CHA_H
+#define	CHA_H
+
+void analyzeClassHierarchy(Absyn *fileTrees[], int numInFiles, Table **fileTables);
+VMTEntry *findCallTarget(Absyn *rcvr, Class *rcvrClass, Sym *name,
+        Entry *methodEntry, Entry *currentMethod);
+
+#endif	/* CHA_H */
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "common.h"
 #include "utils.h"
@@ -10,10 +11,46 @@
 #include "absyn.h"
 #include "instance.h"
 #include "table.h"
+#include "escape.h"
+#include "cha.h"
+#include "inline.h"
+#include "instr.h"
+#include "peephole.h"
+#include "superinstr.h"
+#include "binary.h"
+#include "wellknown.h"
+#include "parallel.h"
+#include "library.h"
 #include "codegen.h"
+#include "timer.h"
+
+/*
+ * The classes are generated in parallel (see generateClasses), each
+ * one into a program of its own. The state of the class a thread is
+ * working on lives in a ClassGen which belongs to that thread.
+ */
+typedef struct {
+    Absyn *node;		/* the class declaration, NULL for the framework */
+    Class *class;		/* its class, whose fields the methods use */
+    Table *fileTable;
+    int index;			/* number of the class, makes its labels unique */
+    int numLabels;
+    InstrProgram *program;	/* the buffers of the class */
+    InstrBuffer *code;		/* the buffer being generated */
+} ClassGen;
 
-static FILE *asmFile;
 static ClassList *metaClasses;
+static ClassGen *classGens;
+static int numClassGens;
+static pthread_key_t classGenKey;
+static pthread_once_t classGenOnce = PTHREAD_ONCE_INIT;
+
+/* "_L", made unique for the code of a library or object file */
+static char *labelPrefix;
+
+/* the shared Integers, see --int-cache */
+int intCacheMin = -128;
+int intCacheMax = 1023;
 
 /* Function decs */
 static void generateCodeNode(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel);
@@ -37,16 +74,167 @@ static char* newMethodLabel(char* filepath, char* classname, char* methodname, b
     return label;
 }
 
+static ClassGen *currentGen(void) {
+    return (ClassGen *) pthread_getspecific(classGenKey);
+}
+
+static InstrBuffer *currentCode(void) {
+    return currentGen()->code;
+}
+
+/* start a new buffer which is written after all others of the class */
+static void beginBuffer(void) {
+    ClassGen *gen = currentGen();
+
+    gen->code = appendInstrBuffer(gen->program);
+}
+
 static int newLabel(void) {
-    static int numLabels = 0;
+    return currentGen()->numLabels++;
+}
+
+static char *labelName(int label) {
+    char *name;
 
-    return numLabels++;
+    /* Label: prefix + class number + _ + number */
+    name = (char *) allocate(strlen(labelPrefix) + 11 + 1 + 11 + 1);
+    sprintf(name, "%s%d_%d", labelPrefix, currentGen()->index, label);
+
+    return name;
+}
+
+char *classLabel(Class *class) {
+    char *label;
+
+    /* Label: ClassName_hash (+1 for underline, +16 for hash) */
+    label = (char *) allocate(strlen(class->name->string) + 1 + 16 + 1);
+    sprintf(label, "%s_%lx", class->name->string, djb2(class->fileName));
+
+    return label;
+}
+
+/* the code generated now takes small Integers from the cache */
+boolean sharesIntegers(void) {
+    return optimizationLevel >= 1;
+}
+
+/* global 0 holds the cache if any code of the program uses it */
+int firstClassGlobal(void) {
+    return sharesIntegers() || library.intCache ? INT_CACHE_GLOBAL + 1 : 0;
+}
+
+static char *quoted(char *string) {
+    char *text;
+
+    text = (char *) allocate(strlen(string) + 2 + 1);
+    sprintf(text, "\"%s\"", string);
+
+    return text;
+}
+
+static void generateVMT(VMT *vmt) {
+    VMTEntry *entry;
+    int i;
+
+    for (i = 0; i < vmt->numEntries; i++) {
+        entry = &vmt->entries[i];
+        appendInstr3(currentCode(), OP_ADDR, newMethodLabel(entry->fileName,
+                entry->className, symToString(entry->name), FALSE));
+    }
 }
 
 static void shouldNotReach(char *nodeName) {
     error("code generation should not reach '%s' node", nodeName);
 }
 
+/*
+ * Generate code which leaves the raw value of an Integer or
+ * Boolean expression on the stack (unboxed ones already do).
+ */
+static void generateRawValue(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
+    generateCodeNode(node, table, currentMethod, returnLabel, breakLabel);
+    if (!isUnboxed(node)) {
+        appendInstr1(currentCode(), OP_GETF, 1);
+    }
+}
+
+/*
+ * Generate a new object of a boxed class and duplicate it,
+ * so that the value calculated afterwards can be put into field 1.
+ */
+static void generateNewBox(Class *class) {
+    appendInstr1(currentCode(), OP_NEW, 2);
+    appendInstr3(currentCode(), OP_ADDR, classLabel(class));
+    appendInstr0(currentCode(), OP_DUP);
+}
+
+/*
+ * Begin an Integer whose raw value is calculated afterwards, the
+ * cache is pushed in case the value turns out to be small.
+ */
+static void beginIntegerBox(void) {
+    if (sharesIntegers()) {
+        appendInstrGlobal(currentCode(), OP_PUSHG, INT_CACHE_GLOBAL, NULL);
+    } else {
+        generateNewBox(wellKnown.integerClass);
+    }
+}
+
+/*
+ * Finish the Integer begun by beginIntegerBox. A value out of the
+ * cache's range gets a new box, it is kept in the return register
+ * while the cache is dropped.
+ */
+static void endIntegerBox(void) {
+    int newBox, done;
+
+    if (!sharesIntegers()) {
+        appendInstr1(currentCode(), OP_PUTF, 1);
+        return;
+    }
+    newBox = newLabel();
+    done = newLabel();
+    appendInstr0(currentCode(), OP_DUP);
+    appendInstr1(currentCode(), OP_PUSHC, intCacheMin);
+    appendInstr0(currentCode(), OP_LT);
+    appendInstr3(currentCode(), OP_BRT, labelName(newBox));
+    appendInstr0(currentCode(), OP_DUP);
+    appendInstr1(currentCode(), OP_PUSHC, intCacheMax);
+    appendInstr0(currentCode(), OP_GT);
+    appendInstr3(currentCode(), OP_BRT, labelName(newBox));
+    appendInstr1(currentCode(), OP_PUSHC, intCacheMin);
+    appendInstr0(currentCode(), OP_SUB);
+    appendInstr0(currentCode(), OP_GETFA);
+    appendInstr3(currentCode(), OP_JMP, labelName(done));
+    appendLabel(currentCode(), labelName(newBox));
+    appendInstr0(currentCode(), OP_POPR);
+    appendInstr1(currentCode(), OP_DROP, 1);
+    generateNewBox(wellKnown.integerClass);
+    appendInstr0(currentCode(), OP_PUSHR);
+    appendInstr1(currentCode(), OP_PUTF, 1);
+    appendLabel(currentCode(), labelName(done));
+}
+
+/*
+ * Push the object of a class, which holds its static fields.
+ */
+static void pushClassObject(Class *class) {
+    appendInstrGlobal(currentCode(), OP_PUSHG, class->metaClass->globalIndex,
+            classLabel(class->metaClass));
+}
+
+/*
+ * A static field is a field of the object of the class declaring it,
+ * also when it is used through a subclass.
+ */
+static void pushStaticFieldOwner(Class *class, Sym *name) {
+    while (class->superClass != NULL
+            && lookupMember(class->superClass, name, ENTRY_KIND_VARIABLE) != NULL) {
+        class = class->superClass;
+    }
+    pushClassObject(class);
+}
+
 /*
  * Absyn *node: LHS of expression
  * Absyn *exp: RHS of expression
@@ -58,6 +246,11 @@ static void handleVar(Absyn *node, Absyn *exp, Table *table, Entry *currentMetho
         {
             Entry *entry;
             entry = lookup(table, node->u.simpleVar.name, ENTRY_KIND_VARIABLE | ENTRY_KIND_CLASS);
+            if (entry == NULL) {
+                /* a field inherited from a superclass */
+                entry = lookupMember(currentGen()->class, node->u.simpleVar.name,
+                        ENTRY_KIND_VARIABLE);
+            }
             if (entry == NULL) {
                 error("variable/class declaration of '%s' vanished from symbol table",
                         symToString(node->u.simpleVar.name));
@@ -66,22 +259,28 @@ static void handleVar(Absyn *node, Absyn *exp, Table *table, Entry *currentMetho
                 if (exp) {
                     generateCodeNode(exp, table, currentMethod, returnLabel, breakLabel);
                 }
-                fprintf(asmFile, "\tpushg\t%d\n", entry->u.classEntry.class->globalIndex);
+                appendInstrGlobal(currentCode(), OP_PUSHG,
+                        entry->u.classEntry.class->globalIndex,
+                        classLabel(entry->u.classEntry.class));
             }/* "self." is optional */
             else if (entry->u.variableEntry.isLocal) {
                 if (exp) {
                     generateCodeNode(exp, table, currentMethod, returnLabel, breakLabel);
                 }
-                fprintf(asmFile, "\t%s\t%d\n", write ? "popl" : "pushl", entry->u.variableEntry.offset);
+                appendInstr1(currentCode(), write ? OP_POPL : OP_PUSHL, entry->u.variableEntry.offset);
             } else {
-                /* push self */
-                fprintf(asmFile, "\tpushl\t%d\n", -3 - currentMethod->u.methodEntry.numParams);
+                if (entry->u.variableEntry.isStatic) {
+                    pushStaticFieldOwner(currentGen()->class, node->u.simpleVar.name);
+                } else {
+                    /* push self */
+                    appendInstr1(currentCode(), OP_PUSHL, -3 - currentMethod->u.methodEntry.numParams);
+                }
                 /* push value */
                 if (exp) {
                     generateCodeNode(exp, table, currentMethod, returnLabel, breakLabel);
                 }
                 /* access field */
-                fprintf(asmFile, "\t%s\t%d\n", write ? "putf" : "getf", entry->u.variableEntry.offset);
+                appendInstr1(currentCode(), write ? OP_PUTF : OP_GETF, entry->u.variableEntry.offset);
             }
         }
             break;
@@ -97,30 +296,32 @@ static void handleVar(Absyn *node, Absyn *exp, Table *table, Entry *currentMetho
             if (fieldEntry == NULL) {
                 error("field declaration '%s' vanished from symbol table", node->u.memberVar.name->string);
             }
-            if(node->u.memberVar.object->type == ABSYN_SUPEREXP
+            if (fieldEntry->u.variableEntry.isStatic) {
+                /* the object is a class name */
+                pushStaticFieldOwner(class, node->u.memberVar.name);
+            } else if(node->u.memberVar.object->type == ABSYN_SUPEREXP
                     || node->u.memberVar.object->type == ABSYN_SELFEXP) {
                 /* push receiver from stack */
-                fprintf(asmFile, "\tpushl\t%d\n", thisPosition);
+                appendInstr1(currentCode(), OP_PUSHL, thisPosition);
             } else {
                 generateCodeNode(node->u.memberVar.object, table, currentMethod, returnLabel, breakLabel);
             }
             if (exp) {
                 generateCodeNode(exp, table, currentMethod, returnLabel, breakLabel);
             }
-            fprintf(asmFile, "\t%s\t%d\n", write ? "putf" : "getf", fieldEntry->u.variableEntry.offset);
+            appendInstr1(currentCode(), write ? OP_PUTF : OP_GETF, fieldEntry->u.variableEntry.offset);
         }
         break;
 
         case ABSYN_ARRAYVAR:
         {
             generateCodeNode(node->u.arrayVar.var, table, currentMethod, returnLabel, breakLabel);
-            generateCodeNode(node->u.arrayVar.index, table, currentMethod, returnLabel, breakLabel);
             /* The index is an integer value and we need to push it onto the stack */
-            fprintf(asmFile, "\tgetf\t1\n");
+            generateRawValue(node->u.arrayVar.index, table, currentMethod, returnLabel, breakLabel);
             if (exp) {
                 generateCodeNode(exp, table, currentMethod, returnLabel, breakLabel);
             }
-            fprintf(asmFile, "\t%s\n", write ? "putfa" : "getfa");
+            appendInstr0(currentCode(), write ? OP_PUTFA : OP_GETFA);
         }
             break;
 
@@ -130,28 +331,6 @@ static void handleVar(Absyn *node, Absyn *exp, Table *table, Entry *currentMetho
     }
 }
 
-static void generateCodeFile(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
-    fprintf(asmFile, "// File \"%s\"\n", node->file);
-    generateCodeNode(node->u.file.classes, table, currentMethod, returnLabel, breakLabel);
-}
-
-static void generateCodeClsList(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
-    Absyn *classList;
-    Absyn *classDec;
-
-    classList = node;
-
-    if (!classList->u.clsList.isEmpty) {
-        for (classDec = classList->u.clsList.head;
-                classList->u.clsList.isEmpty == FALSE;
-                classList = classList->u.clsList.tail,
-                classDec = classList->u.clsList.head) {
-
-            generateCodeNode(classDec, table, currentMethod, returnLabel, breakLabel);
-        }
-    }
-}
-
 static void generateCodeClassDec(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
     Class *class;
     Class *metaClass;
@@ -159,27 +338,27 @@ static void generateCodeClassDec(Absyn *node, Table *table, Entry *currentMethod
     Entry *classEntry = lookupClass(&table, (table)->outerScope, node->u.classDec.name);
     class = classEntry->u.classEntry.class;
     metaClass = class->metaClass;
+    currentGen()->class = class;
 
-    /* Add meta class to the list of meta classes for _prolog generation */
-    metaClasses = newClassList(metaClasses, metaClass);
-
-    fprintf(asmFile, "// Metaclass \"%s\"\n", metaClass->name->string);
-    fprintf(asmFile, "%s_%lx:\n", metaClass->name->string, djb2(node->file));
+    beginBuffer();
+    appendComment(currentCode(), appendString("Metaclass ", quoted(metaClass->name->string)));
+    appendLabel(currentCode(), classLabel(metaClass));
     if (strcmp(metaClass->name->string, "$Object") == 0) {
-        fprintf(asmFile, ".addr\tnil\n");
+        appendInstr3(currentCode(), OP_ADDR, "nil");
     } else {
-        fprintf(asmFile, ".addr\t%s_%lx\n", metaClass->superClass->name->string, djb2(metaClass->superClass->fileName));
+        appendInstr3(currentCode(), OP_ADDR, classLabel(metaClass->superClass));
     }
-    printVMT(asmFile, metaClass->vmt);
+    generateVMT(metaClass->vmt);
 
-    fprintf(asmFile, "// Class \"%s\"\n", node->u.classDec.name->string);
-    fprintf(asmFile, "%s_%lx:\n", node->u.classDec.name->string, djb2(node->file));
-    if (strcmp(node->u.classDec.name->string, "Object") == 0) {
-        fprintf(asmFile, ".addr\tnil\n");
+    beginBuffer();
+    appendComment(currentCode(), appendString("Class ", quoted(class->name->string)));
+    appendLabel(currentCode(), classLabel(class));
+    if (strcmp(class->name->string, "Object") == 0) {
+        appendInstr3(currentCode(), OP_ADDR, "nil");
     } else {
-        fprintf(asmFile, ".addr\t%s_%lx\n", classEntry->u.classEntry.class->superClass->name->string, djb2(classEntry->u.classEntry.class->superClass->fileName));
+        appendInstr3(currentCode(), OP_ADDR, classLabel(class->superClass));
     }
-    printVMT(asmFile, classEntry->u.classEntry.class->vmt);
+    generateVMT(class->vmt);
     generateCodeNode(node->u.classDec.members, classEntry->u.classEntry.class->mbrTable, currentMethod, returnLabel, breakLabel);
 }
 
@@ -212,19 +391,21 @@ static void generateCodeMethodDec(Absyn *node, Table *table, Entry *currentMetho
     methodEntry = lookupMember(node->u.methodDec.class, node->u.methodDec.name, ENTRY_KIND_METHOD);
     methodLabel = newMethodLabel(node->file, methodEntry->u.methodEntry.class->name->string, node->u.methodDec.name->string, methodEntry->u.methodEntry.isStatic);
 
-    fprintf(asmFile, "%s:\n", methodLabel);
-    fprintf(asmFile, "\tasf\t%d\n", methodEntry->u.methodEntry.numLocals);
+    beginBuffer();
+    appendLabel(currentCode(), methodLabel);
+    appendInstr1(currentCode(), OP_ASF, methodEntry->u.methodEntry.numLocals);
 
     newRetLabel = newLabel();
     generateCodeNode(node->u.methodDec.stms, methodEntry->u.methodEntry.localTable, methodEntry, newRetLabel, breakLabel);
 
     /* generate function epilog */
-    fprintf(asmFile, "_L%d:\n", newRetLabel);
-    fprintf(asmFile, "\trsf\n");
-    fprintf(asmFile, "\tret\n");
-    fprintf(asmFile, "\n");
+    appendLabel(currentCode(), labelName(newRetLabel));
+    appendInstr0(currentCode(), OP_RSF);
+    appendInstr0(currentCode(), OP_RET);
 
-    free(methodLabel);
+    if (optimizationLevel >= 1) {
+        optimizeInstrs(currentCode());
+    }
 }
 
 static void generateCodeStmsList(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
@@ -265,16 +446,27 @@ static void generateCodeAsmInstrList(Absyn *node, Table *table, Entry *currentMe
     }
 }
 
+static int asmOpcode(Absyn *node, char *mnemonic) {
+    int opcode;
+
+    opcode = lookupOpcode(mnemonic);
+    if (opcode < 0) {
+        error("unknown instruction '%s' in '%s' on line %d",
+                mnemonic, node->file, node->line);
+    }
+    return opcode;
+}
+
 static void generateCodeAsmInstr0(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
-    fprintf(asmFile, "\t%s\n", node->u.asmInstr0.instr);
+    appendInstr0(currentCode(), asmOpcode(node, node->u.asmInstr0.instr));
 }
 
 static void generateCodeAsmInstr1(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
-    fprintf(asmFile, "\t%s\t%d\n", node->u.asmInstr1.instr, node->u.asmInstr1.immediate);
+    appendInstr1(currentCode(), asmOpcode(node, node->u.asmInstr1.instr), node->u.asmInstr1.immediate);
 }
 
 static void generateCodeAsmInstr2(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
-    fprintf(asmFile, "\t%s\t%d,%d\n", node->u.asmInstr2.instr, node->u.asmInstr2.numArgs, node->u.asmInstr2.offset);
+    appendInstr2(currentCode(), asmOpcode(node, node->u.asmInstr2.instr), node->u.asmInstr2.numArgs, node->u.asmInstr2.offset);
 }
 
 static void generateCodeAsmInstr3(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
@@ -283,9 +475,11 @@ static void generateCodeAsmInstr3(Absyn *node, Table *table, Entry *currentMetho
     if (strcmp(node->u.asmInstr3.instr, ".addr") == 0) {
         classEntry = lookup(table, newSym(node->u.asmInstr3.label), ENTRY_KIND_CLASS);
         class = classEntry->u.classEntry.class;
-        fprintf(asmFile, "\t%s\t%s_%lx\n", node->u.asmInstr3.instr, node->u.asmInstr3.label, djb2(class->fileName));
+        appendInstr3(currentCode(), OP_ADDR, classLabel(class));
     } else {
-        fprintf(asmFile, "\t%s\t%s\n", node->u.asmInstr3.instr, node->u.asmInstr3.label);
+        /* the syntax tree is released before the code is written */
+        appendInstr3(currentCode(), asmOpcode(node, node->u.asmInstr3.instr),
+                copyString(node->u.asmInstr3.label));
     }
 
 }
@@ -318,7 +512,7 @@ static void generateCodeAssignStmt(Absyn *node, Table *table, Entry *currentMeth
     /* Depending on the receiver of the value we need
      * to do a different evaluation.
      */
-    /*    fprintf(asmFile, "\tpopl\t%d\n", entry->u.variableEntry.offset);*/
+    /*    appendInstr1(currentCode(), OP_POPL, entry->u.variableEntry.offset);*/
 
     /*    Absyn *varVar = var->u.varExp.var;*/
     /*    Type *varType = var->u.varExp.expType;*/
@@ -338,11 +532,10 @@ static void generateCodeIfStmt1(Absyn *node, Table *table, Entry *currentMethod,
     int label1;
 
     label1 = newLabel();
-    generateCodeNode(node->u.ifStm1.test, table, currentMethod, returnLabel, breakLabel);
-    fprintf(asmFile, "\tgetf\t1\n");
-    fprintf(asmFile, "\tbrf\t_L%d\n", label1);
+    generateRawValue(node->u.ifStm1.test, table, currentMethod, returnLabel, breakLabel);
+    appendInstr3(currentCode(), OP_BRF, labelName(label1));
     generateCodeNode(node->u.ifStm1.thenPart, table, currentMethod, returnLabel, breakLabel);
-    fprintf(asmFile, "_L%d:\n", label1);
+    appendLabel(currentCode(), labelName(label1));
 }
 
 static void generateCodeIfStmt2(Absyn *node, Table *table, Entry *currentMethod,
@@ -352,14 +545,13 @@ static void generateCodeIfStmt2(Absyn *node, Table *table, Entry *currentMethod,
 
     label1 = newLabel();
     label2 = newLabel();
-    generateCodeNode(node->u.ifStm2.test, table, currentMethod, returnLabel, breakLabel);
-    fprintf(asmFile, "\tgetf\t1\n");
-    fprintf(asmFile, "\tbrf\t_L%d\n", label1);
+    generateRawValue(node->u.ifStm2.test, table, currentMethod, returnLabel, breakLabel);
+    appendInstr3(currentCode(), OP_BRF, labelName(label1));
     generateCodeNode(node->u.ifStm2.thenPart, table, currentMethod, returnLabel, breakLabel);
-    fprintf(asmFile, "\tjmp\t_L%d\n", label2);
-    fprintf(asmFile, "_L%d:\n", label1);
+    appendInstr3(currentCode(), OP_JMP, labelName(label2));
+    appendLabel(currentCode(), labelName(label1));
     generateCodeNode(node->u.ifStm2.elsePart, table, currentMethod, returnLabel, breakLabel);
-    fprintf(asmFile, "_L%d:\n", label2);
+    appendLabel(currentCode(), labelName(label2));
 }
 
 static void generateCodeWhileStmt(Absyn *node, Table *table, Entry *currentMethod,
@@ -369,14 +561,13 @@ static void generateCodeWhileStmt(Absyn *node, Table *table, Entry *currentMetho
     label1 = newLabel();
     label2 = newLabel();
     newBreakLabel = newLabel();
-    fprintf(asmFile, "\tjmp\t_L%d\n", label2);
-    fprintf(asmFile, "_L%d:\n", label1);
+    appendInstr3(currentCode(), OP_JMP, labelName(label2));
+    appendLabel(currentCode(), labelName(label1));
     generateCodeNode(node->u.whileStm.body, table, currentMethod, returnLabel, newBreakLabel);
-    fprintf(asmFile, "_L%d:\n", label2);
-    generateCodeNode(node->u.whileStm.test, table, currentMethod, returnLabel, newBreakLabel);
-    fprintf(asmFile, "\tgetf\t1\n");
-    fprintf(asmFile, "\tbrt\t_L%d\n", label1);
-    fprintf(asmFile, "_L%d:\n", newBreakLabel);
+    appendLabel(currentCode(), labelName(label2));
+    generateRawValue(node->u.whileStm.test, table, currentMethod, returnLabel, newBreakLabel);
+    appendInstr3(currentCode(), OP_BRT, labelName(label1));
+    appendLabel(currentCode(), labelName(newBreakLabel));
 }
 
 static void generateCodeDoStmt(Absyn *node, Table *table, Entry *currentMethod,
@@ -385,12 +576,11 @@ static void generateCodeDoStmt(Absyn *node, Table *table, Entry *currentMethod,
 
     label1 = newLabel();
     newBreakLabel = newLabel();
-    fprintf(asmFile, "_L%d:\n", label1);
+    appendLabel(currentCode(), labelName(label1));
     generateCodeNode(node->u.doStm.body, table, currentMethod, returnLabel, newBreakLabel);
-    generateCodeNode(node->u.doStm.test, table, currentMethod, returnLabel, newBreakLabel);
-    fprintf(asmFile, "\tgetf\t1\n");
-    fprintf(asmFile, "\tbrt\t_L%d\n", label1);
-    fprintf(asmFile, "_L%d:\n", newBreakLabel);
+    generateRawValue(node->u.doStm.test, table, currentMethod, returnLabel, newBreakLabel);
+    appendInstr3(currentCode(), OP_BRT, labelName(label1));
+    appendLabel(currentCode(), labelName(newBreakLabel));
 }
 
 static void generateCodeBreakStmt(Absyn *node, Table *table, Entry *currentMethod,
@@ -398,7 +588,7 @@ static void generateCodeBreakStmt(Absyn *node, Table *table, Entry *currentMetho
     if (breakLabel == -1) {
         error("no valid break label in genCodeBreakStm");
     }
-    fprintf(asmFile, "\tjmp\t_L%d\n", breakLabel);
+    appendInstr3(currentCode(), OP_JMP, labelName(breakLabel));
 }
 
 static void generateCodeRetStmt(Absyn *node, Table *table, Entry *currentMethod,
@@ -406,17 +596,67 @@ static void generateCodeRetStmt(Absyn *node, Table *table, Entry *currentMethod,
     if (returnLabel == -1) {
         error("no valid return label in genCodeRetStm");
     }
-    fprintf(asmFile, "\tjmp\t_L%d\n", returnLabel);
+    appendInstr3(currentCode(), OP_JMP, labelName(returnLabel));
 }
 
 static void generateCodeRetExpStmt(Absyn *node, Table *table, Entry *currentMethod,
         int returnLabel, int breakLabel) {
     generateCodeNode(node->u.retExpStm.exp, table, currentMethod, returnLabel, breakLabel);
-    fprintf(asmFile, "\tpopr\n");
+    appendInstr0(currentCode(), OP_POPR);
     if (returnLabel == -1) {
         error("no valid return label in genCodeRetExpStm");
     }
-    fprintf(asmFile, "\tjmp\t_L%d\n", returnLabel);
+    appendInstr3(currentCode(), OP_JMP, labelName(returnLabel));
+}
+
+static void generateCallInstr(VMTEntry *target, int numArgs, int offset) {
+    char *label;
+
+    if (target != NULL) {
+        label = newMethodLabel(target->fileName, target->className,
+                symToString(target->name), FALSE);
+        appendInstr3(currentCode(), OP_CALL, label);
+    } else {
+        appendInstr2(currentCode(), OP_VMCALL, numArgs, offset + 1);
+    }
+}
+
+/*
+ * Copy the body of an asm method to the call site (see inline.c).
+ * Receiver and arguments are on the stack, they are moved to locals.
+ */
+static void generateInlineMethod(Absyn *methodDec, int inlineBase, boolean needsValue) {
+    Entry *methodEntry;
+    Absyn *instrList;
+    Absyn *instr;
+    int i;
+
+    methodEntry = lookupMember(methodDec->u.methodDec.class,
+            methodDec->u.methodDec.name, ENTRY_KIND_METHOD);
+
+    /* the last argument is on top, the receiver at the bottom */
+    for (i = 0; i <= methodEntry->u.methodEntry.numParams; i++) {
+        appendInstr1(currentCode(), OP_POPL, inlineBase + i);
+    }
+
+    for (instrList = methodDec->u.methodDec.stms->u.stmList.head->u.asmStm.instrList;
+            !instrList->u.asmInstrList.isEmpty;
+            instrList = instrList->u.asmInstrList.tail) {
+        instr = instrList->u.asmInstrList.head;
+        if (instr->type == ABSYN_ASMINSTR1
+                && strcmp(instr->u.asmInstr1.instr, "pushl") == 0) {
+            /* pushl -3 is the last argument */
+            appendInstr1(currentCode(), OP_PUSHL, inlineBase - 3 - instr->u.asmInstr1.immediate);
+        } else if (instr->type == ABSYN_ASMINSTR0
+                && strcmp(instr->u.asmInstr0.instr, "popr") == 0) {
+            /* the return value stays on the stack */
+            if (!needsValue) {
+                appendInstr1(currentCode(), OP_DROP, 1);
+            }
+        } else {
+            generateCodeNode(instr, methodEntry->u.methodEntry.localTable, methodEntry, -1, -1);
+        }
+    }
 }
 
 static void generateCodeCallStmt(Absyn *node, Table *table, Entry *currentMethod,
@@ -425,27 +665,29 @@ static void generateCodeCallStmt(Absyn *node, Table *table, Entry *currentMethod
     Sym *name = node->u.callStm.name;
     Class *rcvrClass = node->u.callStm.rcvrClass;
     Entry *methodEntry;
+    VMTEntry *target;
     int offset;
     int numParams;
     int thisPosition;
 
     methodEntry = lookupMember(rcvrClass, name, ENTRY_KIND_METHOD);
+    target = findCallTarget(node->u.callStm.rcvr, rcvrClass, name,
+            methodEntry, currentMethod);
 
     if (methodEntry->u.methodEntry.isStatic) {
         /* rcvrClass == rcvrMetaclass */
-        fprintf(asmFile, "\tpushg\t%d\n", rcvrClass->globalIndex);
+        appendInstrGlobal(currentCode(), OP_PUSHG, rcvrClass->globalIndex,
+                classLabel(rcvrClass));
     } else {
-        /* Position of self/super receiver on the stack as 0th argument */
-        thisPosition = -methodEntry->u.methodEntry.numParams - 2 - 1;
+        /* Position of self/super receiver below the current method's arguments */
+        thisPosition = -3 - currentMethod->u.methodEntry.numParams;
         /* We need to switch over the receiver of the callExp */
         switch (node->u.callStm.rcvr->type) {
             case ABSYN_SUPEREXP:
-                rcvrClass = methodEntry->u.methodEntry.class->superClass;
-                /* Refetch the methodEntry to get the correct label for vmcall */
-                methodEntry = lookupMember(rcvrClass, node->u.callStm.name, ENTRY_KIND_METHOD);
+                /* self, the call is bound to the superclass's method */
             case ABSYN_SELFEXP:
                 /* push receiver from stack */
-                fprintf(asmFile, "\tpushl\t%d\n", thisPosition);
+                appendInstr1(currentCode(), OP_PUSHL, thisPosition);
                 break;
             default:
                 generateCodeNode(node->u.callStm.rcvr, table, currentMethod, returnLabel, breakLabel);
@@ -458,8 +700,12 @@ static void generateCodeCallStmt(Absyn *node, Table *table, Entry *currentMethod
 
     generateCodeNode(args, table, currentMethod, returnLabel, breakLabel);
 
-    fprintf(asmFile, "\tvmcall\t%d,%d\n", numParams + 1, offset + 1);
-    fprintf(asmFile, "\tdrop\t%d\n", numParams + 1);
+    if (node->u.callStm.inlineMethod != NULL) {
+        generateInlineMethod(node->u.callStm.inlineMethod, node->u.callStm.inlineBase, FALSE);
+        return;
+    }
+    generateCallInstr(target, numParams + 1, offset);
+    appendInstr1(currentCode(), OP_DROP, numParams + 1);
 }
 
 static void generateCodeSuperExp(Absyn *node, Table *table, Entry *currentMethod,
@@ -473,7 +719,7 @@ static void generateVarExp(Absyn *node, Table *table, Entry *currentMethod,
     Sym *varName = getVarName(node);
     Entry *varEntry = lookup(currentMethod->u.methodEntry.localTable, varName, ENTRY_KIND_VARIABLE);
     if (varEntry != NULL) {
-        fprintf(asmFile, "\tpushl\t%d\n", varEntry->u.variableEntry.offset);
+        appendInstr1(currentCode(), OP_PUSHL, varEntry->u.variableEntry.offset);
     }
 }*/
 
@@ -494,16 +740,23 @@ static void generateCodeVarExp(Absyn *node, Table *table, Entry *currentMethod,
 
             /* lookup variable */
             varEntry = lookup(table, varName, ENTRY_KIND_VARIABLE);
+            if (varEntry == NULL) {
+                /* a field inherited from a superclass */
+                varEntry = lookupMember(currentGen()->class, varName, ENTRY_KIND_VARIABLE);
+            }
 
             if (varEntry != NULL) {
                 varOffset = varEntry->u.variableEntry.offset;
 
                 /* generate code to push the variable's value */
                 if (varEntry->u.variableEntry.isLocal) { /* real local variable or parameter */
-                    fprintf(asmFile, "\tpushl\t%d\n", varOffset);
+                    appendInstr1(currentCode(), OP_PUSHL, varOffset);
+                } else if (varEntry->u.variableEntry.isStatic) { /* field of a class object */
+                    pushStaticFieldOwner(currentGen()->class, varName);
+                    appendInstr1(currentCode(), OP_GETF, varOffset);
                 } else { /* field variable */
-                    fprintf(asmFile, "\tpushl\t%d\n", -3 -currentMethod->u.methodEntry.numParams);
-                    fprintf(asmFile, "\tgetf\t%d\n", varOffset);
+                    appendInstr1(currentCode(), OP_PUSHL, -3 -currentMethod->u.methodEntry.numParams);
+                    appendInstr1(currentCode(), OP_GETF, varOffset);
                 }
             } else {
                 /* else handle variable as class name */
@@ -513,7 +766,7 @@ static void generateCodeVarExp(Absyn *node, Table *table, Entry *currentMethod,
                     error("statically named class '%s' vanished from symbol table", varName);
                 }
 
-                fprintf(asmFile, "\tpushg\t%d\n", classEntry->u.classEntry.class->metaClass->globalIndex);
+                pushClassObject(classEntry->u.classEntry.class);
             }
 
             break;
@@ -523,10 +776,10 @@ static void generateCodeVarExp(Absyn *node, Table *table, Entry *currentMethod,
             generateCodeNode(varNode->u.arrayVar.var, table, currentMethod, returnLabel, breakLabel);
 
             /* generate code to push the index of the field to get */
-            generateCodeNode(varNode->u.arrayVar.index, table, currentMethod, returnLabel, breakLabel);
+            generateRawValue(varNode->u.arrayVar.index, table, currentMethod, returnLabel, breakLabel);
 
             /* generate the final get */
-            fprintf(asmFile, "\tgetfa\n");
+            appendInstr0(currentCode(), OP_GETFA);
             break;
 
         case ABSYN_MEMBERVAR:
@@ -535,14 +788,24 @@ static void generateCodeVarExp(Absyn *node, Table *table, Entry *currentMethod,
             /* get class of receiver object */
             /* objectClass = varNode->u.memberVar.objectClass; */
 
-            /* lookup field */
-            varEntry = lookup(table, varNode->u.memberVar.name, ENTRY_KIND_VARIABLE);
+            /* lookup field in the class of the object */
+            varEntry = lookupMember(varNode->u.memberVar.objectClass,
+                    varNode->u.memberVar.name, ENTRY_KIND_VARIABLE);
+            if (varEntry == NULL) {
+                error("field declaration '%s' vanished from symbol table",
+                        symToString(varNode->u.memberVar.name));
+            }
             varOffset = varEntry->u.variableEntry.offset;
 
             /* generate code to push the field's value */
-            generateCodeNode(objectNode, table, currentMethod, returnLabel, breakLabel);
+            if (varEntry->u.variableEntry.isStatic) {
+                /* the object is a class name */
+                pushStaticFieldOwner(varNode->u.memberVar.objectClass, varNode->u.memberVar.name);
+            } else {
+                generateCodeNode(objectNode, table, currentMethod, returnLabel, breakLabel);
+            }
 
-            fprintf(asmFile, "\tgetf\t%d\n", varOffset);
+            appendInstr1(currentCode(), OP_GETF, varOffset);
 
             break;
 
@@ -555,23 +818,23 @@ static void generateCodeCallExp(Absyn *node, Table *table, Entry *currentMethod,
         int returnLabel, int breakLabel) {
 
     Entry *methodEntry;
-    Class *rcvrClass;
+    VMTEntry *target;
     int offset;
     int thisPosition;
 
     methodEntry = lookupMember(node->u.callExp.rcvrClass, node->u.callExp.name, ENTRY_KIND_METHOD);
+    target = findCallTarget(node->u.callExp.rcvr, node->u.callExp.rcvrClass,
+            node->u.callExp.name, methodEntry, currentMethod);
 
-    /* Position of self/super receiver on the stack as 0th argument */
-    thisPosition = -methodEntry->u.methodEntry.numParams - 2 - 1;
+    /* Position of self/super receiver below the current method's arguments */
+    thisPosition = -3 - currentMethod->u.methodEntry.numParams;
     /* We need to switch over the receiver of the callExp */
     switch (node->u.callExp.rcvr->type) {
         case ABSYN_SUPEREXP:
-            rcvrClass = methodEntry->u.methodEntry.class->superClass;
-            /* Refetch the methodEntry to get the correct label for vmcall */
-            methodEntry = lookupMember(rcvrClass, node->u.callExp.name, ENTRY_KIND_METHOD);
+            /* self, the call is bound to the superclass's method */
         case ABSYN_SELFEXP:
             /* push receiver from stack */
-            fprintf(asmFile, "\tpushl\t%d\n", thisPosition);
+            appendInstr1(currentCode(), OP_PUSHL, thisPosition);
             break;
         default:
             generateCodeNode(node->u.callExp.rcvr, table, currentMethod, returnLabel, breakLabel);
@@ -581,9 +844,13 @@ static void generateCodeCallExp(Absyn *node, Table *table, Entry *currentMethod,
     offset = findVMT(methodEntry->u.methodEntry.class->vmt, node->u.callExp.name);
 
     generateCodeNode(node->u.callExp.args, table, currentMethod, returnLabel, breakLabel);
-    fprintf(asmFile, "\tvmcall\t%d,%d\n", methodEntry->u.methodEntry.numParams + 1, offset + 1);
-    fprintf(asmFile, "\tdrop\t%d\n", methodEntry->u.methodEntry.numParams + 1);
-    fprintf(asmFile, "\tpushr\n");
+    if (node->u.callExp.inlineMethod != NULL) {
+        generateInlineMethod(node->u.callExp.inlineMethod, node->u.callExp.inlineBase, TRUE);
+        return;
+    }
+    generateCallInstr(target, methodEntry->u.methodEntry.numParams + 1, offset);
+    appendInstr1(currentCode(), OP_DROP, methodEntry->u.methodEntry.numParams + 1);
+    appendInstr0(currentCode(), OP_PUSHR);
 }
 
 static void generateCodeNewExp(Absyn *node, Table *table, Entry *currentMethod,
@@ -600,8 +867,8 @@ static void generateCodeNewExp(Absyn *node, Table *table, Entry *currentMethod,
     class = type->u.simpleType.class;
 
     /* new Object with numFields fields */
-    fprintf(asmFile, "\tnew\t%d\n", numFields);
-    fprintf(asmFile, "\t.addr %s_%lx\n", class->name->string, djb2(class->fileName));
+    appendInstr1(currentCode(), OP_NEW, numFields);
+    appendInstr3(currentCode(), OP_ADDR, classLabel(class));
 
     /* Look for a method with the same name of the class in the metaclass => constructor */
     entry = lookupMember(class->metaClass, class->name, ENTRY_KIND_METHOD);
@@ -610,10 +877,10 @@ static void generateCodeNewExp(Absyn *node, Table *table, Entry *currentMethod,
     if (entry != NULL) {
         /* Generate code for arguments */
         generateCodeNode(node->u.newExp.args, table, currentMethod, returnLabel, breakLabel);
-        fprintf(asmFile, "\tcall\t$%s\n",
-            newMethodLabel(node->file, class->name->string, class->name->string, TRUE)
-        );
-        fprintf(asmFile, "\tdrop\t%d\n", entry->u.methodEntry.numParams);
+        appendInstr3(currentCode(), OP_CALL, appendString("$",
+            newMethodLabel(class->fileName, class->name->string, class->name->string, TRUE)
+        ));
+        appendInstr1(currentCode(), OP_DROP, entry->u.methodEntry.numParams);
     }
 }
 
@@ -622,72 +889,182 @@ static void generateCodeNewArrayExp(Absyn *node, Table *table, Entry *currentMet
 
     Entry *classEntry = lookup(table, node->u.newArrayExp.type, ENTRY_KIND_CLASS);
 
-    generateCodeNode(node->u.newArrayExp.size, table, currentMethod, returnLabel, breakLabel);
     /* The size is an integer value, we need to fetch that from the object
      on the stack */
-    fprintf(asmFile, "\tgetf\t1\n");
-    fprintf(asmFile, "\tnewa\n");
-    fprintf(asmFile, "\t.addr %s_%lx\n", node->u.newArrayExp.type->string, djb2(classEntry->u.classEntry.class->fileName));
+    generateRawValue(node->u.newArrayExp.size, table, currentMethod, returnLabel, breakLabel);
+    appendInstr0(currentCode(), OP_NEWA);
+    appendInstr3(currentCode(), OP_ADDR, classLabel(classEntry->u.classEntry.class));
 }
 
-static void generateCodeUnopExp(Absyn *node, Table *table, Entry *currentMethod,
+static void generateCodeLogicalExp(Absyn *node, Table *table, Entry *currentMethod,
         int returnLabel, int breakLabel) {
 
-    Entry *entry;
+    int label1;
+    boolean unboxed = node->u.binopExp.unboxed;
+
+    label1 = newLabel();
+
+    /* Keep the left value as result if it decides the expression */
+    if (unboxed) {
+        /* calls among the operands still return a box */
+        generateRawValue(node->u.binopExp.left, table, currentMethod, returnLabel, breakLabel);
+        appendInstr0(currentCode(), OP_DUP);
+    } else {
+        generateCodeNode(node->u.binopExp.left, table, currentMethod, returnLabel, breakLabel);
+        appendInstr0(currentCode(), OP_DUP);
+        appendInstr1(currentCode(), OP_GETF, 1);
+    }
+    appendInstr3(currentCode(), node->u.binopExp.op == ABSYN_BINOP_LAND ? OP_BRF : OP_BRT,
+            labelName(label1));
+
+    /* Otherwise the right value is the result */
+    appendInstr1(currentCode(), OP_DROP, 1);
+    if (unboxed) {
+        generateRawValue(node->u.binopExp.right, table, currentMethod, returnLabel, breakLabel);
+    } else {
+        generateCodeNode(node->u.binopExp.right, table, currentMethod, returnLabel, breakLabel);
+    }
+    appendLabel(currentCode(), labelName(label1));
+}
+
+static void generateCodeBinopExp(Absyn *node, Table *table, Entry *currentMethod,
+        int returnLabel, int breakLabel) {
+
+    int instr;
     Class *class;
+
+    /* only Integer arithmetic and comparisons survive semant (see -O1) */
+    switch (node->u.binopExp.op) {
+        case ABSYN_BINOP_LOR:
+        case ABSYN_BINOP_LAND:
+            generateCodeLogicalExp(node, table, currentMethod, returnLabel, breakLabel);
+            return;
+        case ABSYN_BINOP_EQ:
+            instr = OP_EQ;
+            class = wellKnown.booleanClass;
+            break;
+        case ABSYN_BINOP_NE:
+            instr = OP_NE;
+            class = wellKnown.booleanClass;
+            break;
+        case ABSYN_BINOP_LT:
+            instr = OP_LT;
+            class = wellKnown.booleanClass;
+            break;
+        case ABSYN_BINOP_LE:
+            instr = OP_LE;
+            class = wellKnown.booleanClass;
+            break;
+        case ABSYN_BINOP_GT:
+            instr = OP_GT;
+            class = wellKnown.booleanClass;
+            break;
+        case ABSYN_BINOP_GE:
+            instr = OP_GE;
+            class = wellKnown.booleanClass;
+            break;
+        case ABSYN_BINOP_ADD:
+            instr = OP_ADD;
+            class = wellKnown.integerClass;
+            break;
+        case ABSYN_BINOP_SUB:
+            instr = OP_SUB;
+            class = wellKnown.integerClass;
+            break;
+        case ABSYN_BINOP_MUL:
+            instr = OP_MUL;
+            class = wellKnown.integerClass;
+            break;
+        case ABSYN_BINOP_DIV:
+            instr = OP_DIV;
+            class = wellKnown.integerClass;
+            break;
+        case ABSYN_BINOP_MOD:
+            instr = OP_MOD;
+            class = wellKnown.integerClass;
+            break;
+        default:
+            error("unexpected binary operator %d in generateCodeBinopExp",
+                    node->u.binopExp.op);
+            return;
+    }
+
+    /* First we need to create the target object (unless it does not escape) */
+    if (!node->u.binopExp.unboxed) {
+        if (class == wellKnown.integerClass) {
+            beginIntegerBox();
+        } else {
+            generateNewBox(class);
+        }
+    }
+
+    /* Unbox both operands */
+    generateRawValue(node->u.binopExp.left, table, currentMethod, returnLabel, breakLabel);
+    generateRawValue(node->u.binopExp.right, table, currentMethod, returnLabel, breakLabel);
+
+    /* Calculate and put the result into the first field */
+    appendInstr0(currentCode(), instr);
+    if (!node->u.binopExp.unboxed) {
+        if (class == wellKnown.integerClass) {
+            endIntegerBox();
+        } else {
+            appendInstr1(currentCode(), OP_PUTF, 1);
+        }
+    }
+}
+
+static void generateCodeUnopExp(Absyn *node, Table *table, Entry *currentMethod,
+        int returnLabel, int breakLabel) {
+
+    boolean unboxed = node->u.unopExp.unboxed;
+
     switch (node->u.unopExp.op) {
         case ABSYN_UNOP_PLUS:
-            generateCodeNode(node->u.unopExp.right, table, currentMethod, returnLabel, breakLabel);
+            if (unboxed) {
+                generateRawValue(node->u.unopExp.right, table, currentMethod, returnLabel, breakLabel);
+            } else {
+                generateCodeNode(node->u.unopExp.right, table, currentMethod, returnLabel, breakLabel);
+            }
             break;
         case ABSYN_UNOP_MINUS:
             /* First we need to create the target object */
-            entry = lookup(table, newSym("Integer"), ENTRY_KIND_CLASS);
-            class = entry->u.classEntry.class;
-
-            /* Generate new Integer object and duplicate it */
-            fprintf(asmFile, "\tnew\t%d\n", 2);
-            fprintf(asmFile, "\t.addr\t%s_%lx\n", class->name->string, djb2(class->fileName));
-            fprintf(asmFile, "\tdup\n");
+            if (!unboxed) {
+                beginIntegerBox();
+            }
 
             /* Put the constant 0 on the stack */
-            fprintf(asmFile, "\tpushc\t0\n");
+            appendInstr1(currentCode(), OP_PUSHC, 0);
 
-            /* After this expression we should have an Integer object on the stack */
-            generateCodeNode(node->u.unopExp.right, table, currentMethod, returnLabel, breakLabel);
-
-            /* Get the first field containing the Integer */
-            fprintf(asmFile, "\tgetf\t%d\n", 1);
+            /* Push the value of the operand */
+            generateRawValue(node->u.unopExp.right, table, currentMethod, returnLabel, breakLabel);
 
             /* Substract value on stack */
-            fprintf(asmFile, "\tsub\n");
+            appendInstr0(currentCode(), OP_SUB);
 
             /* put the value on the stack into the first field */
-            fprintf(asmFile, "\tputf\t%d\n", 1);
+            if (!unboxed) {
+                endIntegerBox();
+            }
             break;
         case ABSYN_UNOP_LNOT:
             /* First we need to create the target object */
-            entry = lookup(table, newSym("Boolean"), ENTRY_KIND_CLASS);
-            class = entry->u.classEntry.class;
-
-            /* Generate new Boolean object and duplicate it */
-            fprintf(asmFile, "\tnew\t%d\n", 2);
-            fprintf(asmFile, "\t.addr\t%s_%lx\n", class->name->string, djb2(class->fileName));
-            fprintf(asmFile, "\tdup\n");
-
-            /* Put the constant 0 on the stack */
-            fprintf(asmFile, "\tpushc\t1\n");
+            if (!unboxed) {
+                generateNewBox(wellKnown.booleanClass);
+            }
 
-            /* After this expression we should have an Integer object on the stack */
-            generateCodeNode(node->u.unopExp.right, table, currentMethod, returnLabel, breakLabel);
+            /* Put the constant 1 on the stack */
+            appendInstr1(currentCode(), OP_PUSHC, 1);
 
-            /* Get the first field containing the Integer */
-            fprintf(asmFile, "\tgetf\t%d\n", 1);
+            /* Push the value of the operand */
+            generateRawValue(node->u.unopExp.right, table, currentMethod, returnLabel, breakLabel);
 
             /* Substract value on stack */
-            fprintf(asmFile, "\tsub\n");
+            appendInstr0(currentCode(), OP_SUB);
 
             /* put the value on the stack into the first field */
-            fprintf(asmFile, "\tputf\t%d\n", 1);
+            if (!unboxed) {
+                appendInstr1(currentCode(), OP_PUTF, 1);
+            }
             break;
         default:
             error("unknown unary operator %d in generateCodeUnopExp",
@@ -698,22 +1075,46 @@ static void generateCodeUnopExp(Absyn *node, Table *table, Entry *currentMethod,
 static void generateCodeIntExp(Absyn *node, Table *table, Entry *currentMethod,
         int returnLabel, int breakLabel) {
 
-    Entry *integerEntry;
-    Class *integerClass;
+    int value = node->u.intExp.value;
 
-    integerEntry = lookup(table, newSym("Integer"), ENTRY_KIND_CLASS);
-    integerClass = integerEntry->u.classEntry.class;
+    /* Small Integers are taken from the cache (see generateIntCache) */
+    if (!node->u.intExp.unboxed && sharesIntegers()
+            && value >= intCacheMin && value <= intCacheMax) {
+        appendInstrGlobal(currentCode(), OP_PUSHG, INT_CACHE_GLOBAL, NULL);
+        appendInstr1(currentCode(), OP_PUSHC, value - intCacheMin);
+        appendInstr0(currentCode(), OP_GETFA);
+        return;
+    }
 
     /* Generate new Integer object and duplicate it */
-    fprintf(asmFile, "\tnew\t%d\n", 2);
-    fprintf(asmFile, "\t.addr\t%s_%lx\n", integerClass->name->string, djb2(integerClass->fileName));
-    fprintf(asmFile, "\tdup\n");
+    if (!node->u.intExp.unboxed) {
+        generateNewBox(wellKnown.integerClass);
+    }
 
     /* Push the value of the intExp */
-    fprintf(asmFile, "\tpushc\t%d\n", node->u.intExp.value);
+    appendInstr1(currentCode(), OP_PUSHC, node->u.intExp.value);
+
+    /* put the value on the stack into the first field */
+    if (!node->u.intExp.unboxed) {
+        appendInstr1(currentCode(), OP_PUTF, 1);
+    }
+}
+
+static void generateCodeBoolExp(Absyn *node, Table *table, Entry *currentMethod,
+        int returnLabel, int breakLabel) {
+
+    /* Generate new Boolean object and duplicate it */
+    if (!node->u.boolExp.unboxed) {
+        generateNewBox(wellKnown.booleanClass);
+    }
+
+    /* Push the value of the boolExp */
+    appendInstr1(currentCode(), OP_PUSHC, node->u.boolExp.value);
 
     /* put the value on the stack into the first field */
-    fprintf(asmFile, "\tputf\t%d\n", 1);
+    if (!node->u.boolExp.unboxed) {
+        appendInstr1(currentCode(), OP_PUTF, 1);
+    }
 }
 
 static void generateCodeInstofExp(Absyn *node, Table *table, Entry *currentMethod,
@@ -722,6 +1123,9 @@ static void generateCodeInstofExp(Absyn *node, Table *table, Entry *currentMetho
     Type *typeNode;
     Class *typeClass;
 
+    /* instof leaves a raw value, the expression is a Boolean */
+    generateNewBox(wellKnown.booleanClass);
+
     /* Generate code for the left side expression (e.g. exp instanceof Type) */
     generateCodeNode(node->u.instofExp.exp, table, currentMethod, returnLabel, breakLabel);
 
@@ -732,8 +1136,9 @@ static void generateCodeInstofExp(Absyn *node, Table *table, Entry *currentMetho
       typeClass = typeNode->u.arrayType.base;
     }
 
-    fprintf(asmFile, "\tinstof\n");
-    fprintf(asmFile, "\t.addr\t%s_%lx\n",typeClass->name->string, djb2(typeClass->fileName));
+    appendInstr0(currentCode(), OP_INSTOF);
+    appendInstr3(currentCode(), OP_ADDR, classLabel(typeClass));
+    appendInstr1(currentCode(), OP_PUTF, 1);
 }
 
 static void generateCodeCastExp(Absyn *node, Table *table, Entry *currentMethod,
@@ -746,7 +1151,7 @@ static void generateCodeCastExp(Absyn *node, Table *table, Entry *currentMethod,
     generateCodeNode(node->u.instofExp.exp, table, currentMethod, returnLabel, breakLabel);
 
     /* generate object duplicate (for instanceof-check) */
-    fprintf(asmFile, "\tdup\n");
+    appendInstr0(currentCode(), OP_DUP);
 
     /* generate instanceof-check */
     typeNode = node->u.instofExp.expType;
@@ -757,11 +1162,11 @@ static void generateCodeCastExp(Absyn *node, Table *table, Entry *currentMethod,
       typeClass = typeNode->u.arrayType.base;
     }
 
-    fprintf(asmFile, "\tinstof\n");
-    fprintf(asmFile, "\t.addr\t%s_%lx\n",typeClass->name->string, djb2(typeClass->fileName));
+    appendInstr0(currentCode(), OP_INSTOF);
+    appendInstr3(currentCode(), OP_ADDR, classLabel(typeClass));
 
     /* generate jump if test fails */
-    fprintf(asmFile, "\tbrf\t_cast_error\n");
+    appendInstr3(currentCode(), OP_BRF, "_cast_error");
 }
 
 static void generateCodeExpList(Absyn *node, Table *table, Entry *currentMethod,
@@ -780,25 +1185,64 @@ static void generateCodeExpList(Absyn *node, Table *table, Entry *currentMethod,
 static void generateProlog(Table* table) {
     Entry* mainClass = lookup(table, newSym("$Main"), ENTRY_KIND_CLASS);
 
+    if (mainClass == NULL) {
+        /* only possible when linking object files */
+        error("public class 'Main' is missing.");
+    }
+
     /* execution framework */
-    fprintf(asmFile, "//\n");
-    fprintf(asmFile, "// execution framework\n");
-    fprintf(asmFile, "//\n");
-    fprintf(asmFile, "_start:\n");
-    fprintf(asmFile, "\tcall\t_init\n");
-    fprintf(asmFile, "\tcall\t$Main_main_%lx\n", djb2(mainClass->u.classEntry.class->fileName));
-    fprintf(asmFile, "\tcall\t_exit\n");
+    beginBuffer();
+    appendComment(currentCode(), "");
+    appendComment(currentCode(), "execution framework");
+    appendComment(currentCode(), "");
+    appendLabel(currentCode(), "_start");
+    appendInstr3(currentCode(), OP_CALL, "_init");
+    appendInstr3(currentCode(), OP_CALL, appendString("$", newMethodLabel(
+            mainClass->u.classEntry.class->fileName, "Main", "main", FALSE)));
+    appendInstr3(currentCode(), OP_CALL, "_exit");
     /* void exit() */
-    fprintf(asmFile, "\n");
-    fprintf(asmFile, "//\n");
-    fprintf(asmFile, "// _exit()\n");
-    fprintf(asmFile, "//\n");
-    fprintf(asmFile, "_exit:\n");
-    fprintf(asmFile, "_cast_error:\n");
-    fprintf(asmFile, "\tasf\t0\n");
-    fprintf(asmFile, "\thalt\n");
-    fprintf(asmFile, "\trsf\n");
-    fprintf(asmFile, "\tret\n");
+    beginBuffer();
+    appendComment(currentCode(), "");
+    appendComment(currentCode(), "_exit()");
+    appendComment(currentCode(), "");
+    appendLabel(currentCode(), "_exit");
+    appendLabel(currentCode(), "_cast_error");
+    appendInstr1(currentCode(), OP_ASF, 0);
+    appendInstr0(currentCode(), OP_HALT);
+    appendInstr0(currentCode(), OP_RSF);
+    appendInstr0(currentCode(), OP_RET);
+}
+
+/* the array of the small Integers, filled by a loop with local 0 */
+static void generateIntCache(void) {
+    appendComment(currentCode(), "Generate the small Integers");
+    appendInstr1(currentCode(), OP_PUSHC, intCacheMax - intCacheMin + 1);
+    appendInstr0(currentCode(), OP_NEWA);
+    appendInstr3(currentCode(), OP_ADDR, classLabel(wellKnown.integerClass));
+    appendInstrGlobal(currentCode(), OP_POPG, INT_CACHE_GLOBAL, NULL);
+    appendInstr1(currentCode(), OP_ASF, 1);
+    appendInstr1(currentCode(), OP_PUSHC, 0);
+    appendInstr1(currentCode(), OP_POPL, 0);
+    appendLabel(currentCode(), "_init_ints");
+    appendInstr1(currentCode(), OP_PUSHL, 0);
+    appendInstr1(currentCode(), OP_PUSHC, intCacheMax - intCacheMin + 1);
+    appendInstr0(currentCode(), OP_LT);
+    appendInstr3(currentCode(), OP_BRF, "_init_ints_done");
+    appendInstrGlobal(currentCode(), OP_PUSHG, INT_CACHE_GLOBAL, NULL);
+    appendInstr1(currentCode(), OP_PUSHL, 0);
+    generateNewBox(wellKnown.integerClass);
+    appendInstr1(currentCode(), OP_PUSHL, 0);
+    appendInstr1(currentCode(), OP_PUSHC, intCacheMin);
+    appendInstr0(currentCode(), OP_ADD);
+    appendInstr1(currentCode(), OP_PUTF, 1);
+    appendInstr0(currentCode(), OP_PUTFA);
+    appendInstr1(currentCode(), OP_PUSHL, 0);
+    appendInstr1(currentCode(), OP_PUSHC, 1);
+    appendInstr0(currentCode(), OP_ADD);
+    appendInstr1(currentCode(), OP_POPL, 0);
+    appendInstr3(currentCode(), OP_JMP, "_init_ints");
+    appendLabel(currentCode(), "_init_ints_done");
+    appendInstr0(currentCode(), OP_RSF);
 }
 
 static void generateCodeMetaClasses(void) {
@@ -806,17 +1250,25 @@ static void generateCodeMetaClasses(void) {
     Class* currentClass;
 
     /* Generate init */
-    fprintf(asmFile, "_init:\n");
+    beginBuffer();
+    appendLabel(currentCode(), "_init");
+    /* a program without Integers has nothing to share */
+    if (firstClassGlobal() > INT_CACHE_GLOBAL
+            && wellKnown.integerClass != NULL) {
+        generateIntCache();
+    }
     currentClassList = metaClasses;
     while (!currentClassList->isEmpty) {
         currentClass = currentClassList->head;
-        fprintf(asmFile, "\t// Generate Metaclass object \"%s\"\n", currentClass->name->string);
-        fprintf(asmFile, "\tnew\t%d\n", currentClass->numFields);
-        fprintf(asmFile, "\t.addr\t%s_%lx\n", currentClass->name->string, djb2(currentClass->fileName));
-        fprintf(asmFile, "\tpopg\t%d\n", currentClass->globalIndex);
+        appendComment(currentCode(), appendString("Generate Metaclass object ",
+                quoted(currentClass->name->string)));
+        appendInstr1(currentCode(), OP_NEW, currentClass->numFields);
+        appendInstr3(currentCode(), OP_ADDR, classLabel(currentClass));
+        appendInstrGlobal(currentCode(), OP_POPG, currentClass->globalIndex,
+                classLabel(currentClass));
         currentClassList = currentClassList->tail;
     }
-    fprintf(asmFile, "\tret\n");
+    appendInstr0(currentCode(), OP_RET);
 }
 
 static void generateCodeNode(Absyn *node, Table *table, Entry *currentMethod, int returnLabel, int breakLabel) {
@@ -825,7 +1277,7 @@ static void generateCodeNode(Absyn *node, Table *table, Entry *currentMethod, in
     }
     switch (node->type) {
         case ABSYN_FILE: /* 0 */
-            generateCodeFile(node, table, currentMethod, returnLabel, breakLabel);
+            shouldNotReach("File");
             break;
         case ABSYN_CLASSDEC: /* 1 */
             generateCodeClassDec(node, table, currentMethod, returnLabel, breakLabel);
@@ -885,6 +1337,7 @@ static void generateCodeNode(Absyn *node, Table *table, Entry *currentMethod, in
             generateCodeCallStmt(node, table, currentMethod, returnLabel, breakLabel);
             break;
         case ABSYN_BINOPEXP: /* 20 */
+            generateCodeBinopExp(node, table, currentMethod, returnLabel, breakLabel);
             break;
         case ABSYN_UNOPEXP: /* 21 */
             generateCodeUnopExp(node, table, currentMethod, returnLabel, breakLabel);
@@ -901,6 +1354,7 @@ static void generateCodeNode(Absyn *node, Table *table, Entry *currentMethod, in
             generateCodeIntExp(node, table, currentMethod, returnLabel, breakLabel);
             break;
         case ABSYN_BOOLEXP: /* 26 */
+            generateCodeBoolExp(node, table, currentMethod, returnLabel, breakLabel);
             break;
         case ABSYN_CHAREXP: /* 27 */
             break;
@@ -930,7 +1384,7 @@ static void generateCodeNode(Absyn *node, Table *table, Entry *currentMethod, in
         case ABSYN_MEMBERVAR: /* 37 */
             break;
         case ABSYN_CLSLIST: /* 38 */
-            generateCodeClsList(node, table, currentMethod, returnLabel, breakLabel);
+            shouldNotReach("ClsList");
             break;
         case ABSYN_MBRLIST: /* 39 */
             generateCodeMbrList(node, table, currentMethod, returnLabel, breakLabel);
@@ -969,18 +1423,152 @@ static void generateCodeNode(Absyn *node, Table *table, Entry *currentMethod, in
     }
 }
 
-void generateCode(Absyn *fileTrees[], int numInFiles, Table **fileTables, FILE *outFile) {
-    int i;
-    asmFile = outFile;
+static void generateClass(int i, void *data) {
+    ClassGen *gen = &classGens[i];
 
-    metaClasses = emptyClassList();
+    pthread_setspecific(classGenKey, gen);
+    generateCodeNode(gen->node, gen->fileTable, NULL, -1, -1);
+    pthread_setspecific(classGenKey, NULL);
+}
 
-    /* fileTables[0]->outerScope is the global table! */
-    generateProlog(fileTables[0]->outerScope);
+/*
+ * The classes only read the syntax tree and the tables, so their
+ * code is generated in parallel. The programs of the classes are
+ * appended in source order, which makes the output independent of
+ * the number of threads.
+ */
+static void generateClasses(Absyn *fileTrees[], int numInFiles,
+        Table **fileTables, InstrProgram *program) {
+    Absyn *classList;
+    Entry *classEntry;
+    ClassGen *gen;
+    int i, n;
 
+    numClassGens = 0;
     for (i = 0; i < numInFiles; i++) {
-        generateCodeNode(fileTrees[i], fileTables[i], NULL, -1, -1);
+        for (classList = fileTrees[i]->u.file.classes;
+                !classList->u.clsList.isEmpty;
+                classList = classList->u.clsList.tail) {
+            numClassGens++;
+        }
+    }
+    classGens = (ClassGen *) allocate((numClassGens + 1) * sizeof(ClassGen));
+    n = 0;
+    for (i = 0; i < numInFiles; i++) {
+        for (classList = fileTrees[i]->u.file.classes;
+                !classList->u.clsList.isEmpty;
+                classList = classList->u.clsList.tail) {
+            gen = &classGens[n];
+            gen->node = classList->u.clsList.head;
+            gen->class = NULL;
+            gen->fileTable = fileTables[i];
+            gen->index = n;
+            gen->numLabels = 0;
+            gen->program = newInstrProgram();
+            gen->code = NULL;
+            /* meta classes for the generation of _init */
+            classEntry = lookupClass(&fileTables[i], fileTables[i]->outerScope,
+                    gen->node->u.classDec.name);
+            metaClasses = newClassList(metaClasses,
+                    classEntry->u.classEntry.class->metaClass);
+            n++;
+        }
     }
 
+    for (i = 0; i < library.numClasses; i += 2) {
+        metaClasses = newClassList(metaClasses, library.classes[i]->metaClass);
+    }
+
+    runParallel(numClassGens, generateClass, NULL);
+
+    n = 0;
+    for (i = 0; i < numInFiles; i++) {
+        appendComment(appendInstrBuffer(program),
+                appendString("File ", quoted(fileTrees[i]->file)));
+        for (classList = fileTrees[i]->u.file.classes;
+                !classList->u.clsList.isEmpty;
+                classList = classList->u.clsList.tail) {
+            appendInstrProgram(program, classGens[n++].program);
+        }
+    }
+}
+
+/* only once, a server generates code again and again (see server.c) */
+static void createClassGenKey(void) {
+    if (pthread_key_create(&classGenKey, NULL) != 0) {
+        error("cannot create key for code generation");
+    }
+}
+
+static void beginGeneration(ClassGen *framework) {
+    pthread_once(&classGenOnce, createClassGenKey);
+    metaClasses = emptyClassList();
+    framework->node = NULL;
+    framework->class = NULL;
+    framework->fileTable = NULL;
+    framework->index = -1;
+    framework->numLabels = 0;
+    framework->program = newInstrProgram();
+    framework->code = NULL;
+    pthread_setspecific(classGenKey, framework);
+}
+
+/*
+ * Without input files the loaded object files are linked. The code
+ * refers to nothing but the codegen arena, the loaded code is copied,
+ * so the syntax trees, tables and loaded files may be released before
+ * it is written (see main.c).
+ */
+InstrProgram *generateCode(Absyn *fileTrees[], int numInFiles,
+        Table **fileTables, Table *globalTable) {
+    ClassGen framework;
+
+    startPass(PASS_CODEGEN);
+    labelPrefix = "_L";
+    beginGeneration(&framework);
+
+    generateProlog(globalTable);
+
+    generateClasses(fileTrees, numInFiles, fileTables, framework.program);
+    if (library.code != NULL) {
+        appendInstrProgram(framework.program, copyInstrProgram(library.code));
+    }
+
+    pthread_setspecific(classGenKey, &framework);
     generateCodeMetaClasses();
+    pthread_setspecific(classGenKey, NULL);
+    endPass(PASS_CODEGEN);
+    return framework.program;
+}
+
+void writeProgram(InstrProgram *program, FILE *outFile, boolean emitBinary) {
+    startPass(PASS_EMIT);
+    if (superInstrs) {
+        fuseSuperInstrs(program);
+    }
+    if (emitBinary) {
+        writeBinaryProgram(outFile, program);
+    } else {
+        writeInstrProgram(outFile, program);
+    }
+    endPass(PASS_EMIT);
+}
+
+/*
+ * The classes of a library or object file, without framework and
+ * _init (see library.c). Its labels must not clash with those of the
+ * other files, so they contain the hash of its first file name.
+ */
+InstrProgram *generateLibraryCode(Absyn *fileTrees[], int numInFiles,
+        Table **fileTables) {
+    ClassGen framework;
+
+    startPass(PASS_CODEGEN);
+    labelPrefix = (char *) allocate(2 + 16 + 1 + 1);
+    sprintf(labelPrefix, "_L%lx_", djb2(fileTrees[0]->file));
+    beginGeneration(&framework);
+    generateClasses(fileTrees, numInFiles, fileTables, framework.program);
+    pthread_setspecific(classGenKey, NULL);
+    endPass(PASS_CODEGEN);
+    return framework.program;
 }
@@ -5,7 +5,26 @@
 #ifndef CODEGEN_H
 #define	CODEGEN_H
 
-void generateCode(Absyn *fileTrees[], int numInFiles, Table **fileTables, FILE *outFile);
+/*
+ * From -O1 on the Integers from intCacheMin to intCacheMax (see
+ * --int-cache) are created once by _init, into an array in global 0,
+ * and shared. The meta class objects follow. The loaded library and
+ * object files which share them must agree on the range.
+ */
+#define INT_CACHE_GLOBAL	0
+
+extern int intCacheMin;
+extern int intCacheMax;
+
+boolean sharesIntegers(void);
+int firstClassGlobal(void);
+
+char *classLabel(Class *class);
+InstrProgram *generateCode(Absyn *fileTrees[], int numInFiles,
+        Table **fileTables, Table *globalTable);
+void writeProgram(InstrProgram *program, FILE *outFile, boolean emitBinary);
+InstrProgram *generateLibraryCode(Absyn *fileTrees[], int numInFiles,
+        Table **fileTables);
 
 #endif	/* CODEGEN_H */
 
@@ -15,5 +15,7 @@ typedef int boolean;
 #define MAX_INFILES	100
 
 extern char *mainClass;
+extern int optimizationLevel;
+extern int numJobs;		/* threads, 0: one per processor */
 
 #endif /* _COMMON_H_ */
@@ -44,6 +44,12 @@
 #define VMCALL		38
 #define PUSHG           39
 #define POPG            40
+#define INSTOF		41
+#define UNBOXL		42
+#define BOX		43
+#define DROPR		44
+#define UNBOXBRF	45
+#define LEAVE		46
 
 #define IMMEDIATE(x)	((x) & 0x00FFFFFF)
 #define SIGN_EXTEND(i)	((i) & 0x00800000 ? (i) | 0xFF000000 : (i))
@@ -217,6 +223,24 @@ char *disasm(unsigned int *code, int addr) {
     case POPG:
       sprintf(buffer, "popg");
       break;
+    case INSTOF:
+      sprintf(buffer, "instof");
+      break;
+    case UNBOXL:
+      sprintf(buffer, "unboxl  %d", simmed);
+      break;
+    case BOX:
+      sprintf(buffer, "box");
+      break;
+    case DROPR:
+      sprintf(buffer, "dropr   %d", simmed);
+      break;
+    case UNBOXBRF:
+      sprintf(buffer, "unboxbrf 0x%08X", uimmed);
+      break;
+    case LEAVE:
+      sprintf(buffer, "leave");
+      break;
     default:
       printf("illegal instruction 0x%08X at address 0x%08X\n",
             instr, addr);
@@ -0,0 +1,224 @@
+/*
+ * escape.c -- escape analysis for Integer and Boolean boxes
+ *
+ * Integer and Boolean values are objects which hold the raw value in
+ * field 1. Many of them are created by an expression only to be unboxed
+ * with 'getf 1' right away by the surrounding code: test expressions,
+ * array sizes and indices and the operands of inlined operators. Such a
+ * box never escapes its expression, so this pass marks the expression
+ * as unboxed and codegen leaves the raw value on the stack instead of
+ * allocating an object for it.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "sym.h"
+#include "types.h"
+#include "absyn.h"
+#include "escape.h"
+
+
+static void visitStm(Absyn *node);
+static void visitExp(Absyn *node);
+static void visitRawExp(Absyn *node);
+
+
+boolean isUnboxed(Absyn *node) {
+    switch (node->type) {
+        case ABSYN_BINOPEXP:
+            return node->u.binopExp.unboxed;
+        case ABSYN_UNOPEXP:
+            return node->u.unopExp.unboxed;
+        case ABSYN_INTEXP:
+            return node->u.intExp.unboxed;
+        case ABSYN_BOOLEXP:
+            return node->u.boolExp.unboxed;
+        default:
+            return FALSE;
+    }
+}
+
+
+static void visitStmList(Absyn *stmList) {
+    while (!stmList->u.stmList.isEmpty) {
+        visitStm(stmList->u.stmList.head);
+        stmList = stmList->u.stmList.tail;
+    }
+}
+
+
+static void visitExpList(Absyn *expList) {
+    while (!expList->u.expList.isEmpty) {
+        visitExp(expList->u.expList.head);
+        expList = expList->u.expList.tail;
+    }
+}
+
+
+static void visitVar(Absyn *node) {
+    switch (node->type) {
+        case ABSYN_SIMPLEVAR:
+            break;
+        case ABSYN_ARRAYVAR:
+            visitExp(node->u.arrayVar.var);
+            visitRawExp(node->u.arrayVar.index);
+            break;
+        case ABSYN_MEMBERVAR:
+            visitExp(node->u.memberVar.object);
+            break;
+        default:
+            error("unknown variable node %d in escape analysis", node->type);
+    }
+}
+
+
+/*
+ * the value of the expression is consumed by 'getf 1',
+ * so the box does not escape
+ */
+static void visitRawExp(Absyn *node) {
+    switch (node->type) {
+        case ABSYN_BINOPEXP:
+            node->u.binopExp.unboxed = TRUE;
+            visitRawExp(node->u.binopExp.left);
+            visitRawExp(node->u.binopExp.right);
+            break;
+        case ABSYN_UNOPEXP:
+            node->u.unopExp.unboxed = TRUE;
+            visitRawExp(node->u.unopExp.right);
+            break;
+        case ABSYN_INTEXP:
+            node->u.intExp.unboxed = TRUE;
+            break;
+        case ABSYN_BOOLEXP:
+            node->u.boolExp.unboxed = TRUE;
+            break;
+        default:
+            /* the value is boxed by a call or a variable */
+            visitExp(node);
+            break;
+    }
+}
+
+
+/*
+ * the value of the expression escapes (it is assigned, passed,
+ * returned or used as receiver), so it must stay boxed
+ */
+static void visitExp(Absyn *node) {
+    switch (node->type) {
+        case ABSYN_BINOPEXP:
+            if (node->u.binopExp.op == ABSYN_BINOP_LOR
+                    || node->u.binopExp.op == ABSYN_BINOP_LAND) {
+                /* the result is one of the operand boxes */
+                visitExp(node->u.binopExp.left);
+                visitExp(node->u.binopExp.right);
+            } else {
+                /* inlined operators unbox their operands */
+                visitRawExp(node->u.binopExp.left);
+                visitRawExp(node->u.binopExp.right);
+            }
+            break;
+        case ABSYN_UNOPEXP:
+            if (node->u.unopExp.op == ABSYN_UNOP_PLUS) {
+                visitExp(node->u.unopExp.right);
+            } else {
+                visitRawExp(node->u.unopExp.right);
+            }
+            break;
+        case ABSYN_INSTOFEXP:
+            visitExp(node->u.instofExp.exp);
+            break;
+        case ABSYN_CASTEXP:
+            visitExp(node->u.castExp.exp);
+            break;
+        case ABSYN_VAREXP:
+            visitVar(node->u.varExp.var);
+            break;
+        case ABSYN_CALLEXP:
+            visitExp(node->u.callExp.rcvr);
+            visitExpList(node->u.callExp.args);
+            break;
+        case ABSYN_NEWEXP:
+            visitExpList(node->u.newExp.args);
+            break;
+        case ABSYN_NEWARRAYEXP:
+            visitRawExp(node->u.newArrayExp.size);
+            break;
+        default:
+            /* literals, nil, self and super */
+            break;
+    }
+}
+
+
+static void visitStm(Absyn *node) {
+    switch (node->type) {
+        case ABSYN_EMPTYSTM:
+        case ABSYN_BREAKSTM:
+        case ABSYN_RETSTM:
+        case ABSYN_ASMSTM:
+            break;
+        case ABSYN_COMPSTM:
+            visitStmList(node->u.compStm.stms);
+            break;
+        case ABSYN_ASSIGNSTM:
+            visitVar(node->u.assignStm.var);
+            visitExp(node->u.assignStm.exp);
+            break;
+        case ABSYN_IFSTM1:
+            visitRawExp(node->u.ifStm1.test);
+            visitStm(node->u.ifStm1.thenPart);
+            break;
+        case ABSYN_IFSTM2:
+            visitRawExp(node->u.ifStm2.test);
+            visitStm(node->u.ifStm2.thenPart);
+            visitStm(node->u.ifStm2.elsePart);
+            break;
+        case ABSYN_WHILESTM:
+            visitRawExp(node->u.whileStm.test);
+            visitStm(node->u.whileStm.body);
+            break;
+        case ABSYN_DOSTM:
+            visitRawExp(node->u.doStm.test);
+            visitStm(node->u.doStm.body);
+            break;
+        case ABSYN_RETEXPSTM:
+            visitExp(node->u.retExpStm.exp);
+            break;
+        case ABSYN_CALLSTM:
+            visitExp(node->u.callStm.rcvr);
+            visitExpList(node->u.callStm.args);
+            break;
+        default:
+            error("unknown statement node %d in escape analysis", node->type);
+    }
+}
+
+
+void analyzeEscapes(Absyn *fileTrees[], int numInFiles) {
+    Absyn *classList;
+    Absyn *memberList;
+    Absyn *memberDec;
+    int i;
+
+    for (i = 0; i < numInFiles; i++) {
+        for (classList = fileTrees[i]->u.file.classes;
+                !classList->u.clsList.isEmpty;
+                classList = classList->u.clsList.tail) {
+            for (memberList = classList->u.clsList.head->u.classDec.members;
+                    !memberList->u.mbrList.isEmpty;
+                    memberList = memberList->u.mbrList.tail) {
+                memberDec = memberList->u.mbrList.head;
+                if (memberDec->type == ABSYN_METHODDEC) {
+                    visitStmList(memberDec->u.methodDec.stms);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,11 @@
+/*
+ * escape.h -- escape analysis for Integer and Boolean boxes
+ */
+
+#ifndef ESCAPE_H
+#define	ESCAPE_H
+
+void analyzeEscapes(Absyn *fileTrees[], int numInFiles);
+boolean isUnboxed(Absyn *node);
+
+#endif	/* ESCAPE_H */
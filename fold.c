@@ -0,0 +1,192 @@
+/*
+ * fold.c -- constant folding
+ *
+ * Operators whose operands are literals are calculated at compile
+ * time and the operator node is replaced by a single literal. The
+ * semantic analysis folds every operator right after checking its
+ * operands, so folded operands propagate up the expression tree.
+ * Results which do not fit into the immediate of 'pushc', divisions
+ * by zero and the overflowing INT_MIN / -1 are left to run time.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "common.h"
+#include "utils.h"
+#include "sym.h"
+#include "types.h"
+#include "absyn.h"
+#include "fold.h"
+
+
+/* range of the signed 24 bit immediate of 'pushc' */
+#define IMMEDIATE_MIN	(-(1L << 23))
+#define IMMEDIATE_MAX	((1L << 23) - 1)
+
+
+static boolean fitsImmediate(double value) {
+    return value >= IMMEDIATE_MIN && value <= IMMEDIATE_MAX;
+}
+
+
+static void replaceByInt(Absyn *node, double value, Type *expType) {
+    *node = *newIntExp(node->file, node->line, (int) value);
+    node->u.intExp.expType = expType;
+}
+
+
+static void replaceByBool(Absyn *node, boolean value, Type *expType) {
+    *node = *newBoolExp(node->file, node->line, value);
+    node->u.boolExp.expType = expType;
+}
+
+
+static boolean foldIntegerOp(Absyn *node, int op, int x, int y, Type *expType) {
+    double result;
+
+    switch (op) {
+        case ABSYN_BINOP_EQ:
+            replaceByBool(node, x == y, expType);
+            return TRUE;
+        case ABSYN_BINOP_NE:
+            replaceByBool(node, x != y, expType);
+            return TRUE;
+        case ABSYN_BINOP_LT:
+            replaceByBool(node, x < y, expType);
+            return TRUE;
+        case ABSYN_BINOP_LE:
+            replaceByBool(node, x <= y, expType);
+            return TRUE;
+        case ABSYN_BINOP_GT:
+            replaceByBool(node, x > y, expType);
+            return TRUE;
+        case ABSYN_BINOP_GE:
+            replaceByBool(node, x >= y, expType);
+            return TRUE;
+        case ABSYN_BINOP_ADD:
+            result = (double) x + y;
+            break;
+        case ABSYN_BINOP_SUB:
+            result = (double) x - y;
+            break;
+        case ABSYN_BINOP_MUL:
+            result = (double) x * y;
+            break;
+        case ABSYN_BINOP_DIV:
+            if (y == 0 || (x == INT_MIN && y == -1)) {
+                return FALSE;
+            }
+            result = x / y;
+            break;
+        case ABSYN_BINOP_MOD:
+            if (y == 0 || (x == INT_MIN && y == -1)) {
+                return FALSE;
+            }
+            result = x % y;
+            break;
+        default:
+            return FALSE;
+    }
+    if (!fitsImmediate(result)) {
+        return FALSE;
+    }
+    replaceByInt(node, result, expType);
+    return TRUE;
+}
+
+
+static boolean foldCharacterOp(Absyn *node, int op, char x, char y, Type *expType) {
+    switch (op) {
+        case ABSYN_BINOP_EQ:
+            replaceByBool(node, x == y, expType);
+            return TRUE;
+        case ABSYN_BINOP_NE:
+            replaceByBool(node, x != y, expType);
+            return TRUE;
+        case ABSYN_BINOP_LT:
+            replaceByBool(node, x < y, expType);
+            return TRUE;
+        case ABSYN_BINOP_LE:
+            replaceByBool(node, x <= y, expType);
+            return TRUE;
+        case ABSYN_BINOP_GT:
+            replaceByBool(node, x > y, expType);
+            return TRUE;
+        case ABSYN_BINOP_GE:
+            replaceByBool(node, x >= y, expType);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+
+static boolean foldBooleanOp(Absyn *node, int op, boolean x, boolean y, Type *expType) {
+    switch (op) {
+        case ABSYN_BINOP_LOR:
+            replaceByBool(node, x || y, expType);
+            return TRUE;
+        case ABSYN_BINOP_LAND:
+            replaceByBool(node, x && y, expType);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+
+boolean foldBinop(Absyn *node, Type *expType) {
+    int op = node->u.binopExp.op;
+    Absyn *left = node->u.binopExp.left;
+    Absyn *right = node->u.binopExp.right;
+
+    if (left->type != right->type) {
+        return FALSE;
+    }
+    switch (left->type) {
+        case ABSYN_INTEXP:
+            return foldIntegerOp(node, op,
+                    left->u.intExp.value, right->u.intExp.value, expType);
+        case ABSYN_CHAREXP:
+            return foldCharacterOp(node, op,
+                    left->u.charExp.value, right->u.charExp.value, expType);
+        case ABSYN_BOOLEXP:
+            return foldBooleanOp(node, op,
+                    left->u.boolExp.value, right->u.boolExp.value, expType);
+        default:
+            return FALSE;
+    }
+}
+
+
+boolean foldUnop(Absyn *node, Type *expType) {
+    Absyn *right = node->u.unopExp.right;
+
+    switch (node->u.unopExp.op) {
+        case ABSYN_UNOP_PLUS:
+            if (right->type != ABSYN_INTEXP) {
+                return FALSE;
+            }
+            replaceByInt(node, right->u.intExp.value, expType);
+            return TRUE;
+        case ABSYN_UNOP_MINUS:
+            if (right->type != ABSYN_INTEXP
+                    || !fitsImmediate(-(double) right->u.intExp.value)) {
+                return FALSE;
+            }
+            replaceByInt(node, -(double) right->u.intExp.value, expType);
+            return TRUE;
+        case ABSYN_UNOP_LNOT:
+            if (right->type != ABSYN_BOOLEXP) {
+                return FALSE;
+            }
+            replaceByBool(node, !right->u.boolExp.value, expType);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
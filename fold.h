@@ -0,0 +1,11 @@
+/*
+ * fold.h -- constant folding
+ */
+
+#ifndef FOLD_H
+#define	FOLD_H
+
+boolean foldBinop(Absyn *node, Type *expType);
+boolean foldUnop(Absyn *node, Type *expType);
+
+#endif	/* FOLD_H */
@@ -0,0 +1,323 @@
+/*
+ * inline.c -- inlining of small asm methods
+ *
+ * Most methods of the library (e.g. Integer.add) consist of a few
+ * instructions in a single asm statement. For a call whose target is
+ * known at compile time (see cha.c) and is such a method, codegen
+ * copies the instructions to the call site instead of calling it.
+ * The receiver and the arguments are popped into locals of the
+ * calling method and the 'pushl' instructions of the body, which
+ * address them relative to the callee's frame, are remapped to
+ * these locals. This pass selects the calls and reserves the locals.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "sym.h"
+#include "types.h"
+#include "absyn.h"
+#include "table.h"
+#include "vmt.h"
+#include "cha.h"
+#include "instr.h"
+#include "library.h"
+#include "inline.h"
+
+
+/* maximum number of instructions of an inlined method */
+#define MAX_INLINE_INSTRS	16
+
+
+typedef struct methodDecList {
+    Absyn *head;
+    struct methodDecList *tail;
+} MethodDecList;
+
+
+static MethodDecList *allMethodDecs;
+static Entry *currentMethod;
+static int currentNumLocals;
+
+
+static void visitStm(Absyn *node);
+static void visitExp(Absyn *node);
+
+
+static Absyn *findMethodDec(Class *class, Sym *name) {
+    MethodDecList *list;
+
+    for (list = allMethodDecs; list != NULL; list = list->tail) {
+        /* static methods belong to the metaclass */
+        if ((list->head->u.methodDec.class == class
+                    || list->head->u.methodDec.class->metaClass == class)
+                && list->head->u.methodDec.name == name) {
+            return list->head;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * A method can be inlined if its body is a single asm statement
+ * without control flow which addresses no other locals than self
+ * and its parameters. A value is returned by 'popr' as the last
+ * instruction, leaving the value on the stack at the call site.
+ */
+static boolean isInlinable(Absyn *methodDec, Entry *methodEntry, boolean needsValue) {
+    Absyn *stms = methodDec->u.methodDec.stms;
+    Absyn *instrList;
+    Absyn *instr;
+    int numParams = methodEntry->u.methodEntry.numParams;
+    int numInstrs = 0;
+    boolean returnsValue = FALSE;
+
+    if (stms->u.stmList.isEmpty
+            || !stms->u.stmList.tail->u.stmList.isEmpty
+            || stms->u.stmList.head->type != ABSYN_ASMSTM) {
+        return FALSE;
+    }
+    for (instrList = stms->u.stmList.head->u.asmStm.instrList;
+            !instrList->u.asmInstrList.isEmpty;
+            instrList = instrList->u.asmInstrList.tail) {
+        instr = instrList->u.asmInstrList.head;
+        if (returnsValue || ++numInstrs > MAX_INLINE_INSTRS) {
+            /* nothing may follow 'popr' */
+            return FALSE;
+        }
+        switch (instr->type) {
+            case ABSYN_ASMINSTR0:
+                if (strcmp(instr->u.asmInstr0.instr, "popr") == 0) {
+                    returnsValue = TRUE;
+                } else if (strcmp(instr->u.asmInstr0.instr, "ret") == 0
+                        || strcmp(instr->u.asmInstr0.instr, "rsf") == 0) {
+                    return FALSE;
+                }
+                break;
+            case ABSYN_ASMINSTR1:
+                if (strcmp(instr->u.asmInstr1.instr, "pushl") == 0) {
+                    if (instr->u.asmInstr1.immediate > -3
+                            || instr->u.asmInstr1.immediate < -3 - numParams) {
+                        return FALSE;
+                    }
+                } else if (strcmp(instr->u.asmInstr1.instr, "popl") == 0
+                        || strcmp(instr->u.asmInstr1.instr, "asf") == 0) {
+                    return FALSE;
+                }
+                break;
+            case ABSYN_ASMINSTR2:
+                break;
+            case ABSYN_ASMINSTR3:
+                if (strcmp(instr->u.asmInstr3.instr, ".addr") != 0
+                        && strcmp(instr->u.asmInstr3.instr, "call") != 0) {
+                    /* jumps and branches */
+                    return FALSE;
+                }
+                break;
+            default:
+                return FALSE;
+        }
+    }
+    return returnsValue || !needsValue;
+}
+
+
+static Absyn *selectInlineMethod(Absyn *rcvr, Class *rcvrClass, Sym *name,
+        boolean needsValue, int *inlineBase) {
+    Entry *methodEntry;
+    Absyn *methodDec;
+
+    methodEntry = lookupMember(rcvrClass, name, ENTRY_KIND_METHOD);
+    if (methodEntry == NULL
+            || findCallTarget(rcvr, rcvrClass, name, methodEntry, currentMethod) == NULL) {
+        return NULL;
+    }
+    if (rcvr->type == ABSYN_SUPEREXP) {
+        methodEntry = lookupMember(currentMethod->u.methodEntry.class->superClass,
+                name, ENTRY_KIND_METHOD);
+    }
+    methodDec = findMethodDec(methodEntry->u.methodEntry.class, name);
+    if (methodDec == NULL || !isInlinable(methodDec, methodEntry, needsValue)) {
+        return NULL;
+    }
+    /* the arguments of all inlined calls of a method share its locals */
+    *inlineBase = currentNumLocals;
+    if (currentMethod->u.methodEntry.numLocals
+            < currentNumLocals + methodEntry->u.methodEntry.numParams + 1) {
+        currentMethod->u.methodEntry.numLocals =
+                currentNumLocals + methodEntry->u.methodEntry.numParams + 1;
+    }
+    return methodDec;
+}
+
+
+static void visitStmList(Absyn *stmList) {
+    while (!stmList->u.stmList.isEmpty) {
+        visitStm(stmList->u.stmList.head);
+        stmList = stmList->u.stmList.tail;
+    }
+}
+
+
+static void visitExpList(Absyn *expList) {
+    while (!expList->u.expList.isEmpty) {
+        visitExp(expList->u.expList.head);
+        expList = expList->u.expList.tail;
+    }
+}
+
+
+static void visitVar(Absyn *node) {
+    switch (node->type) {
+        case ABSYN_SIMPLEVAR:
+            break;
+        case ABSYN_ARRAYVAR:
+            visitExp(node->u.arrayVar.var);
+            visitExp(node->u.arrayVar.index);
+            break;
+        case ABSYN_MEMBERVAR:
+            visitExp(node->u.memberVar.object);
+            break;
+        default:
+            error("unknown variable node %d in inlining", node->type);
+    }
+}
+
+
+static void visitExp(Absyn *node) {
+    switch (node->type) {
+        case ABSYN_BINOPEXP:
+            visitExp(node->u.binopExp.left);
+            visitExp(node->u.binopExp.right);
+            break;
+        case ABSYN_UNOPEXP:
+            visitExp(node->u.unopExp.right);
+            break;
+        case ABSYN_INSTOFEXP:
+            visitExp(node->u.instofExp.exp);
+            break;
+        case ABSYN_CASTEXP:
+            visitExp(node->u.castExp.exp);
+            break;
+        case ABSYN_VAREXP:
+            visitVar(node->u.varExp.var);
+            break;
+        case ABSYN_CALLEXP:
+            visitExp(node->u.callExp.rcvr);
+            visitExpList(node->u.callExp.args);
+            node->u.callExp.inlineMethod = selectInlineMethod(
+                    node->u.callExp.rcvr, node->u.callExp.rcvrClass,
+                    node->u.callExp.name, TRUE, &node->u.callExp.inlineBase);
+            break;
+        case ABSYN_NEWEXP:
+            visitExpList(node->u.newExp.args);
+            break;
+        case ABSYN_NEWARRAYEXP:
+            visitExp(node->u.newArrayExp.size);
+            break;
+        default:
+            /* literals, nil, self and super */
+            break;
+    }
+}
+
+
+static void visitStm(Absyn *node) {
+    switch (node->type) {
+        case ABSYN_EMPTYSTM:
+        case ABSYN_BREAKSTM:
+        case ABSYN_RETSTM:
+        case ABSYN_ASMSTM:
+            break;
+        case ABSYN_COMPSTM:
+            visitStmList(node->u.compStm.stms);
+            break;
+        case ABSYN_ASSIGNSTM:
+            visitVar(node->u.assignStm.var);
+            visitExp(node->u.assignStm.exp);
+            break;
+        case ABSYN_IFSTM1:
+            visitExp(node->u.ifStm1.test);
+            visitStm(node->u.ifStm1.thenPart);
+            break;
+        case ABSYN_IFSTM2:
+            visitExp(node->u.ifStm2.test);
+            visitStm(node->u.ifStm2.thenPart);
+            visitStm(node->u.ifStm2.elsePart);
+            break;
+        case ABSYN_WHILESTM:
+            visitExp(node->u.whileStm.test);
+            visitStm(node->u.whileStm.body);
+            break;
+        case ABSYN_DOSTM:
+            visitExp(node->u.doStm.test);
+            visitStm(node->u.doStm.body);
+            break;
+        case ABSYN_RETEXPSTM:
+            visitExp(node->u.retExpStm.exp);
+            break;
+        case ABSYN_CALLSTM:
+            visitExp(node->u.callStm.rcvr);
+            visitExpList(node->u.callStm.args);
+            node->u.callStm.inlineMethod = selectInlineMethod(
+                    node->u.callStm.rcvr, node->u.callStm.rcvrClass,
+                    node->u.callStm.name, FALSE, &node->u.callStm.inlineBase);
+            break;
+        default:
+            error("unknown statement node %d in inlining", node->type);
+    }
+}
+
+
+void inlineCalls(Absyn *fileTrees[], int numInFiles) {
+    MethodDecList *methodDecs;
+    Absyn *classList;
+    Absyn *memberList;
+    Absyn *memberDec;
+    int i;
+
+    /* collect the method bodies, the library has only the asm ones */
+    allMethodDecs = NULL;
+    for (i = 0; i < library.numMethodDecs; i++) {
+        methodDecs = (MethodDecList *) allocate(sizeof(MethodDecList));
+        methodDecs->head = library.methodDecs[i];
+        methodDecs->tail = allMethodDecs;
+        allMethodDecs = methodDecs;
+    }
+    for (i = 0; i < numInFiles; i++) {
+        for (classList = fileTrees[i]->u.file.classes;
+                !classList->u.clsList.isEmpty;
+                classList = classList->u.clsList.tail) {
+            for (memberList = classList->u.clsList.head->u.classDec.members;
+                    !memberList->u.mbrList.isEmpty;
+                    memberList = memberList->u.mbrList.tail) {
+                memberDec = memberList->u.mbrList.head;
+                if (memberDec->type == ABSYN_METHODDEC) {
+                    methodDecs = (MethodDecList *) allocate(sizeof(MethodDecList));
+                    methodDecs->head = memberDec;
+                    methodDecs->tail = allMethodDecs;
+                    allMethodDecs = methodDecs;
+                }
+            }
+        }
+    }
+
+    /* select the calls to inline in every method */
+    for (methodDecs = allMethodDecs; methodDecs != NULL; methodDecs = methodDecs->tail) {
+        memberDec = methodDecs->head;
+        currentMethod = lookupMember(memberDec->u.methodDec.class,
+                memberDec->u.methodDec.name, ENTRY_KIND_METHOD);
+        if (currentMethod->u.methodEntry.isStatic) {
+            /* not the copy made for the class, see lookupMember */
+            currentMethod = lookupMember(memberDec->u.methodDec.class->metaClass,
+                    memberDec->u.methodDec.name, ENTRY_KIND_METHOD);
+        }
+        currentNumLocals = currentMethod->u.methodEntry.numLocals;
+        visitStmList(memberDec->u.methodDec.stms);
+    }
+}
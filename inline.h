@@ -0,0 +1,10 @@
+/*
+ * inline.h -- inlining of small asm methods
+ */
+
+#ifndef INLINE_H
+#define	INLINE_H
+
+void inlineCalls(Absyn *fileTrees[], int numInFiles);
+
+#endif	/* INLINE_H */
@@ -136,6 +136,8 @@ static void traverseBintree(Bintree *bintree, Class *class,
             } else {
                 appendInstanceVar(attList, name, class->name, fileName);
             }
+            /* codegen takes the offset from the entry */
+            entry->u.variableEntry.offset = findInstanceVar(attList, name);
         }
     }
 
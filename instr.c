@@ -0,0 +1,356 @@
+/*
+ * instr.c -- instructions in memory
+ *
+ * Codegen appends the instructions of every method (and of the VMTs
+ * and the execution framework) to a buffer of its own, so that they
+ * can be optimized (see peephole.c) before they are written. Every
+ * class gets a program of its own (see codegen.c), these are joined
+ * in source order. When the whole program is generated, all buffers
+ * are serialized to assembler text in a single write.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "instr.h"
+
+
+#define INITIAL_INSTRS	64
+#define INITIAL_BUFFERS	64
+#define INITIAL_TEXT	65536
+
+/* room for everything of a line except the label */
+#define MAX_LINE_NO_LABEL	40
+
+
+#define FORMAT_NONE		0	/* e.g. halt, add, dup */
+#define FORMAT_IMMEDIATE	1	/* e.g. pushc <n>, drop <n> */
+#define FORMAT_VMCALL		2	/* vmcall <numArgs>,<offset> */
+#define FORMAT_TARGET		3	/* e.g. jmp <label>, .addr <label> */
+#define FORMAT_PSEUDO		4	/* labels, comments */
+
+
+static struct {
+    char *mnemonic;
+    int format;
+} opcodeInfo[NUM_OPCODES] = {
+    { "halt",    FORMAT_NONE },
+    { "pushc",   FORMAT_IMMEDIATE },
+    { "add",     FORMAT_NONE },
+    { "sub",     FORMAT_NONE },
+    { "mul",     FORMAT_NONE },
+    { "div",     FORMAT_NONE },
+    { "mod",     FORMAT_NONE },
+    { "rdint",   FORMAT_NONE },
+    { "wrint",   FORMAT_NONE },
+    { "asf",     FORMAT_IMMEDIATE },
+    { "rsf",     FORMAT_NONE },
+    { "pushl",   FORMAT_IMMEDIATE },
+    { "popl",    FORMAT_IMMEDIATE },
+    { "eq",      FORMAT_NONE },
+    { "ne",      FORMAT_NONE },
+    { "lt",      FORMAT_NONE },
+    { "le",      FORMAT_NONE },
+    { "gt",      FORMAT_NONE },
+    { "ge",      FORMAT_NONE },
+    { "jmp",     FORMAT_TARGET },
+    { "brf",     FORMAT_TARGET },
+    { "brt",     FORMAT_TARGET },
+    { "call",    FORMAT_TARGET },
+    { "ret",     FORMAT_NONE },
+    { "drop",    FORMAT_IMMEDIATE },
+    { "pushr",   FORMAT_NONE },
+    { "popr",    FORMAT_NONE },
+    { "dup",     FORMAT_NONE },
+    { "new",     FORMAT_IMMEDIATE },
+    { "getf",    FORMAT_IMMEDIATE },
+    { "putf",    FORMAT_IMMEDIATE },
+    { "newa",    FORMAT_NONE },
+    { "getla",   FORMAT_NONE },
+    { "getfa",   FORMAT_NONE },
+    { "putfa",   FORMAT_NONE },
+    { "pushn",   FORMAT_NONE },
+    { "refeq",   FORMAT_NONE },
+    { "refne",   FORMAT_NONE },
+    { "vmcall",  FORMAT_VMCALL },
+    { "pushg",   FORMAT_IMMEDIATE },
+    { "popg",    FORMAT_IMMEDIATE },
+    { "instof",  FORMAT_NONE },
+    { "unboxl",  FORMAT_IMMEDIATE },
+    { "box",     FORMAT_NONE },
+    { "dropr",   FORMAT_IMMEDIATE },
+    { "unboxbrf", FORMAT_TARGET },
+    { "leave",   FORMAT_NONE },
+    { ".addr",   FORMAT_TARGET },
+    { NULL,      FORMAT_PSEUDO },
+    { NULL,      FORMAT_PSEUDO },
+    { NULL,      FORMAT_PSEUDO },
+};
+
+
+/* opcode of a mnemonic, -1 if there is no such instruction */
+int lookupOpcode(char *mnemonic) {
+    int opcode;
+
+    for (opcode = 0; opcode < NUM_OPCODES; opcode++) {
+        if (opcodeInfo[opcode].mnemonic != NULL
+                && strcmp(opcodeInfo[opcode].mnemonic, mnemonic) == 0) {
+            return opcode;
+        }
+    }
+    return -1;
+}
+
+
+char *opcodeMnemonic(int opcode) {
+    return opcodeInfo[opcode].mnemonic;
+}
+
+
+InstrBuffer *newInstrBuffer(void) {
+    InstrBuffer *buffer;
+
+    buffer = (InstrBuffer *) allocate(sizeof(InstrBuffer));
+    buffer->numInstrs = 0;
+    buffer->maxInstrs = INITIAL_INSTRS;
+    buffer->instrs = (Instr *) allocate(INITIAL_INSTRS * sizeof(Instr));
+    return buffer;
+}
+
+
+static Instr *appendInstr(InstrBuffer *buffer, int opcode) {
+    Instr *newInstrs;
+    Instr *p;
+
+    if (buffer->numInstrs == buffer->maxInstrs) {
+        /* grow the buffer */
+        newInstrs = (Instr *) allocate(2 * buffer->maxInstrs * sizeof(Instr));
+        memcpy(newInstrs, buffer->instrs, buffer->numInstrs * sizeof(Instr));
+        release(buffer->instrs);
+        buffer->instrs = newInstrs;
+        buffer->maxInstrs *= 2;
+    }
+    p = &buffer->instrs[buffer->numInstrs++];
+    p->opcode = opcode;
+    p->immediate = 0;
+    p->offset = 0;
+    p->label = NULL;
+    return p;
+}
+
+
+void appendInstr0(InstrBuffer *buffer, int opcode) {
+    appendInstr(buffer, opcode);
+}
+
+
+void appendInstr1(InstrBuffer *buffer, int opcode, int immediate) {
+    appendInstr(buffer, opcode)->immediate = immediate;
+}
+
+
+void appendInstr2(InstrBuffer *buffer, int opcode, int numArgs, int offset) {
+    Instr *p;
+
+    p = appendInstr(buffer, opcode);
+    p->immediate = numArgs;
+    p->offset = offset;
+}
+
+
+void appendInstr3(InstrBuffer *buffer, int opcode, char *label) {
+    appendInstr(buffer, opcode)->label = label;
+}
+
+
+/* pushg or popg of the meta class object labeled 'label' */
+void appendInstrGlobal(InstrBuffer *buffer, int opcode, int index, char *label) {
+    Instr *p;
+
+    p = appendInstr(buffer, opcode);
+    p->immediate = index;
+    p->label = label;
+}
+
+
+void appendLabel(InstrBuffer *buffer, char *label) {
+    appendInstr(buffer, OP_LABEL)->label = label;
+}
+
+
+void appendComment(InstrBuffer *buffer, char *text) {
+    appendInstr(buffer, OP_COMMENT)->label = text;
+}
+
+
+void removeDeletedInstrs(InstrBuffer *buffer) {
+    int i, n;
+
+    n = 0;
+    for (i = 0; i < buffer->numInstrs; i++) {
+        if (buffer->instrs[i].opcode != OP_DELETED) {
+            buffer->instrs[n++] = buffer->instrs[i];
+        }
+    }
+    buffer->numInstrs = n;
+}
+
+
+InstrProgram *newInstrProgram(void) {
+    InstrProgram *program;
+
+    program = (InstrProgram *) allocate(sizeof(InstrProgram));
+    program->numBuffers = 0;
+    program->maxBuffers = INITIAL_BUFFERS;
+    program->buffers = (InstrBuffer **)
+            allocate(INITIAL_BUFFERS * sizeof(InstrBuffer *));
+    return program;
+}
+
+
+static void addBuffer(InstrProgram *program, InstrBuffer *buffer) {
+    InstrBuffer **newBuffers;
+
+    if (program->numBuffers == program->maxBuffers) {
+        newBuffers = (InstrBuffer **)
+                allocate(2 * program->maxBuffers * sizeof(InstrBuffer *));
+        memcpy(newBuffers, program->buffers,
+                program->numBuffers * sizeof(InstrBuffer *));
+        release(program->buffers);
+        program->buffers = newBuffers;
+        program->maxBuffers *= 2;
+    }
+    program->buffers[program->numBuffers++] = buffer;
+}
+
+
+/* a new buffer which is written after all others */
+InstrBuffer *appendInstrBuffer(InstrProgram *program) {
+    InstrBuffer *buffer;
+
+    buffer = newInstrBuffer();
+    addBuffer(program, buffer);
+    return buffer;
+}
+
+
+/* a copy in the current arena, with copies of the labels */
+InstrProgram *copyInstrProgram(InstrProgram *program) {
+    InstrProgram *copy;
+    InstrBuffer *from;
+    InstrBuffer *to;
+    int i, j;
+
+    copy = newInstrProgram();
+    for (i = 0; i < program->numBuffers; i++) {
+        from = program->buffers[i];
+        to = (InstrBuffer *) allocate(sizeof(InstrBuffer));
+        to->numInstrs = from->numInstrs;
+        to->maxInstrs = from->numInstrs > 0 ? from->numInstrs : 1;
+        to->instrs = (Instr *) allocate(to->maxInstrs * sizeof(Instr));
+        memcpy(to->instrs, from->instrs, from->numInstrs * sizeof(Instr));
+        for (j = 0; j < to->numInstrs; j++) {
+            if (to->instrs[j].label != NULL) {
+                to->instrs[j].label = copyString(to->instrs[j].label);
+            }
+        }
+        addBuffer(copy, to);
+    }
+    return copy;
+}
+
+
+/* the buffers of other are written after all others of program */
+void appendInstrProgram(InstrProgram *program, InstrProgram *other) {
+    int i;
+
+    for (i = 0; i < other->numBuffers; i++) {
+        addBuffer(program, other->buffers[i]);
+    }
+}
+
+
+typedef struct {
+    int length;
+    int maxLength;
+    char *text;
+} TextBuffer;
+
+
+/* make room for n more characters and a '\0' */
+static char *reserveText(TextBuffer *buffer, int n) {
+    char *newText;
+
+    if (buffer->length + n + 1 > buffer->maxLength) {
+        while (buffer->length + n + 1 > buffer->maxLength) {
+            buffer->maxLength *= 2;
+        }
+        newText = (char *) allocate(buffer->maxLength);
+        memcpy(newText, buffer->text, buffer->length);
+        release(buffer->text);
+        buffer->text = newText;
+    }
+    return buffer->text + buffer->length;
+}
+
+
+static void formatInstr(TextBuffer *buffer, Instr *p) {
+    char *mnemonic = opcodeInfo[p->opcode].mnemonic;
+    char *s;
+
+    s = reserveText(buffer, MAX_LINE_NO_LABEL
+            + (p->label == NULL ? 0 : strlen(p->label)));
+    switch (opcodeInfo[p->opcode].format) {
+        case FORMAT_NONE:
+            buffer->length += sprintf(s, "\t%s\n", mnemonic);
+            break;
+        case FORMAT_IMMEDIATE:
+            buffer->length += sprintf(s, "\t%s\t%d\n", mnemonic, p->immediate);
+            break;
+        case FORMAT_VMCALL:
+            buffer->length += sprintf(s, "\t%s\t%d,%d\n",
+                    mnemonic, p->immediate, p->offset);
+            break;
+        case FORMAT_TARGET:
+            buffer->length += sprintf(s, "\t%s\t%s\n", mnemonic, p->label);
+            break;
+        case FORMAT_PSEUDO:
+            if (p->opcode == OP_LABEL) {
+                buffer->length += sprintf(s, "%s:\n", p->label);
+            } else if (p->opcode == OP_COMMENT) {
+                buffer->length += sprintf(s, "//%s%s\n",
+                        *p->label == '\0' ? "" : " ", p->label);
+            }
+            break;
+        default:
+            error("unknown opcode %d in formatInstr", p->opcode);
+    }
+}
+
+
+/* the buffers are separated by empty lines */
+void writeInstrProgram(FILE *file, InstrProgram *program) {
+    TextBuffer text;
+    InstrBuffer *buffer;
+    int i, j;
+
+    text.length = 0;
+    text.maxLength = INITIAL_TEXT;
+    text.text = (char *) allocate(INITIAL_TEXT);
+    for (i = 0; i < program->numBuffers; i++) {
+        buffer = program->buffers[i];
+        for (j = 0; j < buffer->numInstrs; j++) {
+            formatInstr(&text, &buffer->instrs[j]);
+        }
+        *reserveText(&text, 1) = '\n';
+        text.length++;
+    }
+    if (fwrite(text.text, 1, text.length, file) != text.length) {
+        error("cannot write assembler output");
+    }
+    release(text.text);
+}
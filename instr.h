@@ -0,0 +1,107 @@
+/*
+ * instr.h -- instructions in memory
+ */
+
+#ifndef INSTR_H
+#define	INSTR_H
+
+/* opcodes of the VM, see file 'instrs' */
+#define OP_HALT		0
+#define OP_PUSHC	1
+#define OP_ADD		2
+#define OP_SUB		3
+#define OP_MUL		4
+#define OP_DIV		5
+#define OP_MOD		6
+#define OP_RDINT	7
+#define OP_WRINT	8
+#define OP_ASF		9
+#define OP_RSF		10
+#define OP_PUSHL	11
+#define OP_POPL		12
+#define OP_EQ		13
+#define OP_NE		14
+#define OP_LT		15
+#define OP_LE		16
+#define OP_GT		17
+#define OP_GE		18
+#define OP_JMP		19
+#define OP_BRF		20
+#define OP_BRT		21
+#define OP_CALL		22
+#define OP_RET		23
+#define OP_DROP		24
+#define OP_PUSHR	25
+#define OP_POPR		26
+#define OP_DUP		27
+#define OP_NEW		28
+#define OP_GETF		29
+#define OP_PUTF		30
+#define OP_NEWA		31
+#define OP_GETLA	32
+#define OP_GETFA	33
+#define OP_PUTFA	34
+#define OP_PUSHN	35
+#define OP_REFEQ	36
+#define OP_REFNE	37
+#define OP_VMCALL	38
+#define OP_PUSHG	39
+#define OP_POPG		40
+#define OP_INSTOF	41	/* must be followed by address of VMT */
+
+/* superinstructions, see superinstr.c */
+#define OP_UNBOXL	42	/* pushl n; getf 1 */
+#define OP_BOX		43	/* new 2; dup; <value>; putf 1 */
+#define OP_DROPR	44	/* drop n; pushr */
+#define OP_UNBOXBRF	45	/* getf 1; brf <label> */
+#define OP_LEAVE	46	/* rsf; ret */
+
+/* pseudo instructions */
+#define OP_ADDR		47	/* .addr <label> */
+#define OP_LABEL	48	/* label definition */
+#define OP_COMMENT	49	/* comment line */
+#define OP_DELETED	50	/* removed by the optimizer */
+#define NUM_OPCODES	51
+
+
+typedef struct {
+    int opcode;
+    int immediate;		/* immediate or number of arguments */
+    int offset;			/* vmcall offset */
+    char *label;		/* label referenced or defined, comment */
+} Instr;
+
+typedef struct {
+    int numInstrs;
+    int maxInstrs;
+    Instr *instrs;
+} InstrBuffer;
+
+/* the buffers of a program in the order of the output */
+typedef struct {
+    int numBuffers;
+    int maxBuffers;
+    InstrBuffer **buffers;
+} InstrProgram;
+
+
+int lookupOpcode(char *mnemonic);
+char *opcodeMnemonic(int opcode);
+
+InstrBuffer *newInstrBuffer(void);
+void appendInstr0(InstrBuffer *buffer, int opcode);
+void appendInstr1(InstrBuffer *buffer, int opcode, int immediate);
+void appendInstr2(InstrBuffer *buffer, int opcode, int numArgs, int offset);
+void appendInstr3(InstrBuffer *buffer, int opcode, char *label);
+void appendInstrGlobal(InstrBuffer *buffer, int opcode, int index, char *label);
+void appendLabel(InstrBuffer *buffer, char *label);
+void appendComment(InstrBuffer *buffer, char *text);
+void removeDeletedInstrs(InstrBuffer *buffer);
+
+InstrProgram *newInstrProgram(void);
+InstrBuffer *appendInstrBuffer(InstrProgram *program);
+InstrProgram *copyInstrProgram(InstrProgram *program);
+void appendInstrProgram(InstrProgram *program, InstrProgram *other);
+void writeInstrProgram(FILE *file, InstrProgram *program);
+
+#endif	/* INSTR_H */
@@ -0,0 +1,1091 @@
+/*
+ * library.c -- precompiled libraries and object files
+ *
+ * With --write-njlib <dir> the input files are compiled as a library
+ * (there is no main class) into the interface file <dir>/njlib.nji,
+ * with -c a single input file is compiled into an object file of the
+ * same format. It holds what a program needs from the classes: names
+ * and superclasses, the members with their types, offsets and
+ * signatures, the VMTs and instance variables, the asm bodies which
+ * may be inlined (see inline.c) and the code of all methods. Such
+ * files given with --njlib <dir> or as *.njo input files are loaded
+ * into the global table before the program is checked and their code
+ * is appended to the program's code, so their sources are neither
+ * scanned, parsed nor checked again. Without source files the loaded
+ * files are just linked.
+ *
+ * The program may add subclasses to a library, so its code is
+ * generated without CHA and inlining (see main.c). The meta class
+ * objects are numbered when the files are loaded, every pushg and
+ * popg names its class (see codegen.c) to be relocated.
+ *
+ * A compiler server (see server.c) keeps the files it has loaded in
+ * memory, as long as they are not changed.
+ *
+ * Code compiled with -O1 or more takes small Integers from a cache in
+ * global 0, whose range is part of the file. All files which use the
+ * cache must agree on it. The program has it if any file uses it.
+ *
+ * All numbers are written as 32 bit big endian words, strings as
+ * their length (-1 for NULL) followed by the characters. Classes are
+ * referenced by their index in the file, classes outside of the file
+ * by their name.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L	/* fmemopen, stat */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "utils.h"
+#include "sym.h"
+#include "types.h"
+#include "absyn.h"
+#include "vmt.h"
+#include "instance.h"
+#include "table.h"
+#include "instr.h"
+#include "codegen.h"
+#include "library.h"
+#include "timer.h"
+
+
+#define LIBRARY_MAGIC	0x4E4A4C42	/* "NJLB" */
+#define LIBRARY_FORMAT	4
+
+#define REF_NONE	(-1)		/* no class */
+#define REF_EXTERNAL	(-2)		/* followed by the class name */
+
+
+Library library;
+
+static FILE *libFile;
+static char *libFileName;
+static Table *libGlobalTable;
+
+/* hash of the interface written so far, see writeLibrary */
+static unsigned long interfaceHash;
+static boolean hashingInterface;
+
+/* the classes and asm bodies of the file being written */
+static Class **ownClasses;
+static int numOwnClasses;
+static Absyn **ownMethodDecs;
+static int numOwnMethodDecs;
+
+/* the classes of the file being read are library.classes[libBase...] */
+static int libBase;
+static int libNumClasses;
+static int maxClasses;
+static int maxMethodDecs;
+
+/* the files whose class bodies have not been read yet */
+static int numPendingFiles;
+static FILE **pendingFiles;
+static char **pendingNames;
+static int *pendingBases;
+static int *pendingCounts;
+
+/* the files kept in memory, see keepLibrariesResident */
+typedef struct resident {
+    char *fileName;
+    char *data;
+    long size;
+    time_t mtime;		/* of the file when it was read */
+    struct resident *next;
+} Resident;
+
+static boolean keepResident = FALSE;
+static Resident *residents = NULL;
+
+
+/**************************************************************/
+
+/* files kept in memory */
+
+
+/* a server loads the same files for every request */
+void keepLibrariesResident(void) {
+    keepResident = TRUE;
+}
+
+
+static Resident *findResident(char *fileName) {
+    Resident *r;
+
+    for (r = residents; r != NULL; r = r->next) {
+        if (strcmp(r->fileName, fileName) == 0) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+
+/* the file is about to be written */
+static void forgetResident(char *fileName) {
+    Resident *r;
+
+    r = findResident(fileName);
+    if (r != NULL) {
+        free(r->data);
+        r->data = NULL;
+    }
+}
+
+
+static boolean readResident(Resident *r, struct stat *status) {
+    FILE *file;
+
+    file = fopen(r->fileName, "rb");
+    if (file == NULL) {
+        return FALSE;
+    }
+    r->data = (char *) malloc(status->st_size);
+    if (r->data == NULL) {
+        fclose(file);
+        return FALSE;
+    }
+    r->size = status->st_size;
+    r->mtime = status->st_mtime;
+    if (fread(r->data, 1, r->size, file) != r->size) {
+        free(r->data);
+        r->data = NULL;
+    }
+    fclose(file);
+    return r->data != NULL;
+}
+
+
+static FILE *openLibrary(char *fileName) {
+    struct stat status;
+    Resident *r;
+
+    if (!keepResident || stat(fileName, &status) != 0
+            || status.st_size == 0) {
+        return fopen(fileName, "rb");
+    }
+    r = findResident(fileName);
+    if (r == NULL) {
+        r = (Resident *) allocateResident(sizeof(Resident));
+        r->fileName = (char *) allocateResident(strlen(fileName) + 1);
+        strcpy(r->fileName, fileName);
+        r->data = NULL;
+        r->next = residents;
+        residents = r;
+    }
+    if (r->data != NULL
+            && (r->size != status.st_size || r->mtime != status.st_mtime)) {
+        /* changed by someone else */
+        free(r->data);
+        r->data = NULL;
+    }
+    if (r->data == NULL && !readResident(r, &status)) {
+        return fopen(fileName, "rb");
+    }
+    return fmemopen(r->data, r->size, "rb");
+}
+
+
+/**************************************************************/
+
+/* writing */
+
+
+static void writeByte(int c) {
+    putc(c, libFile);
+    if (hashingInterface) {
+        interfaceHash = ((interfaceHash << 5) + interfaceHash) + c;
+    }
+}
+
+
+static void writeInt(int n) {
+    unsigned int u = (unsigned int) n;
+
+    writeByte((u >> 24) & 0xFF);
+    writeByte((u >> 16) & 0xFF);
+    writeByte((u >> 8) & 0xFF);
+    writeByte(u & 0xFF);
+}
+
+
+/* a number which may differ without any change of the interface */
+static void writeUnhashedInt(int n) {
+    boolean hashing = hashingInterface;
+
+    hashingInterface = FALSE;
+    writeInt(n);
+    hashingInterface = hashing;
+}
+
+
+static void writeString(char *s) {
+    int length;
+
+    if (s == NULL) {
+        writeInt(-1);
+        return;
+    }
+    length = strlen(s);
+    writeInt(length);
+    while (*s != '\0') {
+        writeByte((unsigned char) *s++);
+    }
+}
+
+
+static void writeSym(Sym *sym) {
+    writeString(symToString(sym));
+}
+
+
+static void writeClassRef(Class *class) {
+    int i;
+
+    if (class == NULL) {
+        writeInt(REF_NONE);
+        return;
+    }
+    for (i = 0; i < numOwnClasses; i++) {
+        if (ownClasses[i] == class) {
+            writeInt(i);
+            return;
+        }
+    }
+    writeInt(REF_EXTERNAL);
+    writeSym(class->name);
+}
+
+
+static void writeType(Type *type) {
+    if (type == NULL) {
+        /* constructors have no return type */
+        writeInt(-1);
+        return;
+    }
+    writeInt(type->kind);
+    writeInt(type->isStatic);
+    switch (type->kind) {
+        case TYPE_KIND_SIMPLE:
+            writeClassRef(type->u.simpleType.class);
+            break;
+        case TYPE_KIND_ARRAY:
+            writeClassRef(type->u.arrayType.base);
+            writeInt(type->u.arrayType.dims);
+            break;
+    }
+}
+
+
+static void writeEntry(Entry *entry) {
+    TypeList *paramTypes;
+
+    writeInt(entry->kind);
+    switch (entry->kind) {
+        case ENTRY_KIND_METHOD:
+            writeInt(entry->u.methodEntry.isPublic);
+            writeInt(entry->u.methodEntry.isStatic);
+            writeType(entry->u.methodEntry.retType);
+            writeInt(getLength(entry->u.methodEntry.paramTypes));
+            for (paramTypes = entry->u.methodEntry.paramTypes;
+                    !paramTypes->isEmpty;
+                    paramTypes = paramTypes->next) {
+                writeType(paramTypes->type);
+            }
+            writeUnhashedInt(entry->u.methodEntry.numLocals);
+            writeInt(entry->u.methodEntry.numParams);
+            writeClassRef(entry->u.methodEntry.class);
+            break;
+        case ENTRY_KIND_VARIABLE:
+            writeInt(entry->u.variableEntry.isPublic);
+            writeInt(entry->u.variableEntry.isStatic);
+            writeType(entry->u.variableEntry.type);
+            writeInt(entry->u.variableEntry.offset);
+            break;
+        default:
+            error("unexpected entry of kind %d in member table", entry->kind);
+    }
+}
+
+
+static void writeBintree(Bintree *bintree) {
+    if (bintree == NULL) {
+        return;
+    }
+    writeBintree(bintree->left);
+    writeSym(bintree->sym);
+    writeEntry(bintree->entry);
+    writeBintree(bintree->right);
+}
+
+
+static void writeClass(Class *class) {
+    InstanceVar *var;
+    VMTEntry *entry;
+    int i;
+
+    writeClassRef(class->superClass);
+    writeClassRef(class->metaClass);
+    writeInt(class->vmt->numEntries);
+    for (i = 0; i < class->vmt->numEntries; i++) {
+        entry = &class->vmt->entries[i];
+        writeSym(entry->name);
+        writeString(entry->className);
+        writeString(entry->fileName);
+    }
+    writeInt(countFields(class->attibuteList));
+    for (var = class->attibuteList; !var->isEmpty; var = var->next) {
+        writeSym(var->name);
+        writeSym(var->className);
+        writeSym(var->fileName);
+        writeInt(var->offset);
+    }
+    writeInt(class->mbrTable->numEntries);
+    writeBintree(class->mbrTable->bintree);
+}
+
+
+static boolean isAsmBody(Absyn *methodDec) {
+    Absyn *stms = methodDec->u.methodDec.stms;
+
+    return !stms->u.stmList.isEmpty
+            && stms->u.stmList.tail->u.stmList.isEmpty
+            && stms->u.stmList.head->type == ABSYN_ASMSTM;
+}
+
+
+static void writeAsmInstr(Absyn *instr) {
+    writeInt(instr->type);
+    switch (instr->type) {
+        case ABSYN_ASMINSTR0:
+            writeString(instr->u.asmInstr0.instr);
+            break;
+        case ABSYN_ASMINSTR1:
+            writeString(instr->u.asmInstr1.instr);
+            writeInt(instr->u.asmInstr1.immediate);
+            break;
+        case ABSYN_ASMINSTR2:
+            writeString(instr->u.asmInstr2.instr);
+            writeInt(instr->u.asmInstr2.numArgs);
+            writeInt(instr->u.asmInstr2.offset);
+            break;
+        case ABSYN_ASMINSTR3:
+            writeString(instr->u.asmInstr3.instr);
+            writeString(instr->u.asmInstr3.label);
+            break;
+        default:
+            error("unexpected node %d in asm statement", instr->type);
+    }
+}
+
+
+static void writeMethodDec(Absyn *methodDec) {
+    Absyn *instrList;
+    int numInstrs;
+
+    writeClassRef(methodDec->u.methodDec.class);
+    writeString(methodDec->file);
+    writeUnhashedInt(methodDec->line);
+    writeInt(methodDec->u.methodDec.publ);
+    writeInt(methodDec->u.methodDec.stat);
+    writeInt(methodDec->u.methodDec.isConstructor);
+    writeSym(methodDec->u.methodDec.name);
+    instrList = methodDec->u.methodDec.stms->u.stmList.head->u.asmStm.instrList;
+    numInstrs = 0;
+    while (!instrList->u.asmInstrList.isEmpty) {
+        numInstrs++;
+        instrList = instrList->u.asmInstrList.tail;
+    }
+    writeInt(numInstrs);
+    instrList = methodDec->u.methodDec.stms->u.stmList.head->u.asmStm.instrList;
+    while (!instrList->u.asmInstrList.isEmpty) {
+        writeAsmInstr(instrList->u.asmInstrList.head);
+        instrList = instrList->u.asmInstrList.tail;
+    }
+}
+
+
+static void writeCode(InstrProgram *code) {
+    InstrBuffer *buffer;
+    Instr *p;
+    int i, j;
+
+    writeInt(code->numBuffers);
+    for (i = 0; i < code->numBuffers; i++) {
+        buffer = code->buffers[i];
+        writeInt(buffer->numInstrs);
+        for (j = 0; j < buffer->numInstrs; j++) {
+            p = &buffer->instrs[j];
+            writeInt(p->opcode);
+            writeInt(p->immediate);
+            writeInt(p->offset);
+            writeString(p->label);
+        }
+    }
+}
+
+
+/* the classes of the input files, each one followed by its meta class */
+static void collectClasses(Absyn *fileTrees[], int numInFiles,
+        Table **fileTables) {
+    Absyn *classList;
+    Entry *classEntry;
+    int i;
+
+    numOwnClasses = 0;
+    for (i = 0; i < numInFiles; i++) {
+        for (classList = fileTrees[i]->u.file.classes;
+                !classList->u.clsList.isEmpty;
+                classList = classList->u.clsList.tail) {
+            numOwnClasses += 2;
+        }
+    }
+    ownClasses = (Class **) allocate((numOwnClasses + 1) * sizeof(Class *));
+    numOwnClasses = 0;
+    for (i = 0; i < numInFiles; i++) {
+        for (classList = fileTrees[i]->u.file.classes;
+                !classList->u.clsList.isEmpty;
+                classList = classList->u.clsList.tail) {
+            classEntry = lookupClass(&fileTables[i], fileTables[i]->outerScope,
+                    classList->u.clsList.head->u.classDec.name);
+            ownClasses[numOwnClasses++] = classEntry->u.classEntry.class;
+            ownClasses[numOwnClasses++] = classEntry->u.classEntry.class->metaClass;
+        }
+    }
+}
+
+
+/* the method declarations with an asm body */
+static void collectMethodDecs(Absyn *fileTrees[], int numInFiles) {
+    Absyn *classList;
+    Absyn *memberList;
+    Absyn *memberDec;
+    int pass;
+    int i;
+
+    for (pass = 0; pass < 2; pass++) {
+        numOwnMethodDecs = 0;
+        for (i = 0; i < numInFiles; i++) {
+            for (classList = fileTrees[i]->u.file.classes;
+                    !classList->u.clsList.isEmpty;
+                    classList = classList->u.clsList.tail) {
+                for (memberList = classList->u.clsList.head->u.classDec.members;
+                        !memberList->u.mbrList.isEmpty;
+                        memberList = memberList->u.mbrList.tail) {
+                    memberDec = memberList->u.mbrList.head;
+                    if (memberDec->type == ABSYN_METHODDEC && isAsmBody(memberDec)) {
+                        if (pass == 1) {
+                            ownMethodDecs[numOwnMethodDecs] = memberDec;
+                        }
+                        numOwnMethodDecs++;
+                    }
+                }
+            }
+        }
+        if (pass == 0) {
+            ownMethodDecs = (Absyn **)
+                    allocate((numOwnMethodDecs + 1) * sizeof(Absyn *));
+        }
+    }
+}
+
+
+/*
+ * Returns a hash of the interface, i.e. of everything but the code
+ * and the numbers which are not seen by other files. A file compiled
+ * against this one must be compiled again if the hash changes (see
+ * cache.c).
+ */
+unsigned long writeLibrary(char *fileName, Absyn *fileTrees[], int numInFiles,
+        Table **fileTables, InstrProgram *code) {
+    Class *class;
+    int i;
+
+    collectClasses(fileTrees, numInFiles, fileTables);
+    collectMethodDecs(fileTrees, numInFiles);
+    libFileName = fileName;
+    forgetResident(libFileName);
+    libFile = fopen(libFileName, "wb");
+    if (libFile == NULL) {
+        error("cannot open library file '%s'", libFileName);
+    }
+    interfaceHash = 5381;
+    hashingInterface = TRUE;
+    writeInt(LIBRARY_MAGIC);
+    writeInt(LIBRARY_FORMAT);
+    writeUnhashedInt(sharesIntegers());
+    writeUnhashedInt(intCacheMin);
+    writeUnhashedInt(intCacheMax);
+    writeInt(numOwnClasses);
+    for (i = 0; i < numOwnClasses; i++) {
+        class = ownClasses[i];
+        writeSym(class->name);
+        writeInt(class->isPublic);
+        writeString(class->fileName);
+        writeUnhashedInt(class->globalIndex);
+        writeInt(class->numFields);
+        writeInt(class->numMethods);
+    }
+    for (i = 0; i < numOwnClasses; i++) {
+        writeClass(ownClasses[i]);
+    }
+    writeInt(numOwnMethodDecs);
+    for (i = 0; i < numOwnMethodDecs; i++) {
+        writeMethodDec(ownMethodDecs[i]);
+    }
+    hashingInterface = FALSE;
+    writeCode(code);
+    if (ferror(libFile) || fclose(libFile) != 0) {
+        error("cannot write library file '%s'", libFileName);
+    }
+    return interfaceHash;
+}
+
+
+/**************************************************************/
+
+/* reading */
+
+
+static int readInt(void) {
+    unsigned int u;
+    int c;
+    int i;
+
+    u = 0;
+    for (i = 0; i < 4; i++) {
+        c = getc(libFile);
+        if (c == EOF) {
+            error("library file '%s' is truncated", libFileName);
+        }
+        u = (u << 8) | c;
+    }
+    return (int) u;
+}
+
+
+static char *readString(void) {
+    char *s;
+    int length;
+
+    length = readInt();
+    if (length < 0) {
+        return NULL;
+    }
+    s = (char *) allocate(length + 1);
+    if (fread(s, 1, length, libFile) != length) {
+        error("library file '%s' is truncated", libFileName);
+    }
+    s[length] = '\0';
+    return s;
+}
+
+
+static Sym *readSym(void) {
+    char *s;
+
+    s = readString();
+    if (s == NULL) {
+        error("missing name in library file '%s'", libFileName);
+    }
+    return newSym(s);
+}
+
+
+static Class *readClassRef(void) {
+    Entry *classEntry;
+    Sym *name;
+    int ref;
+
+    ref = readInt();
+    if (ref == REF_NONE) {
+        return NULL;
+    }
+    if (ref == REF_EXTERNAL) {
+        name = readSym();
+        classEntry = lookup(libGlobalTable, name, ENTRY_KIND_CLASS);
+        if (classEntry == NULL) {
+            error("unknown class '%s' in library file '%s'",
+                    symToString(name), libFileName);
+        }
+        return classEntry->u.classEntry.class;
+    }
+    if (ref < 0 || ref >= libNumClasses) {
+        error("invalid class reference %d in library file '%s'",
+                ref, libFileName);
+    }
+    return library.classes[libBase + ref];
+}
+
+
+static Type *readType(void) {
+    Type *type;
+    Class *base;
+    int kind;
+    int isStatic;
+
+    kind = readInt();
+    if (kind < 0) {
+        return NULL;
+    }
+    isStatic = readInt();
+    switch (kind) {
+        case TYPE_KIND_VOID:
+            type = newVoidType();
+            break;
+        case TYPE_KIND_NIL:
+            type = newNilType();
+            break;
+        case TYPE_KIND_SIMPLE:
+            type = newSimpleType(readClassRef());
+            break;
+        case TYPE_KIND_ARRAY:
+            base = readClassRef();
+            type = newArrayType(base, readInt());
+            break;
+        default:
+            error("invalid type kind %d in library file '%s'", kind, libFileName);
+            return NULL;
+    }
+    type->isStatic = isStatic;
+    return type;
+}
+
+
+static Entry *readEntry(Class *class) {
+    Entry *entry;
+    boolean isPublic;
+    boolean isStatic;
+    Type *type;
+    Type **types;
+    TypeList *paramTypes;
+    int kind;
+    int n, i;
+
+    kind = readInt();
+    isPublic = readInt();
+    isStatic = readInt();
+    type = readType();
+    switch (kind) {
+        case ENTRY_KIND_METHOD:
+            n = readInt();
+            types = (Type **) allocate((n + 1) * sizeof(Type *));
+            for (i = 0; i < n; i++) {
+                types[i] = readType();
+            }
+            paramTypes = emptyTypeList();
+            for (i = n - 1; i >= 0; i--) {
+                paramTypes = newTypeList(types[i], paramTypes);
+            }
+            release(types);
+            entry = newMethodEntry(isPublic, isStatic, type, paramTypes,
+                    newTable(class->mbrTable), NULL);
+            entry->u.methodEntry.numLocals = readInt();
+            entry->u.methodEntry.numParams = readInt();
+            entry->u.methodEntry.class = readClassRef();
+            break;
+        case ENTRY_KIND_VARIABLE:
+            entry = newVariableEntry(FALSE, isPublic, isStatic, type);
+            entry->u.variableEntry.offset = readInt();
+            break;
+        default:
+            error("invalid entry kind %d in library file '%s'", kind, libFileName);
+            return NULL;
+    }
+    return entry;
+}
+
+
+static void readClass(Class *class) {
+    InstanceVar **vars;
+    Sym *name;
+    char *className;
+    char *fileName;
+    int n, i;
+
+    class->superClass = readClassRef();
+    class->metaClass = readClassRef();
+    class->vmt = newEmptyVMT();
+    n = readInt();
+    for (i = 0; i < n; i++) {
+        name = readSym();
+        className = readString();
+        fileName = readString();
+        appendVMT(class->vmt, name, className, fileName);
+    }
+    n = readInt();
+    vars = (InstanceVar **) allocate((n + 1) * sizeof(InstanceVar *));
+    for (i = 0; i < n; i++) {
+        vars[i] = newInstanceVar(NULL, NULL, NULL, NULL, 0);
+        vars[i]->name = readSym();
+        vars[i]->className = readSym();
+        vars[i]->fileName = readSym();
+        vars[i]->offset = readInt();
+    }
+    class->attibuteList = newEmptyInstanceVar();
+    for (i = n - 1; i >= 0; i--) {
+        vars[i]->next = class->attibuteList;
+        class->attibuteList = vars[i];
+    }
+    release(vars);
+    n = readInt();
+    for (i = 0; i < n; i++) {
+        name = readSym();
+        if (enter(class->mbrTable, name, readEntry(class)) == NULL) {
+            error("member '%s' of class '%s' defined twice in library file '%s'",
+                    symToString(name), symToString(class->name), libFileName);
+        }
+    }
+}
+
+
+static Absyn *readAsmInstr(char *file, int line) {
+    Absyn *instr;
+    char *mnemonic;
+    int type;
+    int n;
+
+    type = readInt();
+    mnemonic = readString();
+    switch (type) {
+        case ABSYN_ASMINSTR0:
+            instr = newAsmInstr0(file, line, mnemonic);
+            break;
+        case ABSYN_ASMINSTR1:
+            instr = newAsmInstr1(file, line, mnemonic, readInt());
+            break;
+        case ABSYN_ASMINSTR2:
+            n = readInt();
+            instr = newAsmInstr2(file, line, mnemonic, n, readInt());
+            break;
+        case ABSYN_ASMINSTR3:
+            instr = newAsmInstr3(file, line, mnemonic, readString());
+            break;
+        default:
+            error("invalid asm instruction in library file '%s'", libFileName);
+            return NULL;
+    }
+    return instr;
+}
+
+
+static Absyn *readMethodDec(void) {
+    Absyn *methodDec;
+    Absyn **instrs;
+    Absyn *instrList;
+    Class *class;
+    char *file;
+    int line;
+    boolean publ, stat, isConstructor;
+    Sym *name;
+    int n, i;
+
+    class = readClassRef();
+    file = readString();
+    line = readInt();
+    publ = readInt();
+    stat = readInt();
+    isConstructor = readInt();
+    name = readSym();
+    n = readInt();
+    instrs = (Absyn **) allocate((n + 1) * sizeof(Absyn *));
+    for (i = 0; i < n; i++) {
+        instrs[i] = readAsmInstr(file, line);
+    }
+    instrList = emptyAsmInstrList();
+    for (i = n - 1; i >= 0; i--) {
+        instrList = newAsmInstrList(instrs[i], instrList);
+    }
+    release(instrs);
+    methodDec = newMethodDec(file, line, publ, stat, isConstructor, name,
+            NULL, emptyParList(), emptyVarList(),
+            newStmList(newAsmStm(file, line, instrList), emptyStmList()));
+    methodDec->u.methodDec.class = class;
+    return methodDec;
+}
+
+
+static void readCode(InstrProgram *code) {
+    InstrBuffer *buffer;
+    int opcode;
+    int immediate;
+    int numBuffers, numInstrs;
+    int i, j;
+
+    numBuffers = readInt();
+    for (i = 0; i < numBuffers; i++) {
+        buffer = appendInstrBuffer(code);
+        numInstrs = readInt();
+        for (j = 0; j < numInstrs; j++) {
+            opcode = readInt();
+            if (opcode < 0 || opcode >= NUM_OPCODES) {
+                error("invalid opcode %d in library file '%s'", opcode, libFileName);
+            }
+            immediate = readInt();
+            appendInstr2(buffer, opcode, immediate, readInt());
+            buffer->instrs[buffer->numInstrs - 1].label = readString();
+        }
+    }
+}
+
+
+static void addClass(Class *class) {
+    Class **newClasses;
+
+    if (library.numClasses == maxClasses) {
+        maxClasses = maxClasses == 0 ? 64 : 2 * maxClasses;
+        newClasses = (Class **) allocate(maxClasses * sizeof(Class *));
+        if (library.numClasses > 0) {
+            memcpy(newClasses, library.classes,
+                    library.numClasses * sizeof(Class *));
+            release(library.classes);
+        }
+        library.classes = newClasses;
+    }
+    library.classes[library.numClasses++] = class;
+}
+
+
+static void addMethodDec(Absyn *methodDec) {
+    Absyn **newMethodDecs;
+
+    if (library.numMethodDecs == maxMethodDecs) {
+        maxMethodDecs = maxMethodDecs == 0 ? 64 : 2 * maxMethodDecs;
+        newMethodDecs = (Absyn **) allocate(maxMethodDecs * sizeof(Absyn *));
+        if (library.numMethodDecs > 0) {
+            memcpy(newMethodDecs, library.methodDecs,
+                    library.numMethodDecs * sizeof(Absyn *));
+            release(library.methodDecs);
+        }
+        library.methodDecs = newMethodDecs;
+    }
+    library.methodDecs[library.numMethodDecs++] = methodDec;
+}
+
+
+/* the range of the shared Integers, a file without them fits any */
+static void readIntCache(void) {
+    boolean shared;
+    int min, max;
+
+    shared = readInt();
+    min = readInt();
+    max = readInt();
+    if (!shared) {
+        return;
+    }
+    if ((sharesIntegers() || library.intCache)
+            && (min != intCacheMin || max != intCacheMax)) {
+        error("'%s' shares the Integers from %d to %d, not from %d to %d "
+                "(see --int-cache)", libFileName, min, max,
+                intCacheMin, intCacheMax);
+    }
+    intCacheMin = min;
+    intCacheMax = max;
+    library.intCache = TRUE;
+}
+
+
+/* create the classes of a file, so that all files can refer to them */
+static void readClassHeaders(void) {
+    Class *class;
+    Sym *name;
+    boolean isPublic;
+    char *fileName;
+    int i;
+
+    if (readInt() != LIBRARY_MAGIC || readInt() != LIBRARY_FORMAT) {
+        error("'%s' is not a library or object file of this compiler",
+                libFileName);
+    }
+    readIntCache();
+    libNumClasses = readInt();
+    if (libNumClasses < 0 || libNumClasses % 2 != 0) {
+        error("invalid number of classes in library file '%s'", libFileName);
+    }
+    for (i = 0; i < libNumClasses; i++) {
+        name = readSym();
+        isPublic = readInt();
+        fileName = readString();
+        class = newClass(isPublic, name, fileName, NULL, NULL,
+                newTable(libGlobalTable));
+        class->globalIndex = readInt();
+        class->numFields = readInt();
+        class->numMethods = readInt();
+        addClass(class);
+        if (isPublic && enter(libGlobalTable, name, newClassEntry(class)) == NULL) {
+            error("class '%s' of library file '%s' is defined twice",
+                    symToString(name), libFileName);
+        }
+    }
+}
+
+
+static void readClassBodies(void) {
+    int n, i;
+
+    for (i = 0; i < libNumClasses; i++) {
+        readClass(library.classes[libBase + i]);
+    }
+    n = readInt();
+    for (i = 0; i < n; i++) {
+        addMethodDec(readMethodDec());
+    }
+    readCode(library.code);
+}
+
+
+/*
+ * The meta class objects are numbered in the order of the files, the
+ * pushg and popg instructions of their code name the class whose
+ * object they address.
+ */
+static void relocateGlobals(void) {
+    Class **buckets;
+    Class *class;
+    InstrBuffer *buffer;
+    Instr *p;
+    char **labels;
+    unsigned int numBuckets;
+    unsigned int index;
+    int i, j;
+
+    numBuckets = 2 * library.numClasses + 1;
+    buckets = (Class **) allocate(numBuckets * sizeof(Class *));
+    labels = (char **) allocate(numBuckets * sizeof(char *));
+    memset(buckets, 0, numBuckets * sizeof(Class *));
+    for (i = 0; i < library.numClasses; i++) {
+        class = library.classes[i];
+        if (i % 2 == 1) {
+            class->globalIndex = firstClassGlobal() + i / 2;
+        }
+        /* open addressing, the table is at most half full */
+        index = djb2(classLabel(class)) % numBuckets;
+        while (buckets[index] != NULL) {
+            index = (index + 1) % numBuckets;
+        }
+        buckets[index] = class;
+        labels[index] = classLabel(class);
+    }
+    for (i = 0; i < library.code->numBuffers; i++) {
+        buffer = library.code->buffers[i];
+        for (j = 0; j < buffer->numInstrs; j++) {
+            p = &buffer->instrs[j];
+            if ((p->opcode != OP_PUSHG && p->opcode != OP_POPG)
+                    || p->label == NULL) {
+                continue;
+            }
+            index = djb2(p->label) % numBuckets;
+            while (buckets[index] != NULL
+                    && strcmp(labels[index], p->label) != 0) {
+                index = (index + 1) % numBuckets;
+            }
+            if (buckets[index] == NULL) {
+                error("class '%s' is missing in the library and object files",
+                        p->label);
+            }
+            p->immediate = buckets[index]->globalIndex;
+        }
+    }
+    release(labels);
+    release(buckets);
+}
+
+
+/* forget the loaded files, before loading into a new global table */
+void resetLibraries(void) {
+    int i;
+
+    for (i = 0; i < numPendingFiles; i++) {
+        if (pendingFiles[i] != NULL) {
+            fclose(pendingFiles[i]);
+        }
+    }
+    numPendingFiles = 0;
+    library.numClasses = 0;
+    library.classes = NULL;
+    library.numMethodDecs = 0;
+    library.methodDecs = NULL;
+    library.code = NULL;
+    library.intCache = FALSE;
+    maxClasses = 0;
+    maxMethodDecs = 0;
+}
+
+
+/*
+ * Only create the classes of the files. Their bodies may refer to the
+ * classes of the input files, then they are read by check() when it
+ * has entered these classes (see cache.c). Their code is not linked.
+ */
+void readLibraryHeaders(int numFiles, char *fileNames[], Table *globalTable) {
+    int i;
+
+    if (numFiles == 0) {
+        return;
+    }
+    startPass(PASS_LOAD);
+    libGlobalTable = globalTable;
+    pendingFiles = (FILE **) allocate(numFiles * sizeof(FILE *));
+    pendingNames = fileNames;
+    pendingBases = (int *) allocate(numFiles * sizeof(int));
+    pendingCounts = (int *) allocate(numFiles * sizeof(int));
+
+    /* all classes must exist before they can be referenced */
+    for (i = 0; i < numFiles; i++) {
+        libFileName = fileNames[i];
+        libFile = openLibrary(libFileName);
+        if (libFile == NULL) {
+            error("cannot open library file '%s'", libFileName);
+        }
+        /* to be closed by resetLibraries() if reading fails */
+        pendingFiles[i] = libFile;
+        numPendingFiles = i + 1;
+        pendingBases[i] = library.numClasses;
+        readClassHeaders();
+        pendingCounts[i] = libNumClasses;
+    }
+    library.code = newInstrProgram();
+    endPass(PASS_LOAD);
+}
+
+
+/* the rest of the files whose headers have been read, if any */
+void readLibraryBodies(void) {
+    int i;
+
+    if (numPendingFiles == 0) {
+        return;
+    }
+    startPass(PASS_LOAD);
+    for (i = 0; i < numPendingFiles; i++) {
+        libFileName = pendingNames[i];
+        libFile = pendingFiles[i];
+        libBase = pendingBases[i];
+        libNumClasses = pendingCounts[i];
+        readClassBodies();
+        fclose(libFile);
+        pendingFiles[i] = NULL;
+    }
+    release(pendingCounts);
+    release(pendingBases);
+    release(pendingFiles);
+    numPendingFiles = 0;
+    endPass(PASS_LOAD);
+}
+
+
+void readLibraries(int numFiles, char *fileNames[], Table *globalTable) {
+    if (numFiles == 0) {
+        return;
+    }
+    readLibraryHeaders(numFiles, fileNames, globalTable);
+    readLibraryBodies();
+    relocateGlobals();
+}
@@ -0,0 +1,31 @@
+/*
+ * library.h -- precompiled libraries and object files
+ */
+
+#ifndef LIBRARY_H
+#define	LIBRARY_H
+
+/* name of the interface file in the library directory */
+#define LIBRARY_FILE	"njlib.nji"
+
+typedef struct {
+    int numClasses;		/* every class is followed by its meta class */
+    Class **classes;
+    int numMethodDecs;		/* methods with an asm body, see inline.c */
+    Absyn **methodDecs;
+    InstrProgram *code;		/* the code of all loaded classes */
+    boolean intCache;		/* some code shares Integers, see codegen.h */
+} Library;
+
+/* the library and object files loaded, empty if there are none */
+extern Library library;
+
+unsigned long writeLibrary(char *fileName, Absyn *fileTrees[], int numInFiles,
+        Table **fileTables, InstrProgram *code);
+void resetLibraries(void);
+void keepLibrariesResident(void);
+void readLibraries(int numFiles, char *fileNames[], Table *globalTable);
+void readLibraryHeaders(int numFiles, char *fileNames[], Table *globalTable);
+void readLibraryBodies(void);
+
+#endif	/* LIBRARY_H */
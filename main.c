@@ -16,13 +16,27 @@
 #include "scanner.h"
 #include "instance.h"
 #include "table.h"
+#include "wellknown.h"
 #include "parser.h"
 #include "semant.h"
+#include "escape.h"
+#include "cha.h"
+#include "inline.h"
+#include "instr.h"
+#include "peephole.h"
+#include "superinstr.h"
+#include "binary.h"
+#include "library.h"
 #include "codegen.h"
+#include "cache.h"
+#include "server.h"
+#include "timer.h"
 
 #define VERSION		7
 
 char *mainClass = "Main";
+int optimizationLevel = 0;
+int numJobs = 0;
 
 static void version(char *myself) {
   /* show version and compilation date */
@@ -31,16 +45,64 @@ static void version(char *myself) {
 }
 
 
+static boolean hasSuffix(char *name, char *suffix) {
+  int n, m;
+
+  n = strlen(name);
+  m = strlen(suffix);
+  return n >= m && strcmp(name + n - m, suffix) == 0;
+}
+
+
+/* x.nj is compiled into x.njo by default */
+static char *objectFileName(char *sourceName) {
+  char *name;
+  int n;
+
+  if (!hasSuffix(sourceName, ".nj")) {
+    return appendString(sourceName, ".njo");
+  }
+  n = strlen(sourceName);
+  name = (char *) allocate(n + 2);
+  strcpy(name, sourceName);
+  strcpy(name + n, "o");
+  return name;
+}
+
+
 static void help(char *myself) {
   /* show some help how to use the program */
   printf("Usage: %s [options] <input file> [...]\n", myself);
+  printf("Input files are sources (*.nj) and object files (*.njo),\n");
+  printf("object files alone are linked to a program.\n");
   printf("Options:\n");
   printf("  --output <file>     specify output file\n");
   printf("  --mainclass <class> specify main class\n");
-  printf("  --njlib <dir>       specify location of library\n");
+  printf("  --njlib <dir>       load the precompiled library from <dir>\n");
+  printf("  --write-njlib <dir> compile the input files as library into <dir>\n");
+  printf("  -c                  compile the input file into an object file\n");
+  printf("  --cache <dir>       compile only changed files, keep the others\n");
+  printf("                      as object files in <dir>\n");
+  printf("  --server <socket>   answer compile requests on <socket>, needs --cache\n");
+  printf("  --connect <socket>  let the server on <socket> compile the input files\n");
   printf("  --tokens            show stream of tokens (no parsing)\n");
   printf("  --absyn             show abstract syntax\n");
   printf("  --tables            show symbol tables\n");
+  printf("  --stats             show optimizer and memory statistics\n");
+  printf("  --time-passes       show time and memory used by each pass\n");
+  printf("  --emit-bin          write binary code instead of assembler\n");
+  printf("  --superinstr        use the superinstructions of njvm\n");
+  printf("  --int-cache <min>,<max>\n");
+  printf("                      share the Integers from min to max\n");
+  printf("                      (default: -128,1023)\n");
+  printf("  --jobs <n>          number of threads (default: one per processor)\n");
+  printf("  -O<level>           optimization level (default 0)\n");
+  printf("                      1: inline Integer arithmetic and comparisons,\n");
+  printf("                         fold constant expressions,\n");
+  printf("                         bind monomorphic calls statically,\n");
+  printf("                         share small Integers (see --int-cache)\n");
+  printf("                      2: also keep non-escaping values unboxed,\n");
+  printf("                         inline small asm methods\n");
   printf("  --version           show version and exit\n");
   printf("  --help              show this help and exit\n");
 }
@@ -48,25 +110,46 @@ static void help(char *myself) {
 
 int main(int argc, char *argv[]) {
   int i;
+  char c;
   char *inFileName[MAX_INFILES];
   int numInFiles;
+  char *objFileName[MAX_INFILES + 1];
+  int numObjFiles;
   char *outFileName;
   char *ninjaLibrary;
+  char *libraryDir;
+  char *cacheDir;
+  char *serverSocket;
+  char *clientSocket;
+  boolean optionCompile;
+  boolean isLibrary;
   boolean optionTokens;
   boolean optionAbsyn;
   boolean optionTables;
-  int token;
+  boolean optionStats;
+  boolean optionEmitBin;
+  yyscan_t scanner;
   Absyn *fileTrees[MAX_INFILES];
   FILE *outFile;
+  Table *globalTable;
   Table **fileTables;
+  InstrProgram *program;
 
   /* analyze command line */
   numInFiles = 0;
+  numObjFiles = 0;
   outFileName = NULL;
+  ninjaLibrary = NULL;
+  optionCompile = FALSE;
   optionTokens = FALSE;
   optionAbsyn = FALSE;
   optionTables = FALSE;
-  ninjaLibrary = NULL;
+  optionStats = FALSE;
+  optionEmitBin = FALSE;
+  libraryDir = NULL;
+  cacheDir = NULL;
+  serverSocket = NULL;
+  clientSocket = NULL;
   for (i = 1; i < argc; i++) {
     if (argv[i][0] == '-') {
       /* option */
@@ -90,6 +173,33 @@ int main(int argc, char *argv[]) {
         }
         ninjaLibrary = argv[i];
       } else
+      if (strcmp(argv[i], "--write-njlib") == 0) {
+        if (++i == argc) {
+          error("library directory missing");
+        }
+        libraryDir = argv[i];
+      } else
+      if (strcmp(argv[i], "-c") == 0) {
+        optionCompile = TRUE;
+      } else
+      if (strcmp(argv[i], "--cache") == 0) {
+        if (++i == argc) {
+          error("cache directory missing");
+        }
+        cacheDir = argv[i];
+      } else
+      if (strcmp(argv[i], "--server") == 0) {
+        if (++i == argc) {
+          error("server socket missing");
+        }
+        serverSocket = argv[i];
+      } else
+      if (strcmp(argv[i], "--connect") == 0) {
+        if (++i == argc) {
+          error("server socket missing");
+        }
+        clientSocket = argv[i];
+      } else
       if (strcmp(argv[i], "--tokens") == 0) {
         optionTokens = TRUE;
       } else
@@ -99,6 +209,36 @@ int main(int argc, char *argv[]) {
       if (strcmp(argv[i], "--tables") == 0) {
         optionTables = TRUE;
       } else
+      if (strcmp(argv[i], "--stats") == 0) {
+        optionStats = TRUE;
+      } else
+      if (strcmp(argv[i], "--time-passes") == 0) {
+        timePasses = TRUE;
+      } else
+      if (strcmp(argv[i], "--emit-bin") == 0) {
+        optionEmitBin = TRUE;
+      } else
+      if (strcmp(argv[i], "--superinstr") == 0) {
+        superInstrs = TRUE;
+      } else
+      if (strcmp(argv[i], "--int-cache") == 0) {
+        if (++i == argc
+            || sscanf(argv[i], "%d,%d%c", &intCacheMin, &intCacheMax, &c) != 2
+            || intCacheMin > intCacheMax
+            || (double) intCacheMax - intCacheMin >= 65536) {
+          error("range of shared Integers missing or invalid");
+        }
+      } else
+      if (strcmp(argv[i], "--jobs") == 0) {
+        if (++i == argc || atoi(argv[i]) < 1) {
+          error("number of jobs missing or invalid");
+        }
+        numJobs = atoi(argv[i]);
+      } else
+      if (argv[i][1] == 'O' && argv[i][2] >= '0' && argv[i][2] <= '9'
+          && argv[i][3] == '\0') {
+        optimizationLevel = argv[i][2] - '0';
+      } else
       if (strcmp(argv[i], "--version") == 0) {
         version(argv[0]);
         exit(0);
@@ -112,37 +252,109 @@ int main(int argc, char *argv[]) {
       }
     } else {
       /* file */
-      if (numInFiles == MAX_INFILES) {
+      if (numInFiles + numObjFiles == MAX_INFILES) {
         error("too many input files");
       }
-      inFileName[numInFiles++] = argv[i];
+      if (hasSuffix(argv[i], ".njo")) {
+        objFileName[numObjFiles++] = argv[i];
+      } else {
+        inFileName[numInFiles++] = argv[i];
+      }
     }
   }
-  if (numInFiles == 0) {
+  if (numInFiles + numObjFiles == 0 && serverSocket == NULL) {
     error("no input file");
   }
-
-  /* scan & parse source */
-  for (i = 0; i < numInFiles; i++) {
-/*    printf("Compiling file '%s'...\n", inFileName[i]); */
-    if (!yyInit(inFileName[i])) {
-      error("cannot open input file '%s'", inFileName[i]);
+  if (optionCompile) {
+    if (numInFiles != 1 || libraryDir != NULL) {
+      error("option '-c' needs exactly one source file");
     }
-    if (optionTokens) {
-      do {
-        token = yylex();
-        showToken(token);
-      } while (token != 0);
-    } else {
-      yyparse();
-      /* Set file name in Absyn Tree */
-      fileTree->file = inFileName[i];
-      fileTrees[i] = fileTree;
+    if (outFileName == NULL) {
+      outFileName = objectFileName(inFileName[0]);
+    }
+  }
+  if (cacheDir != NULL && serverSocket == NULL
+      && (numInFiles == 0 || optionCompile || libraryDir != NULL)) {
+    error("option '--cache' needs source files of a program");
+  }
+  if (serverSocket != NULL && (cacheDir == NULL || numInFiles != 0)) {
+    error("option '--server' needs '--cache' and no source files");
+  }
+  if (clientSocket != NULL) {
+    if (numInFiles == 0 || numObjFiles != 0 || ninjaLibrary != NULL) {
+      error("option '--connect' needs source files only");
+    }
+    return requestCompile(clientSocket, numInFiles, inFileName,
+                          outFileName, optionEmitBin);
+  }
+  if (ninjaLibrary != NULL) {
+    /* the library comes first, the object files may depend on it */
+    for (i = numObjFiles; i > 0; i--) {
+      objFileName[i] = objFileName[i - 1];
     }
+    objFileName[0] = appendString(ninjaLibrary, "/" LIBRARY_FILE);
+    numObjFiles++;
+  }
+  if (serverSocket != NULL) {
+    /* does not return */
+    runServer(serverSocket, cacheDir, numObjFiles, objFileName);
   }
+  /* a library or object file does not know the rest of the program */
+  isLibrary = libraryDir != NULL || optionCompile;
+
+  /* scan & parse source */
+  useArena(ARENA_PARSE);
   if (optionTokens) {
+    for (i = 0; i < numInFiles; i++) {
+      scanner = newScanner(inFileName[i]);
+      if (scanner == NULL) {
+        error("cannot open input file '%s'", inFileName[i]);
+      }
+      showTokens(scanner);
+      freeScanner(scanner);
+    }
     exit(0);
   }
+  if (timePasses) {
+    /* the parser scans again, this is only to see what scanning costs */
+    startPass(PASS_SCAN);
+    for (i = 0; i < numInFiles; i++) {
+      scanner = newScanner(inFileName[i]);
+      if (scanner == NULL) {
+        error("cannot open input file '%s'", inFileName[i]);
+      }
+      scanTokens(scanner);
+      freeScanner(scanner);
+    }
+    endPass(PASS_SCAN);
+  }
+  if (cacheDir != NULL) {
+    /* the files are parsed and checked by the cache as needed */
+    if(NULL != outFileName)
+        outFile = fopen(outFileName, optionEmitBin ? "wb" : "w");
+    else
+        outFile = (FILE*)stdout;
+    buildWithCache(cacheDir, numInFiles, inFileName, numObjFiles, objFileName,
+                   outFile, optionEmitBin);
+    if (optionStats) {
+      showCacheStats(stderr);
+      showPeepholeStats(stderr);
+      if (superInstrs) {
+        showSuperInstrStats(stderr);
+      }
+      showArenaStats(stderr);
+    }
+    if (timePasses) {
+      showPassTimes(stderr);
+    }
+    if(NULL != outFileName)
+        fclose(outFile);
+    releaseArena(ARENA_CODEGEN);
+    releaseArena(ARENA_SEMANT);
+    releaseArena(ARENA_PARSE);
+    return 0;
+  }
+  parseFiles(numInFiles, inFileName, fileTrees);
   if (optionAbsyn) {
     for (i = 0; i < numInFiles; i++) {
       printf("Abstract syntax for file \"%s\":\n", inFileName[i]);
@@ -150,7 +362,29 @@ int main(int argc, char *argv[]) {
     }
   }
   /* do semantic analysis */
-  fileTables = check(fileTrees, numInFiles, optionTables);
+  useArena(ARENA_SEMANT);
+  globalTable = newGlobalTable();
+  readLibraries(numObjFiles, objFileName, globalTable);
+  if (numInFiles == 0) {
+    /* just link the object files, their interfaces declare the builtins */
+    fileTables = NULL;
+    initWellKnownTypes(globalTable);
+  } else {
+    fileTables = check(fileTrees, numInFiles, globalTable,
+                       optionTables, isLibrary);
+    startPass(PASS_OPTIMIZE);
+    /* a library does not know the subclasses a program may add */
+    if (optimizationLevel >= 1 && !isLibrary) {
+      analyzeClassHierarchy(fileTrees, numInFiles, fileTables);
+    }
+    if (optimizationLevel >= 2) {
+      analyzeEscapes(fileTrees, numInFiles);
+      if (!isLibrary) {
+        inlineCalls(fileTrees, numInFiles);
+      }
+    }
+    endPass(PASS_OPTIMIZE);
+  }
 
   
   if (optionAbsyn) {
@@ -159,17 +393,54 @@ int main(int argc, char *argv[]) {
       showAbsyn(fileTrees[i]);
     }
   }
-  /* If there is a filename open it, else use STDOUT */
-  if(NULL != outFileName)
-      outFile = fopen(outFileName, "w");
-  else
-      outFile = (FILE*)stdout;
-  /* generate code */
-  generateCode(fileTrees, numInFiles, fileTables, outFile);
+  if (isLibrary) {
+    /* generate the library's code and write it with the interface */
+    useArena(ARENA_CODEGEN);
+    writeLibrary(optionCompile ? outFileName :
+                   appendString(libraryDir, "/" LIBRARY_FILE),
+                 fileTrees, numInFiles, fileTables,
+                 generateLibraryCode(fileTrees, numInFiles, fileTables));
+    outFileName = NULL;
+    outFile = NULL;
+  } else {
+    /* If there is a filename open it, else use STDOUT */
+    if(NULL != outFileName)
+        outFile = fopen(outFileName, optionEmitBin ? "wb" : "w");
+    else
+        outFile = (FILE*)stdout;
+    /* generate code */
+    useArena(ARENA_CODEGEN);
+    program = generateCode(fileTrees, numInFiles, fileTables, globalTable);
+    /*
+     * The syntax trees (parse) and the tables, VMTs, layouts and loaded
+     * files (semant) are used up to the last method generated, but the
+     * code refers to none of them (see generateCode). Only the codegen
+     * arena stays alive while the code is fused and written.
+     */
+    releaseArena(ARENA_SEMANT);
+    releaseArena(ARENA_PARSE);
+    writeProgram(program, outFile, optionEmitBin);
+  }
+  if (optionStats) {
+    /* not on stdout, it may be the assembler output */
+    showPeepholeStats(stderr);
+    if (superInstrs) {
+      showSuperInstrStats(stderr);
+    }
+    showArenaStats(stderr);
+  }
+  if (timePasses) {
+    showPassTimes(stderr);
+  }
 
   if(NULL != outFileName)
       fclose(outFile);
 
+  /* a library is written with its syntax trees and tables */
+  releaseArena(ARENA_CODEGEN);
+  releaseArena(ARENA_SEMANT);
+  releaseArena(ARENA_PARSE);
+
   /* done */
   return 0;
 }
@@ -0,0 +1,306 @@
+/*
+ * ngrams.c -- frequent instruction sequences
+ *
+ * Counts the sequences of n consecutive instructions (n-grams) in the
+ * assembler output of njc and shows those which would save the most
+ * dispatches as a superinstruction (see ../superinstr.c). A sequence
+ * never spans a label, a jump could enter it in the middle, nor a
+ * VMT. Operands are replaced by their kind ("pushl n", "jmp L"),
+ * except those of getf, putf and new which select what the sequence
+ * does. The class address after new, newa and instof is part of the
+ * instruction. The counts are static, every instruction counts once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#define VERSION		1
+
+#define LINE_SIZE	1000
+#define TOKEN_SIZE	40
+#define MAX_N		8
+#define NUM_BUCKETS	4099
+
+#define DEFAULT_MIN	2
+#define DEFAULT_MAX	4
+#define DEFAULT_TOP	20
+
+
+typedef struct ngram {
+  char *text;			/* the instructions, separated by "; " */
+  int n;
+  unsigned long count;
+  struct ngram *next;
+} Ngram;
+
+static Ngram *buckets[NUM_BUCKETS];
+static int numNgrams;
+
+static int minN;
+static int maxN;
+
+/* the last instructions since the last label */
+static char window[MAX_N][TOKEN_SIZE];
+static int windowSize;
+
+
+static void error(char *fmt, ...) {
+  va_list ap;
+
+  va_start(ap, fmt);
+  fprintf(stderr, "Error: ");
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+  exit(1);
+}
+
+
+static unsigned long djb2(char *s) {
+  unsigned long hash;
+
+  hash = 5381;
+  while (*s != '\0') {
+    hash = hash * 33 + (unsigned char) *s++;
+  }
+  return hash;
+}
+
+
+static void countNgram(char *text, int n) {
+  Ngram *ngram;
+  unsigned long index;
+
+  index = djb2(text) % NUM_BUCKETS;
+  for (ngram = buckets[index]; ngram != NULL; ngram = ngram->next) {
+    if (strcmp(ngram->text, text) == 0) {
+      ngram->count++;
+      return;
+    }
+  }
+  ngram = (Ngram *) malloc(sizeof(Ngram));
+  if (ngram == NULL) {
+    error("out of memory");
+  }
+  ngram->text = (char *) malloc(strlen(text) + 1);
+  if (ngram->text == NULL) {
+    error("out of memory");
+  }
+  strcpy(ngram->text, text);
+  ngram->n = n;
+  ngram->count = 1;
+  ngram->next = buckets[index];
+  buckets[index] = ngram;
+  numNgrams++;
+}
+
+
+/* the n-grams which end with the instruction just added */
+static void countWindow(void) {
+  char text[MAX_N * (TOKEN_SIZE + 2)];
+  int n, i;
+
+  for (n = minN; n <= maxN && n <= windowSize; n++) {
+    text[0] = '\0';
+    for (i = windowSize - n; i < windowSize; i++) {
+      strcat(text, window[i]);
+      if (i < windowSize - 1) {
+        strcat(text, "; ");
+      }
+    }
+    countNgram(text, n);
+  }
+}
+
+
+static void addInstr(char *mnemonic, char *operand) {
+  if (windowSize == maxN) {
+    memmove(window[0], window[1], (MAX_N - 1) * TOKEN_SIZE);
+    windowSize--;
+  }
+  if (operand == NULL) {
+    sprintf(window[windowSize], "%.30s", mnemonic);
+  } else
+  if (strcmp(mnemonic, "getf") == 0 || strcmp(mnemonic, "putf") == 0
+      || strcmp(mnemonic, "new") == 0) {
+    sprintf(window[windowSize], "%.20s %.10s", mnemonic, operand);
+  } else
+  if (strcmp(mnemonic, "vmcall") == 0) {
+    sprintf(window[windowSize], "vmcall n,m");
+  } else
+  if ((operand[0] >= '0' && operand[0] <= '9') || operand[0] == '-') {
+    sprintf(window[windowSize], "%.30s n", mnemonic);
+  } else {
+    sprintf(window[windowSize], "%.30s L", mnemonic);
+  }
+  windowSize++;
+  countWindow();
+}
+
+
+static void readAsmFile(char *fileName) {
+  FILE *file;
+  char line[LINE_SIZE];
+  char *mnemonic;
+  char *operand;
+
+  file = fopen(fileName, "r");
+  if (file == NULL) {
+    error("cannot open assembler file '%s'", fileName);
+  }
+  windowSize = 0;
+  while (fgets(line, LINE_SIZE, file) != NULL) {
+    if (line[0] == '/' && line[1] == '/') {
+      /* comment */
+      continue;
+    }
+    mnemonic = strtok(line, " \t\r\n");
+    if (mnemonic == NULL || line[0] != '\t') {
+      /* empty line between buffers, or label */
+      windowSize = 0;
+      continue;
+    }
+    operand = strtok(NULL, " \t\r\n");
+    if (strcmp(mnemonic, ".addr") == 0) {
+      /* the class of the instruction before, or a VMT */
+      if (windowSize == 0 || (strncmp(window[windowSize - 1], "new", 3) != 0
+                              && strcmp(window[windowSize - 1], "instof") != 0)) {
+        windowSize = 0;
+      }
+      continue;
+    }
+    addInstr(mnemonic, operand);
+  }
+  fclose(file);
+}
+
+
+/* most saved dispatches first */
+static int compareNgrams(const void *p1, const void *p2) {
+  Ngram *n1 = *(Ngram **) p1;
+  Ngram *n2 = *(Ngram **) p2;
+  unsigned long saved1 = n1->count * (n1->n - 1);
+  unsigned long saved2 = n2->count * (n2->n - 1);
+
+  if (saved1 != saved2) {
+    return saved1 < saved2 ? 1 : -1;
+  }
+  return strcmp(n1->text, n2->text);
+}
+
+
+static void showNgrams(int top) {
+  Ngram **all;
+  Ngram *ngram;
+  int i, n;
+
+  all = (Ngram **) malloc((numNgrams + 1) * sizeof(Ngram *));
+  if (all == NULL) {
+    error("out of memory");
+  }
+  n = 0;
+  for (i = 0; i < NUM_BUCKETS; i++) {
+    for (ngram = buckets[i]; ngram != NULL; ngram = ngram->next) {
+      all[n++] = ngram;
+    }
+  }
+  qsort(all, n, sizeof(Ngram *), compareNgrams);
+  printf("%8s %8s  %s\n", "count", "saved", "instructions");
+  for (i = 0; i < n && i < top; i++) {
+    printf("%8lu %8lu  %s\n", all[i]->count,
+           all[i]->count * (all[i]->n - 1), all[i]->text);
+  }
+}
+
+
+/**************************************************************/
+
+
+static void version(char *myself) {
+  /* show version and compilation date */
+  printf("%s version %d (compiled %s, %s)\n",
+         myself, VERSION, __DATE__, __TIME__);
+}
+
+
+static void help(char *myself) {
+  /* show some help how to use the program */
+  printf("Usage: %s [options] <assembler file> [...]\n", myself);
+  printf("Shows the most frequent instruction sequences in the output\n");
+  printf("of njc, most saved dispatches first.\n");
+  printf("Options:\n");
+  printf("  --min <n>           shortest sequence (default %d)\n",
+         DEFAULT_MIN);
+  printf("  --max <n>           longest sequence (default %d, at most %d)\n",
+         DEFAULT_MAX, MAX_N);
+  printf("  --top <n>           number of sequences shown (default %d)\n",
+         DEFAULT_TOP);
+  printf("  --version           show version and exit\n");
+  printf("  --help              show this help and exit\n");
+}
+
+
+static int numberArgument(int argc, char *argv[], int i, char *what) {
+  if (i == argc || atoi(argv[i]) < 1) {
+    error("%s missing or invalid", what);
+  }
+  return atoi(argv[i]);
+}
+
+
+int main(int argc, char *argv[]) {
+  int i;
+  int top;
+  char **fileNames;
+  int numFiles;
+
+  fileNames = (char **) malloc(argc * sizeof(char *));
+  if (fileNames == NULL) {
+    error("out of memory");
+  }
+  minN = DEFAULT_MIN;
+  maxN = DEFAULT_MAX;
+  top = DEFAULT_TOP;
+  numFiles = 0;
+  for (i = 1; i < argc; i++) {
+    if (argv[i][0] == '-') {
+      /* option */
+      if (strcmp(argv[i], "--min") == 0) {
+        minN = numberArgument(argc, argv, ++i, "minimum length");
+      } else
+      if (strcmp(argv[i], "--max") == 0) {
+        maxN = numberArgument(argc, argv, ++i, "maximum length");
+      } else
+      if (strcmp(argv[i], "--top") == 0) {
+        top = numberArgument(argc, argv, ++i, "number of sequences");
+      } else
+      if (strcmp(argv[i], "--version") == 0) {
+        version(argv[0]);
+        exit(0);
+      } else
+      if (strcmp(argv[i], "--help") == 0) {
+        help(argv[0]);
+        exit(0);
+      } else {
+        error("unrecognized option '%s'; try '%s --help'",
+              argv[i], argv[0]);
+      }
+    } else {
+      /* file */
+      fileNames[numFiles++] = argv[i];
+    }
+  }
+  if (minN > maxN || maxN > MAX_N) {
+    error("invalid lengths %d to %d", minN, maxN);
+  }
+  if (numFiles == 0) {
+    error("no assembler file");
+  }
+  for (i = 0; i < numFiles; i++) {
+    readAsmFile(fileNames[i]);
+  }
+  showNgrams(top);
+  return 0;
+}
@@ -0,0 +1,336 @@
+/*
+ * gc.c -- generational garbage collector
+ *
+ * New objects are allocated in the nursery by bumping a pointer.
+ * When it is full, a minor collection copies the objects reachable
+ * from the roots (stack, globals, return value) and from the
+ * remembered set into the old space, Cheney style: the copied objects
+ * are scanned in the order they were copied, which copies the young
+ * objects they refer to. Everything else in the nursery, e.g. most of
+ * the boxed Integers and Booleans, is garbage and costs nothing.
+ *
+ * The remembered set holds the old objects which got a reference to
+ * a young one (see WRITE_BARRIER), so that a minor collection need
+ * not look at the whole old space.
+ *
+ * When the old space cannot take the nursery, it is collected with a
+ * mark-compact collection first: the reachable objects are marked,
+ * then each gets the address it slides down to, the references are
+ * changed to these addresses and finally the objects are moved. The
+ * objects in the nursery are taken as reachable, the minor collection
+ * which follows sorts them out. Objects too large for the nursery go
+ * to the old space directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "njvm.h"
+#include "gc.h"
+
+
+#define ALIGN		8
+#define OBJECT_BYTES(size) \
+  ((offsetof(Object, fields) + (size) * sizeof(Slot) + ALIGN - 1) \
+   / ALIGN * ALIGN)
+
+char *nurseryStart;
+char *nurseryEnd;
+static char *nurseryTop;
+static unsigned long nurserySize;
+
+static char *oldStart;
+static char *oldEnd;
+static char *oldTop;
+
+static ObjRef *remembered;
+static int numRemembered;
+static int maxRemembered;
+
+static ObjRef *markStack;
+static int markTop;
+static int maxMarkStack;
+
+static unsigned long numMinor;
+static unsigned long numMajor;
+static unsigned long numObjects;
+static unsigned long bytesAllocated;
+static unsigned long bytesPromoted;
+
+
+void initHeap(unsigned long nurseryKB, unsigned long heapKB) {
+  nurserySize = nurseryKB * 1024;
+  nurseryStart = (char *) malloc(nurserySize);
+  oldStart = (char *) malloc(heapKB * 1024);
+  if (nurseryStart == NULL || oldStart == NULL) {
+    error("cannot allocate heap");
+  }
+  nurseryEnd = nurseryStart + nurserySize;
+  nurseryTop = nurseryStart;
+  oldEnd = oldStart + heapKB * 1024;
+  oldTop = oldStart;
+}
+
+
+/**************************************************************/
+
+
+/* an old object which refers to a young one, see WRITE_BARRIER */
+void rememberObject(ObjRef object) {
+  if (numRemembered == maxRemembered) {
+    maxRemembered = maxRemembered == 0 ? 256 : 2 * maxRemembered;
+    remembered = (ObjRef *) realloc(remembered,
+                                    maxRemembered * sizeof(ObjRef));
+    if (remembered == NULL) {
+      error("cannot allocate remembered set");
+    }
+  }
+  object->flags |= OBJ_REMEMBERED;
+  remembered[numRemembered++] = object;
+}
+
+
+/* the copy of a young object in the old space */
+static ObjRef promote(ObjRef object) {
+  ObjRef copy;
+  unsigned long bytes;
+
+  if (object->flags & OBJ_FORWARDED) {
+    return object->forward;
+  }
+  bytes = OBJECT_BYTES(object->size);
+  /* there is room, see collectGarbage */
+  copy = (ObjRef) oldTop;
+  oldTop += bytes;
+  memcpy(copy, object, bytes);
+  copy->flags = OBJ_OLD;
+  object->flags |= OBJ_FORWARDED;
+  object->forward = copy;
+  bytesPromoted += bytes;
+  return copy;
+}
+
+
+static void promoteSlot(Slot *slot) {
+  if (slot->isRef && IS_YOUNG(slot->u.ref)) {
+    slot->u.ref = promote(slot->u.ref);
+  }
+}
+
+
+static void promoteFields(ObjRef object) {
+  int i;
+
+  for (i = 0; i < object->size; i++) {
+    promoteSlot(&object->fields[i]);
+  }
+}
+
+
+static void minorCollection(void) {
+  char *scan;
+  ObjRef object;
+  int i;
+
+  numMinor++;
+  scan = oldTop;
+  for (i = 0; i < sp; i++) {
+    promoteSlot(&stack[i]);
+  }
+  for (i = 0; i < numGlobals; i++) {
+    promoteSlot(&globals[i]);
+  }
+  promoteSlot(&returnValue);
+  for (i = 0; i < numRemembered; i++) {
+    remembered[i]->flags &= ~OBJ_REMEMBERED;
+    promoteFields(remembered[i]);
+  }
+  numRemembered = 0;
+  /* the promoted objects may refer to other young ones */
+  while (scan < oldTop) {
+    object = (ObjRef) scan;
+    promoteFields(object);
+    scan += OBJECT_BYTES(object->size);
+  }
+  nurseryTop = nurseryStart;
+}
+
+
+/**************************************************************/
+
+
+static void markSlot(Slot *slot) {
+  ObjRef object;
+
+  if (!slot->isRef || slot->u.ref == NULL || IS_YOUNG(slot->u.ref)) {
+    return;
+  }
+  object = slot->u.ref;
+  if (object->flags & OBJ_MARKED) {
+    return;
+  }
+  object->flags |= OBJ_MARKED;
+  if (markTop == maxMarkStack) {
+    maxMarkStack = maxMarkStack == 0 ? 1024 : 2 * maxMarkStack;
+    markStack = (ObjRef *) realloc(markStack, maxMarkStack * sizeof(ObjRef));
+    if (markStack == NULL) {
+      error("cannot allocate mark stack");
+    }
+  }
+  markStack[markTop++] = object;
+}
+
+
+static void updateSlot(Slot *slot) {
+  if (slot->isRef && slot->u.ref != NULL && !IS_YOUNG(slot->u.ref)) {
+    slot->u.ref = slot->u.ref->forward;
+  }
+}
+
+
+/* the roots of a major collection, including the young objects */
+static void forEachRoot(void (*visit)(Slot *slot)) {
+  char *p;
+  ObjRef object;
+  int i;
+
+  for (i = 0; i < sp; i++) {
+    (*visit)(&stack[i]);
+  }
+  for (i = 0; i < numGlobals; i++) {
+    (*visit)(&globals[i]);
+  }
+  (*visit)(&returnValue);
+  for (p = nurseryStart; p < nurseryTop; p += OBJECT_BYTES(object->size)) {
+    object = (ObjRef) p;
+    for (i = 0; i < object->size; i++) {
+      (*visit)(&object->fields[i]);
+    }
+  }
+}
+
+
+static void majorCollection(void) {
+  char *p;
+  char *free;
+  ObjRef object;
+  unsigned long bytes;
+  int i, n;
+
+  numMajor++;
+  /* mark */
+  markTop = 0;
+  forEachRoot(markSlot);
+  while (markTop > 0) {
+    object = markStack[--markTop];
+    for (i = 0; i < object->size; i++) {
+      markSlot(&object->fields[i]);
+    }
+  }
+  /* compute the new addresses */
+  free = oldStart;
+  for (p = oldStart; p < oldTop; p += bytes) {
+    object = (ObjRef) p;
+    bytes = OBJECT_BYTES(object->size);
+    if (object->flags & OBJ_MARKED) {
+      object->forward = (ObjRef) free;
+      free += bytes;
+    }
+  }
+  /* update the references */
+  forEachRoot(updateSlot);
+  for (p = oldStart; p < oldTop; p += bytes) {
+    object = (ObjRef) p;
+    bytes = OBJECT_BYTES(object->size);
+    if (object->flags & OBJ_MARKED) {
+      for (i = 0; i < object->size; i++) {
+        updateSlot(&object->fields[i]);
+      }
+    }
+  }
+  n = 0;
+  for (i = 0; i < numRemembered; i++) {
+    if (remembered[i]->flags & OBJ_MARKED) {
+      remembered[n++] = remembered[i]->forward;
+    }
+  }
+  numRemembered = n;
+  /* move, nothing ahead of an object is overwritten */
+  for (p = oldStart; p < oldTop; p += bytes) {
+    object = (ObjRef) p;
+    bytes = OBJECT_BYTES(object->size);
+    if (object->flags & OBJ_MARKED) {
+      object->flags &= ~OBJ_MARKED;
+      memmove(object->forward, object, bytes);
+    }
+  }
+  oldTop = free;
+}
+
+
+/* make room for the nursery and 'bytes' more in the old space */
+static void collectGarbage(unsigned long bytes) {
+  bytes += nurseryTop - nurseryStart;
+  if ((unsigned long) (oldEnd - oldTop) < bytes) {
+    majorCollection();
+    if ((unsigned long) (oldEnd - oldTop) < bytes) {
+      error("heap overflow");
+    }
+  }
+  minorCollection();
+}
+
+
+/**************************************************************/
+
+
+ObjRef newObject(unsigned int class, int size) {
+  ObjRef object;
+  unsigned long bytes;
+  int i;
+
+  if (size < 0) {
+    error("negative size %d of new object", size);
+  }
+  bytes = OBJECT_BYTES(size);
+  if (bytes > nurserySize / 4) {
+    /* large objects would only be copied around */
+    if ((unsigned long) (oldEnd - oldTop) < bytes) {
+      collectGarbage(bytes);
+    }
+    object = (ObjRef) oldTop;
+    oldTop += bytes;
+    object->flags = OBJ_OLD;
+  } else {
+    if ((unsigned long) (nurseryEnd - nurseryTop) < bytes) {
+      collectGarbage(0);
+    }
+    object = (ObjRef) nurseryTop;
+    nurseryTop += bytes;
+    object->flags = 0;
+  }
+  object->class = class;
+  object->size = size;
+  for (i = 0; i < size; i++) {
+    object->fields[i].isRef = TRUE;
+    object->fields[i].u.ref = NULL;
+  }
+  numObjects++;
+  bytesAllocated += bytes;
+  return object;
+}
+
+
+void showGcStats(FILE *file) {
+  fprintf(file, "Garbage collector:\n");
+  fprintf(file, "  %-28s %lu\n", "objects allocated", numObjects);
+  fprintf(file, "  %-28s %lu KB\n", "bytes allocated",
+          bytesAllocated / 1024);
+  fprintf(file, "  %-28s %lu KB\n", "bytes promoted", bytesPromoted / 1024);
+  fprintf(file, "  %-28s %lu\n", "minor collections", numMinor);
+  fprintf(file, "  %-28s %lu\n", "major collections", numMajor);
+  fprintf(file, "  %-28s %lu KB\n", "old space in use",
+          (unsigned long) (oldTop - oldStart) / 1024);
+}
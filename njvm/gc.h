@@ -0,0 +1,38 @@
+/*
+ * gc.h -- generational garbage collector
+ */
+
+#ifndef _GC_H_
+#define _GC_H_
+
+
+#define OBJ_OLD		0x01	/* lives in the old space */
+#define OBJ_REMEMBERED	0x02	/* in the remembered set */
+#define OBJ_FORWARDED	0x04	/* copied by a minor collection */
+#define OBJ_MARKED	0x08	/* reached by a major collection */
+
+#define DEFAULT_NURSERY	1024		/* KB */
+#define DEFAULT_HEAP	(64 * 1024)	/* KB */
+
+extern char *nurseryStart;
+extern char *nurseryEnd;
+
+#define IS_YOUNG(r)	((char *) (r) >= nurseryStart && \
+			 (char *) (r) < nurseryEnd)
+
+/* an old object which gets a reference to a young one is remembered */
+#define WRITE_BARRIER(object, value) \
+  do { \
+    if (((object)->flags & (OBJ_OLD | OBJ_REMEMBERED)) == OBJ_OLD \
+        && (value).isRef && IS_YOUNG((value).u.ref)) { \
+      rememberObject(object); \
+    } \
+  } while (0)
+
+void initHeap(unsigned long nurseryKB, unsigned long heapKB);
+ObjRef newObject(unsigned int class, int size);
+void rememberObject(ObjRef object);
+void showGcStats(FILE *file);
+
+
+#endif /* _GC_H_ */
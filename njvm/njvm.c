@@ -0,0 +1,965 @@
+/*
+ * njvm.c -- Ninja Virtual Machine
+ *
+ * Executes the binary programs written by njc --emit-bin (see 'instrs'
+ * and ../binary.c). Every word of the program is one instruction with
+ * the opcode in the upper 8 bits and a 24 bit immediate; 'new', 'newa'
+ * and 'instof' are followed by the address of a class. A class is a
+ * word with the address of its superclass (nil: 0xFFFFFFFF), followed
+ * by its virtual method table, so 'vmcall n,i' calls the method whose
+ * address is at word i of the class of the receiver.
+ *
+ * The program is decoded once into the address of the code which
+ * executes each instruction (direct threaded code), every instruction
+ * jumps to the next one by itself. Compilers without computed goto
+ * get a switch instead. The superinstructions (njc --superinstr) do
+ * the work of the sequences they replace in a single dispatch.
+ *
+ * Every vmcall has an inline cache of the targets for the last few
+ * classes of its receivers, which saves the lookup in the VMT. A site
+ * which sees more classes than fit in is megamorphic and looks up
+ * every call.
+ *
+ * The objects live in the heap of the garbage collector (see gc.c),
+ * its roots are the stack, the globals and the return value register.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "njvm.h"
+#include "gc.h"
+
+#define VERSION		1
+
+#define HALT		0
+#define PUSHC		1
+#define ADD		2
+#define SUB		3
+#define MUL		4
+#define DIV		5
+#define MOD		6
+#define RDINT		7
+#define WRINT		8
+#define ASF		9
+#define RSF		10
+#define PUSHL		11
+#define POPL		12
+#define EQ		13
+#define NE		14
+#define LT		15
+#define LE		16
+#define GT		17
+#define GE		18
+#define JMP		19
+#define BRF		20
+#define BRT		21
+#define CALL		22
+#define RET		23
+#define DROP		24
+#define PUSHR		25
+#define POPR		26
+#define DUP		27
+#define NEW		28
+#define GETF		29
+#define PUTF		30
+#define NEWA		31
+#define GETLA		32
+#define GETFA		33
+#define PUTFA		34
+#define PUSHN		35
+#define REFEQ		36
+#define REFNE		37
+#define VMCALL		38
+#define PUSHG		39
+#define POPG		40
+#define INSTOF		41
+#define UNBOXL		42
+#define BOX		43
+#define DROPR		44
+#define UNBOXBRF	45
+#define LEAVE		46
+#define NUM_OPCODES	47
+
+#define IMMEDIATE(x)	((x) & 0x00FFFFFF)
+#define SIGN_EXTEND(i)	((i) & 0x00800000 ? (i) | 0xFF000000 : (i))
+
+#define NIL_CLASS	0xFFFFFFFF
+
+#define DEFAULT_STACK	(64 * 1024)	/* slots */
+
+#define IC_ENTRIES	4		/* classes per inline cache */
+
+#if defined(__GNUC__) && !defined(NJVM_SWITCH)
+#define THREADED
+#endif
+
+
+/* the inline cache of a vmcall */
+typedef struct {
+  int numEntries;		/* IC_ENTRIES + 1: megamorphic */
+  unsigned int classes[IC_ENTRIES];
+  int targets[IC_ENTRIES];
+  unsigned long hits;
+  unsigned long misses;
+} InlineCache;
+
+
+static unsigned int *code;	/* program memory */
+static int codeSize;		/* size in instructions */
+
+Slot *stack;
+static int stackSize;
+int sp;				/* first free slot */
+static int fp;
+
+Slot *globals;
+int numGlobals;
+
+Slot returnValue;
+
+static InlineCache **caches;	/* of the vmcall at an address, or NULL */
+
+
+void error(char *fmt, ...) {
+  va_list ap;
+
+  va_start(ap, fmt);
+  fprintf(stderr, "Error: ");
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+  exit(1);
+}
+
+
+static void loadCode(char *codeFileName) {
+  FILE *codeFile;
+  long size;
+
+  codeFile = fopen(codeFileName, "rb");
+  if (codeFile == NULL) {
+    error("cannot open code file '%s'", codeFileName);
+  }
+  fseek(codeFile, 0, SEEK_END);
+  size = ftell(codeFile);
+  fseek(codeFile, 0, SEEK_SET);
+  codeSize = size / sizeof(unsigned int);
+  if (codeSize == 0) {
+    error("code file '%s' is empty", codeFileName);
+  }
+  /* one more word, an illegal instruction behind the end of the code */
+  code = (unsigned int *) malloc((codeSize + 1) * sizeof(unsigned int));
+  if (code == NULL) {
+    error("cannot allocate program memory");
+  }
+  if (fread(code, sizeof(unsigned int), codeSize, codeFile)
+      != (size_t) codeSize) {
+    error("cannot read code file '%s'", codeFileName);
+  }
+  code[codeSize] = (unsigned int) NUM_OPCODES << 24;
+  fclose(codeFile);
+}
+
+
+/* the globals are the class objects, pushg and popg tell how many */
+static void allocateGlobals(void) {
+  unsigned int opcode;
+  int i;
+
+  numGlobals = 0;
+  for (i = 0; i < codeSize; i++) {
+    opcode = code[i] >> 24;
+    if ((opcode == PUSHG || opcode == POPG)
+        && (int) IMMEDIATE(code[i]) >= numGlobals) {
+      numGlobals = IMMEDIATE(code[i]) + 1;
+    }
+  }
+  globals = (Slot *) malloc((numGlobals + 1) * sizeof(Slot));
+  if (globals == NULL) {
+    error("cannot allocate global variables");
+  }
+  for (i = 0; i < numGlobals; i++) {
+    globals[i].isRef = TRUE;
+    globals[i].u.ref = NULL;
+  }
+}
+
+
+static void allocateInlineCaches(void) {
+  InlineCache *cache;
+  int i;
+
+  caches = (InlineCache **) malloc(codeSize * sizeof(InlineCache *));
+  if (caches == NULL) {
+    error("cannot allocate inline caches");
+  }
+  for (i = 0; i < codeSize; i++) {
+    caches[i] = NULL;
+    if ((code[i] >> 24) != VMCALL) {
+      continue;
+    }
+    cache = (InlineCache *) malloc(sizeof(InlineCache));
+    if (cache == NULL) {
+      error("cannot allocate inline caches");
+    }
+    cache->numEntries = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    caches[i] = cache;
+  }
+}
+
+
+static void allocateStack(void) {
+  stack = (Slot *) malloc(stackSize * sizeof(Slot));
+  if (stack == NULL) {
+    error("cannot allocate stack");
+  }
+  sp = 0;
+  fp = 0;
+}
+
+
+/**************************************************************/
+
+
+static int typeError(char *expected, int pc) {
+  error("%s expected at address 0x%08X", expected, pc);
+  return 0;
+}
+
+
+static int stackUnderflow(int pc) {
+  error("stack underflow at address 0x%08X", pc);
+  return 0;
+}
+
+
+static boolean isInstanceOf(ObjRef object, unsigned int class) {
+  unsigned int c;
+
+  if (object == NULL) {
+    return FALSE;
+  }
+  for (c = object->class; c != NIL_CLASS; c = code[c]) {
+    if (c == class) {
+      return TRUE;
+    }
+    if (c >= (unsigned int) codeSize) {
+      error("invalid class address 0x%08X", c);
+    }
+  }
+  return FALSE;
+}
+
+
+/* the method at word 'vmti' of the class */
+static int lookupVMT(unsigned int class, int vmti, int pc) {
+  int target;
+
+  if (class + vmti >= (unsigned int) codeSize) {
+    error("invalid class address 0x%08X at address 0x%08X", class, pc);
+  }
+  target = code[class + vmti];
+  if ((unsigned int) target >= (unsigned int) codeSize) {
+    error("call of invalid address 0x%08X at address 0x%08X", target, pc);
+  }
+  return target;
+}
+
+
+/* the target of a vmcall for receivers of class 'class' */
+static int lookupInlineCache(InlineCache *cache, unsigned int class,
+                             int vmti, int pc) {
+  int target;
+  int i;
+
+  if (cache->numEntries > IC_ENTRIES) {
+    /* megamorphic, the cache is not searched any more */
+    cache->misses++;
+    return lookupVMT(class, vmti, pc);
+  }
+  for (i = 0; i < cache->numEntries; i++) {
+    if (cache->classes[i] == class) {
+      cache->hits++;
+      return cache->targets[i];
+    }
+  }
+  cache->misses++;
+  target = lookupVMT(class, vmti, pc);
+  if (cache->numEntries < IC_ENTRIES) {
+    cache->classes[cache->numEntries] = class;
+    cache->targets[cache->numEntries] = target;
+    cache->numEntries++;
+  } else {
+    cache->numEntries = IC_ENTRIES + 1;
+  }
+  return target;
+}
+
+
+static void showInlineCaches(FILE *file) {
+  InlineCache *cache;
+  unsigned long hits;
+  unsigned long misses;
+  int i;
+
+  hits = 0;
+  misses = 0;
+  fprintf(file, "Inline caches (address, state, classes, hits, misses):\n");
+  for (i = 0; i < codeSize; i++) {
+    cache = caches[i];
+    if (cache == NULL || cache->numEntries == 0) {
+      continue;
+    }
+    fprintf(file, "  0x%08X  %-12s %2d %10lu %10lu\n", i,
+            cache->numEntries == 1 ? "monomorphic" :
+            cache->numEntries <= IC_ENTRIES ? "polymorphic" : "megamorphic",
+            cache->numEntries <= IC_ENTRIES ? cache->numEntries : IC_ENTRIES,
+            cache->hits, cache->misses);
+    hits += cache->hits;
+    misses += cache->misses;
+  }
+  fprintf(file, "  %-28s %10lu %10lu\n", "total", hits, misses);
+}
+
+
+/**************************************************************/
+
+
+#define PUSH_NUMBER(n) \
+  do { \
+    if (sp == stackSize) { \
+      error("stack overflow"); \
+    } \
+    stack[sp].isRef = FALSE; \
+    stack[sp].u.number = (n); \
+    sp++; \
+  } while (0)
+
+#define PUSH_REF(r) \
+  do { \
+    if (sp == stackSize) { \
+      error("stack overflow"); \
+    } \
+    stack[sp].isRef = TRUE; \
+    stack[sp].u.ref = (r); \
+    sp++; \
+  } while (0)
+
+#define PUSH_SLOT(s) \
+  do { \
+    if (sp == stackSize) { \
+      error("stack overflow"); \
+    } \
+    stack[sp++] = (s); \
+  } while (0)
+
+/* the compiler may be wrong, a number is never taken for a reference */
+#define CHECK_UNDERFLOW()	(sp == 0 ? stackUnderflow(pc) : 0)
+#define POP_NUMBER() \
+  (CHECK_UNDERFLOW(), \
+   stack[--sp].isRef ? typeError("number", pc) : stack[sp].u.number)
+#define POP_REF() \
+  (CHECK_UNDERFLOW(), \
+   stack[--sp].isRef ? stack[sp].u.ref : (typeError("reference", pc), NULL))
+#define POP_SLOT()	(CHECK_UNDERFLOW(), stack[--sp])
+
+/* locals and arguments are below the top of the stack */
+#define CHECK_LOCAL(i) \
+  do { \
+    if (fp + (i) < 0 || fp + (i) >= sp) { \
+      error("local %d outside of the stack at address 0x%08X", (i), pc); \
+    } \
+  } while (0)
+
+#define CHECK_DROP(n) \
+  do { \
+    if ((n) < 0 || (n) > sp) { \
+      error("drop of %d slots at address 0x%08X", (n), pc); \
+    } \
+  } while (0)
+
+#define CHECK_GLOBAL(i) \
+  do { \
+    if ((i) >= numGlobals) { \
+      error("global %d of %d at address 0x%08X", (i), numGlobals, pc); \
+    } \
+  } while (0)
+
+#define CHECK_NOT_NIL(r) \
+  do { \
+    if ((r) == NULL) { \
+      error("nil reference at address 0x%08X", pc); \
+    } \
+  } while (0)
+
+#define CHECK_FIELD(r, i) \
+  do { \
+    if ((i) < 0 || (i) >= (r)->size) { \
+      error("field %d of object with %d fields at address 0x%08X", \
+            (i), (r)->size, pc); \
+    } \
+  } while (0)
+
+#define CHECK_TARGET(t) \
+  do { \
+    if ((unsigned int) (t) >= (unsigned int) codeSize) { \
+      error("jump to invalid address 0x%08X at address 0x%08X", (t), pc); \
+    } \
+  } while (0)
+
+
+#ifdef THREADED
+#define OPCODE(op)	op_##op:
+#define DISPATCH()	goto *handlers[pc]
+#else
+#define OPCODE(op)	case op:
+#define DISPATCH()	goto dispatch
+#endif
+
+
+static void execute(void) {
+  int pc;
+  int immediate;
+  int a, b;
+  ObjRef object;
+  Slot value;
+  unsigned int class;
+#ifdef THREADED
+  static void *opcodeHandlers[NUM_OPCODES] = {
+    &&op_HALT, &&op_PUSHC, &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV,
+    &&op_MOD, &&op_RDINT, &&op_WRINT, &&op_ASF, &&op_RSF, &&op_PUSHL,
+    &&op_POPL, &&op_EQ, &&op_NE, &&op_LT, &&op_LE, &&op_GT, &&op_GE,
+    &&op_JMP, &&op_BRF, &&op_BRT, &&op_CALL, &&op_RET, &&op_DROP,
+    &&op_PUSHR, &&op_POPR, &&op_DUP, &&op_NEW, &&op_GETF, &&op_PUTF,
+    &&op_NEWA, &&op_GETLA, &&op_GETFA, &&op_PUTFA, &&op_PUSHN,
+    &&op_REFEQ, &&op_REFNE, &&op_VMCALL, &&op_PUSHG, &&op_POPG,
+    &&op_INSTOF, &&op_UNBOXL, &&op_BOX, &&op_DROPR, &&op_UNBOXBRF,
+    &&op_LEAVE,
+  };
+  void **handlers;
+  unsigned int opcode;
+  int i;
+
+  /* decode: the address of the code of every instruction */
+  handlers = (void **) malloc((codeSize + 1) * sizeof(void *));
+  if (handlers == NULL) {
+    error("cannot allocate threaded code");
+  }
+  for (i = 0; i <= codeSize; i++) {
+    opcode = code[i] >> 24;
+    /* data words (class addresses, VMTs) are never executed */
+    handlers[i] = opcode < NUM_OPCODES ? opcodeHandlers[opcode] : &&illegal;
+  }
+#endif
+
+  pc = 0;
+#ifdef THREADED
+  DISPATCH();
+#else
+dispatch:
+  switch (code[pc] >> 24) {
+#endif
+
+  OPCODE(HALT)
+#ifdef THREADED
+    free(handlers);
+#endif
+    return;
+
+  OPCODE(PUSHC)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    PUSH_NUMBER(immediate);
+    pc++;
+    DISPATCH();
+
+  OPCODE(ADD)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    PUSH_NUMBER(a + b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(SUB)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    PUSH_NUMBER(a - b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(MUL)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    PUSH_NUMBER(a * b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(DIV)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    if (b == 0) {
+      error("division by zero at address 0x%08X", pc);
+    }
+    PUSH_NUMBER(a / b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(MOD)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    if (b == 0) {
+      error("division by zero at address 0x%08X", pc);
+    }
+    PUSH_NUMBER(a % b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(RDINT)
+    if (scanf("%d", &a) != 1) {
+      error("cannot read integer");
+    }
+    PUSH_NUMBER(a);
+    pc++;
+    DISPATCH();
+
+  OPCODE(WRINT)
+    a = POP_NUMBER();
+    printf("%d", a);
+    pc++;
+    DISPATCH();
+
+  OPCODE(ASF)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    if (immediate < 0 || sp + 1 + immediate > stackSize) {
+      error("stack overflow");
+    }
+    PUSH_NUMBER(fp);
+    fp = sp;
+    /* the garbage collector must not see stale references */
+    for (a = 0; a < immediate; a++) {
+      stack[sp].isRef = TRUE;
+      stack[sp].u.ref = NULL;
+      sp++;
+    }
+    pc++;
+    DISPATCH();
+
+  OPCODE(RSF)
+    sp = fp;
+    fp = POP_NUMBER();
+    pc++;
+    DISPATCH();
+
+  OPCODE(PUSHL)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    CHECK_LOCAL(immediate);
+    PUSH_SLOT(stack[fp + immediate]);
+    pc++;
+    DISPATCH();
+
+  OPCODE(POPL)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    value = POP_SLOT();
+    CHECK_LOCAL(immediate);
+    stack[fp + immediate] = value;
+    pc++;
+    DISPATCH();
+
+  OPCODE(EQ)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    PUSH_NUMBER(a == b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(NE)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    PUSH_NUMBER(a != b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(LT)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    PUSH_NUMBER(a < b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(LE)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    PUSH_NUMBER(a <= b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(GT)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    PUSH_NUMBER(a > b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(GE)
+    b = POP_NUMBER();
+    a = POP_NUMBER();
+    PUSH_NUMBER(a >= b);
+    pc++;
+    DISPATCH();
+
+  OPCODE(JMP)
+    immediate = IMMEDIATE(code[pc]);
+    CHECK_TARGET(immediate);
+    pc = immediate;
+    DISPATCH();
+
+  OPCODE(BRF)
+    immediate = IMMEDIATE(code[pc]);
+    if (POP_NUMBER() == 0) {
+      CHECK_TARGET(immediate);
+      pc = immediate;
+    } else {
+      pc++;
+    }
+    DISPATCH();
+
+  OPCODE(BRT)
+    immediate = IMMEDIATE(code[pc]);
+    if (POP_NUMBER() != 0) {
+      CHECK_TARGET(immediate);
+      pc = immediate;
+    } else {
+      pc++;
+    }
+    DISPATCH();
+
+  OPCODE(CALL)
+    immediate = IMMEDIATE(code[pc]);
+    CHECK_TARGET(immediate);
+    PUSH_NUMBER(pc + 1);
+    pc = immediate;
+    DISPATCH();
+
+  OPCODE(RET)
+    immediate = POP_NUMBER();
+    CHECK_TARGET(immediate);
+    pc = immediate;
+    DISPATCH();
+
+  OPCODE(DROP)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    CHECK_DROP(immediate);
+    sp -= immediate;
+    pc++;
+    DISPATCH();
+
+  OPCODE(PUSHR)
+    PUSH_SLOT(returnValue);
+    pc++;
+    DISPATCH();
+
+  OPCODE(POPR)
+    returnValue = POP_SLOT();
+    pc++;
+    DISPATCH();
+
+  OPCODE(DUP)
+    value = stack[sp - 1];
+    PUSH_SLOT(value);
+    pc++;
+    DISPATCH();
+
+  OPCODE(NEW)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    object = newObject(code[pc + 1], immediate);
+    PUSH_REF(object);
+    pc += 2;
+    DISPATCH();
+
+  OPCODE(GETF)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    object = POP_REF();
+    CHECK_NOT_NIL(object);
+    CHECK_FIELD(object, immediate);
+    PUSH_SLOT(object->fields[immediate]);
+    pc++;
+    DISPATCH();
+
+  OPCODE(PUTF)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    value = POP_SLOT();
+    object = POP_REF();
+    CHECK_NOT_NIL(object);
+    CHECK_FIELD(object, immediate);
+    WRITE_BARRIER(object, value);
+    object->fields[immediate] = value;
+    pc++;
+    DISPATCH();
+
+  OPCODE(NEWA)
+    a = POP_NUMBER();
+    object = newObject(code[pc + 1], a);
+    PUSH_REF(object);
+    pc += 2;
+    DISPATCH();
+
+  OPCODE(GETLA)
+    object = POP_REF();
+    CHECK_NOT_NIL(object);
+    PUSH_NUMBER(object->size);
+    pc++;
+    DISPATCH();
+
+  OPCODE(GETFA)
+    a = POP_NUMBER();
+    object = POP_REF();
+    CHECK_NOT_NIL(object);
+    CHECK_FIELD(object, a);
+    PUSH_SLOT(object->fields[a]);
+    pc++;
+    DISPATCH();
+
+  OPCODE(PUTFA)
+    value = POP_SLOT();
+    a = POP_NUMBER();
+    object = POP_REF();
+    CHECK_NOT_NIL(object);
+    CHECK_FIELD(object, a);
+    WRITE_BARRIER(object, value);
+    object->fields[a] = value;
+    pc++;
+    DISPATCH();
+
+  OPCODE(PUSHN)
+    PUSH_REF(NULL);
+    pc++;
+    DISPATCH();
+
+  OPCODE(REFEQ)
+    object = POP_REF();
+    a = POP_REF() == object;
+    PUSH_NUMBER(a);
+    pc++;
+    DISPATCH();
+
+  OPCODE(REFNE)
+    object = POP_REF();
+    a = POP_REF() != object;
+    PUSH_NUMBER(a);
+    pc++;
+    DISPATCH();
+
+  OPCODE(VMCALL)
+    /* the receiver is below the other arguments */
+    a = (IMMEDIATE(code[pc]) >> 16) & 0xFF;
+    b = IMMEDIATE(code[pc]) & 0xFFFF;
+    if (!stack[sp - a].isRef) {
+      typeError("reference", pc);
+    }
+    object = stack[sp - a].u.ref;
+    CHECK_NOT_NIL(object);
+    immediate = lookupInlineCache(caches[pc], object->class, b, pc);
+    PUSH_NUMBER(pc + 1);
+    pc = immediate;
+    DISPATCH();
+
+  OPCODE(PUSHG)
+    immediate = IMMEDIATE(code[pc]);
+    CHECK_GLOBAL(immediate);
+    PUSH_SLOT(globals[immediate]);
+    pc++;
+    DISPATCH();
+
+  OPCODE(POPG)
+    immediate = IMMEDIATE(code[pc]);
+    CHECK_GLOBAL(immediate);
+    globals[immediate] = POP_SLOT();
+    pc++;
+    DISPATCH();
+
+  OPCODE(INSTOF)
+    class = code[pc + 1];
+    object = POP_REF();
+    PUSH_NUMBER(isInstanceOf(object, class));
+    pc += 2;
+    DISPATCH();
+
+  /* superinstructions */
+
+  OPCODE(UNBOXL)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    CHECK_LOCAL(immediate);
+    if (!stack[fp + immediate].isRef) {
+      typeError("reference", pc);
+    }
+    object = stack[fp + immediate].u.ref;
+    CHECK_NOT_NIL(object);
+    CHECK_FIELD(object, 1);
+    PUSH_SLOT(object->fields[1]);
+    pc++;
+    DISPATCH();
+
+  OPCODE(BOX)
+    /* the value stays on the stack while the box is allocated */
+    object = newObject(code[pc + 1], 2);
+    object->fields[1] = POP_SLOT();
+    PUSH_REF(object);
+    pc += 2;
+    DISPATCH();
+
+  OPCODE(DROPR)
+    immediate = SIGN_EXTEND(IMMEDIATE(code[pc]));
+    CHECK_DROP(immediate);
+    sp -= immediate;
+    PUSH_SLOT(returnValue);
+    pc++;
+    DISPATCH();
+
+  OPCODE(UNBOXBRF)
+    immediate = IMMEDIATE(code[pc]);
+    object = POP_REF();
+    CHECK_NOT_NIL(object);
+    CHECK_FIELD(object, 1);
+    if (object->fields[1].isRef) {
+      typeError("number", pc);
+    }
+    if (object->fields[1].u.number == 0) {
+      CHECK_TARGET(immediate);
+      pc = immediate;
+    } else {
+      pc++;
+    }
+    DISPATCH();
+
+  OPCODE(LEAVE)
+    sp = fp;
+    fp = POP_NUMBER();
+    immediate = POP_NUMBER();
+    CHECK_TARGET(immediate);
+    pc = immediate;
+    DISPATCH();
+
+#ifdef THREADED
+illegal:
+#else
+  default:
+#endif
+    if (pc == codeSize) {
+      error("no halt at the end of the code");
+    }
+    error("illegal instruction 0x%08X at address 0x%08X", code[pc], pc);
+#ifndef THREADED
+  }
+#endif
+}
+
+
+/**************************************************************/
+
+
+static void version(char *myself) {
+  /* show version and compilation date */
+  printf("%s version %d (compiled %s, %s)\n",
+         myself, VERSION, __DATE__, __TIME__);
+}
+
+
+static void help(char *myself) {
+  /* show some help how to use the program */
+  printf("Usage: %s [options] <code file>\n", myself);
+  printf("Executes a program written by njc --emit-bin.\n");
+  printf("Options:\n");
+  printf("  --stack <n>         stack size in slots (default %d)\n",
+         DEFAULT_STACK);
+  printf("  --nursery <KB>      size of the nursery (default %d)\n",
+         DEFAULT_NURSERY);
+  printf("  --heap <KB>         size of the old space (default %d)\n",
+         DEFAULT_HEAP);
+  printf("  --gcstats           show statistics of the garbage collector\n");
+  printf("  --ic-stats          show the inline caches of the vmcalls\n");
+  printf("  --version           show version and exit\n");
+  printf("  --help              show this help and exit\n");
+}
+
+
+int main(int argc, char *argv[]) {
+  int i;
+  char *codeFileName;
+  int nurseryKB;
+  int heapKB;
+  boolean gcStats;
+  boolean icStats;
+
+  codeFileName = NULL;
+  stackSize = DEFAULT_STACK;
+  nurseryKB = DEFAULT_NURSERY;
+  heapKB = DEFAULT_HEAP;
+  gcStats = FALSE;
+  icStats = FALSE;
+  for (i = 1; i < argc; i++) {
+    if (argv[i][0] == '-') {
+      /* option */
+      if (strcmp(argv[i], "--stack") == 0) {
+        if (++i == argc || atoi(argv[i]) < 1) {
+          error("stack size missing or invalid");
+        }
+        stackSize = atoi(argv[i]);
+      } else
+      if (strcmp(argv[i], "--nursery") == 0) {
+        if (++i == argc || atoi(argv[i]) < 1) {
+          error("nursery size missing or invalid");
+        }
+        nurseryKB = atoi(argv[i]);
+      } else
+      if (strcmp(argv[i], "--heap") == 0) {
+        if (++i == argc || atoi(argv[i]) < 1) {
+          error("heap size missing or invalid");
+        }
+        heapKB = atoi(argv[i]);
+      } else
+      if (strcmp(argv[i], "--gcstats") == 0) {
+        gcStats = TRUE;
+      } else
+      if (strcmp(argv[i], "--ic-stats") == 0) {
+        icStats = TRUE;
+      } else
+      if (strcmp(argv[i], "--version") == 0) {
+        version(argv[0]);
+        exit(0);
+      } else
+      if (strcmp(argv[i], "--help") == 0) {
+        help(argv[0]);
+        exit(0);
+      } else {
+        error("unrecognized option '%s'; try '%s --help'",
+              argv[i], argv[0]);
+      }
+    } else {
+      /* file */
+      if (codeFileName != NULL) {
+        error("more than one code file");
+      }
+      codeFileName = argv[i];
+    }
+  }
+  if (codeFileName == NULL) {
+    error("no code file");
+  }
+  loadCode(codeFileName);
+  allocateGlobals();
+  allocateInlineCaches();
+  allocateStack();
+  initHeap(nurseryKB, heapKB);
+  execute();
+  if (gcStats) {
+    showGcStats(stderr);
+  }
+  if (icStats) {
+    showInlineCaches(stderr);
+  }
+  return 0;
+}
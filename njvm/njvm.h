@@ -0,0 +1,50 @@
+/*
+ * njvm.h -- Ninja Virtual Machine
+ */
+
+#ifndef _NJVM_H_
+#define _NJVM_H_
+
+
+typedef int boolean;
+
+#define FALSE		0
+#define TRUE		1
+
+
+/*
+ * A slot of the stack, of an object or a global variable holds
+ * either a number or a reference (the return addresses and frame
+ * pointers on the stack are numbers).
+ */
+typedef struct object *ObjRef;
+
+typedef struct {
+  boolean isRef;
+  union {
+    int number;
+    ObjRef ref;
+  } u;
+} Slot;
+
+/* an object or an array, which is an object with a field per element */
+typedef struct object {
+  unsigned int class;		/* address of its class, see njvm.c */
+  int size;			/* number of fields */
+  unsigned int flags;		/* OBJ_..., see gc.c */
+  struct object *forward;	/* new address while collecting */
+  Slot fields[1];
+} Object;
+
+
+/* the roots of the garbage collector */
+extern Slot *stack;
+extern int sp;
+extern Slot *globals;
+extern int numGlobals;
+extern Slot returnValue;
+
+void error(char *fmt, ...);
+
+
+#endif /* _NJVM_H_ */
@@ -0,0 +1,166 @@
+/*
+ * parallel.c -- parallel execution of independent tasks
+ *
+ * A phase which works on independent pieces (e.g. one source file
+ * each) hands them to runParallel(), which starts up to numJobs
+ * threads (see --jobs) that take the next task until none is left.
+ * Every thread allocates from a worker arena of its own (see utils.c).
+ * With a single job or a single task, everything runs on the calling
+ * thread, exactly as before.
+ *
+ * An error in a task does not end the compiler at once: the task
+ * is abandoned, and when all threads are done, the error of the
+ * first failing task is reported. This is the error a sequential
+ * run would have reported, no matter how the threads were scheduled.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "utils.h"
+#include "parallel.h"
+
+
+#define MAX_WORKERS	64
+
+
+typedef struct {
+    int numTasks;
+    int nextTask;
+    int failedTask;		/* first task with an error, or numTasks */
+    char *message;		/* its error message */
+    void (*task)(int index, void *data);
+    void *data;
+    pthread_mutex_t mutex;
+} TaskQueue;
+
+/* where error() leaves a task on a worker thread */
+typedef struct {
+    jmp_buf env;
+    char *message;
+} ErrorTrap;
+
+static pthread_key_t errorTrapKey;
+static pthread_once_t errorTrapOnce = PTHREAD_ONCE_INIT;
+
+/* the hook of the calling thread, e.g. of the server (see server.c) */
+static ErrorHook callerHook;
+
+
+/* number of threads to use for a number of tasks */
+static int numWorkers(int numTasks) {
+    long n;
+
+    n = numJobs;
+    if (n <= 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (n > MAX_WORKERS) {
+        n = MAX_WORKERS;
+    }
+    if (n > numTasks) {
+        n = numTasks;
+    }
+    return n < 1 ? 1 : (int) n;
+}
+
+
+static void createErrorTrapKey(void) {
+    if (pthread_key_create(&errorTrapKey, NULL) != 0) {
+        error("cannot create error traps");
+    }
+}
+
+
+static void trapError(char *message) {
+    ErrorTrap *trap;
+
+    trap = (ErrorTrap *) pthread_getspecific(errorTrapKey);
+    if (trap != NULL) {
+        trap->message = message;
+        longjmp(trap->env, 1);
+    }
+    if (callerHook != NULL) {
+        (*callerHook)(message);
+    }
+}
+
+
+static void *worker(void *arg) {
+    TaskQueue *queue = (TaskQueue *) arg;
+    ErrorTrap trap;
+    int index;
+
+    pthread_setspecific(errorTrapKey, &trap);
+    enterWorkerArena();
+    while (1) {
+        pthread_mutex_lock(&queue->mutex);
+        index = queue->nextTask++;
+        if (index > queue->failedTask) {
+            /* a sequential run would not get here */
+            index = queue->numTasks;
+        }
+        pthread_mutex_unlock(&queue->mutex);
+        if (index >= queue->numTasks) {
+            break;
+        }
+        if (setjmp(trap.env) == 0) {
+            (*queue->task)(index, queue->data);
+        } else {
+            pthread_mutex_lock(&queue->mutex);
+            if (index < queue->failedTask) {
+                queue->failedTask = index;
+                queue->message = trap.message;
+            }
+            pthread_mutex_unlock(&queue->mutex);
+        }
+    }
+    leaveWorkerArena();
+    pthread_setspecific(errorTrapKey, NULL);
+    return NULL;
+}
+
+
+void runParallel(int numTasks, void (*task)(int index, void *data), void *data) {
+    TaskQueue queue;
+    pthread_t threads[MAX_WORKERS];
+    int n, i;
+
+    n = numWorkers(numTasks);
+    if (n == 1) {
+        for (i = 0; i < numTasks; i++) {
+            (*task)(i, data);
+        }
+        return;
+    }
+    queue.numTasks = numTasks;
+    queue.nextTask = 0;
+    queue.failedTask = numTasks;
+    queue.message = NULL;
+    queue.task = task;
+    queue.data = data;
+    pthread_mutex_init(&queue.mutex, NULL);
+    pthread_once(&errorTrapOnce, createErrorTrapKey);
+    initWorkerArenas();
+    callerHook = setErrorHook(trapError);
+    for (i = 0; i < n; i++) {
+        if (pthread_create(&threads[i], NULL, worker, &queue) != 0) {
+            error("cannot create worker thread");
+        }
+    }
+    for (i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    setErrorHook(callerHook);
+    pthread_mutex_destroy(&queue.mutex);
+    if (queue.failedTask < numTasks) {
+        error("%s", queue.message);
+    }
+}
@@ -0,0 +1,10 @@
+/*
+ * parallel.h -- parallel execution of independent tasks
+ */
+
+#ifndef PARALLEL_H
+#define	PARALLEL_H
+
+void runParallel(int numTasks, void (*task)(int index, void *data), void *data);
+
+#endif	/* PARALLEL_H */
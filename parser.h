@@ -7,11 +7,8 @@
 #define _PARSER_H_
 
 
-extern Absyn *fileTree;
-
-
-int yyparse(void);
-void yyerror(char *msg);
+void parseFiles(int numFiles, char *fileNames[], Absyn *fileTrees[]);
+void yyerror(yyscan_t scanner, Absyn **fileTree, char *msg);
 
 
 #endif /* _PARSER_H_ */
@@ -15,13 +15,16 @@
 #include "absyn.h"
 #include "scanner.h"
 #include "parser.h"
-
-Absyn *fileTree;
-int arrayDims = 1;
+#include "parallel.h"
+#include "timer.h"
 
 
 %}
 
+%define api.pure full
+%lex-param		{yyscan_t scanner}
+%parse-param		{yyscan_t scanner} {Absyn **fileTree}
+
 %union {
   NoVal noVal;
   IntVal intVal;
@@ -29,6 +32,10 @@ int arrayDims = 1;
   Absyn *node;
 }
 
+%code {
+int yylex(YYSTYPE *lvalp, yyscan_t scanner);
+}
+
 %token	<noVal>		BREAK CASTTO CLASS DO ELSE EXTENDS
 %token	<noVal>		IF INSTANCEOF LOCAL NEW NIL PUBLIC ASM
 %token	<noVal>		RETURN SELF STATIC SUPER VOID WHILE
@@ -53,7 +60,7 @@ int arrayDims = 1;
 %type	<node>		method_dec
 %type	<node>		void
 %type	<node>		type
-%type	<node>		more_dims
+%type	<intVal>	more_dims
 %type	<node>		par_dec_list
 %type	<node>		non_empty_par_dec_list
 %type	<node>		par_dec
@@ -96,7 +103,7 @@ int arrayDims = 1;
 
 source_file		: class_dec_list
 			  {
-			    fileTree = newFile("<dummy>", 0, $1);
+			    *fileTree = newFile("<dummy>", 0, $1);
 			  }
 			;
 
@@ -241,18 +248,17 @@ type			: IDENT
 			| IDENT LBRACK RBRACK more_dims
 			  {                            
 			    $$ = newArrayTy($2.file, $2.line,
-                                             newSym($1.val), arrayDims);
-                            arrayDims = 1; /* reset array dimension counter */
+			                    newSym($1.val), $4.val + 1);
 			  }
 			;
 
 more_dims		: /* empty */
 			  {
-			    $$ = NULL;
+			    $$.val = 0;
 			  }
 			| LBRACK RBRACK more_dims
 			  {
-                            arrayDims++;
+			    $$.val = $3.val + 1;
 			  }
 			;
 
@@ -458,7 +464,7 @@ non_empty_asm_instrlist : asm_instr
 
 asm_instr               : IDENT
                           {
-                            $$ = newAsmInstr0($1.file, $1.line, $1.val)
+                            $$ = newAsmInstr0($1.file, $1.line, $1.val);
                           }
                         | NEW INTLIT
                           {
@@ -719,19 +725,18 @@ primary_exp		: NIL
 			  }
 			| NEW new_obj_spec
 			  {			    
-                            $$ = $2
+                            $$ = $2;
 			  }
 			;
 
 new_obj_spec		: IDENT LPAREN arg_list RPAREN
 			  {
-			    $$ = newNewExp($1.file, $1.line, newSym($1.val), $3)
+			    $$ = newNewExp($1.file, $1.line, newSym($1.val), $3);
 			  }
 			| IDENT LBRACK exp RBRACK more_dims
 			  {
                             $$ = newNewArrayExp($2.file, $2.line,
-                                    newSym($1.val), $3, arrayDims);
-                            arrayDims = 1; /* reset array dimension counter */
+                                    newSym($1.val), $3, $5.val + 1);
 			  }
 			;
 
@@ -756,6 +761,49 @@ var			: IDENT
 %%
 
 
-void yyerror(char *msg) {
-  error("%s in line %d", msg, yylval.noVal.line);
+void yyerror(yyscan_t scanner, Absyn **fileTree, char *msg) {
+  int line;
+
+  line = tokenLine(scanner);
+  /* error() does not return, a server goes on (see server.c) */
+  freeScanner(scanner);
+  error("%s in line %d", msg, line);
+}
+
+
+typedef struct {
+  char **fileNames;
+  Absyn **fileTrees;
+} ParseJob;
+
+
+static void parseFile(int i, void *data) {
+  ParseJob *job = (ParseJob *) data;
+  yyscan_t scanner;
+  Absyn *fileTree;
+
+  scanner = newScanner(job->fileNames[i]);
+  if (scanner == NULL) {
+    error("cannot open input file '%s'", job->fileNames[i]);
+  }
+  yyparse(scanner, &fileTree);
+  freeScanner(scanner);
+  /* Set file name in Absyn Tree */
+  fileTree->file = job->fileNames[i];
+  job->fileTrees[i] = fileTree;
+}
+
+
+/*
+ * The files are independent of each other, so they are parsed
+ * in parallel, each one with a scanner and a parser of its own.
+ */
+void parseFiles(int numFiles, char *fileNames[], Absyn *fileTrees[]) {
+  ParseJob job;
+
+  job.fileNames = fileNames;
+  job.fileTrees = fileTrees;
+  startPass(PASS_PARSE);
+  runParallel(numFiles, parseFile, &job);
+  endPass(PASS_PARSE);
 }
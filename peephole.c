@@ -0,0 +1,258 @@
+/*
+ * peephole.c -- peephole optimizer
+ *
+ * The optimizer looks at a small window of the buffered instructions
+ * of a method and replaces redundant sequences by shorter ones. All
+ * patterns are applied repeatedly until none of them matches anymore.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "utils.h"
+#include "instr.h"
+#include "peephole.h"
+
+
+#define PATTERN_STORE_LOAD	0
+#define PATTERN_DEAD_STORE	1
+#define PATTERN_PUSH_DROP	2
+#define PATTERN_DROP_ZERO	3
+#define PATTERN_JUMP_TO_NEXT	4
+#define PATTERN_BOX_UNBOX	5
+#define NUM_PATTERNS		6
+
+
+static char *patternNames[NUM_PATTERNS] = {
+    "popl n; pushl n",
+    "popl n (never read)",
+    "push; drop",
+    "drop 0",
+    "jmp to next label",
+    "new; ...; putf 1; getf 1",
+};
+
+/* methods are optimized by several threads at once */
+static int patternHits[NUM_PATTERNS];
+static pthread_mutex_t hitsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void hit(int pattern) {
+    pthread_mutex_lock(&hitsMutex);
+    patternHits[pattern]++;
+    pthread_mutex_unlock(&hitsMutex);
+}
+
+
+/* number of instructions which read local variable n */
+static int countLoads(InstrBuffer *buffer, int n) {
+    int count;
+    int i;
+
+    count = 0;
+    for (i = 0; i < buffer->numInstrs; i++) {
+        if (buffer->instrs[i].opcode == OP_PUSHL
+                && buffer->instrs[i].immediate == n) {
+            count++;
+        }
+    }
+    return count;
+}
+
+
+/* popl n; pushl n => nothing, if the local is not read elsewhere */
+static boolean matchStoreLoad(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+
+    if (i + 1 >= buffer->numInstrs
+            || p[0].opcode != OP_POPL || p[0].immediate < 0
+            || p[1].opcode != OP_PUSHL || p[1].immediate != p[0].immediate
+            || countLoads(buffer, p[0].immediate) != 1) {
+        return FALSE;
+    }
+    p[0].opcode = OP_DELETED;
+    p[1].opcode = OP_DELETED;
+    hit(PATTERN_STORE_LOAD);
+    return TRUE;
+}
+
+
+/* popl n => drop 1, if the local is never read */
+static boolean matchDeadStore(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+
+    if (p->opcode != OP_POPL || p->immediate < 0
+            || countLoads(buffer, p->immediate) != 0) {
+        return FALSE;
+    }
+    p->opcode = OP_DROP;
+    p->immediate = 1;
+    hit(PATTERN_DEAD_STORE);
+    return TRUE;
+}
+
+
+/* pushc/pushl/pushg/pushn/dup; drop n => drop n-1 */
+static boolean matchPushDrop(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+
+    if (i + 1 >= buffer->numInstrs
+            || !(p[0].opcode == OP_PUSHC || p[0].opcode == OP_PUSHL
+                || p[0].opcode == OP_PUSHG || p[0].opcode == OP_PUSHN
+                || p[0].opcode == OP_DUP)
+            || p[1].opcode != OP_DROP || p[1].immediate < 1) {
+        return FALSE;
+    }
+    p[0].opcode = OP_DELETED;
+    if (--p[1].immediate == 0) {
+        p[1].opcode = OP_DELETED;
+    }
+    hit(PATTERN_PUSH_DROP);
+    return TRUE;
+}
+
+
+/* drop 0 => nothing */
+static boolean matchDropZero(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+
+    if (p->opcode != OP_DROP || p->immediate != 0) {
+        return FALSE;
+    }
+    p->opcode = OP_DELETED;
+    hit(PATTERN_DROP_ZERO);
+    return TRUE;
+}
+
+
+/* jmp L; (labels) L: => (labels) L: */
+static boolean matchJumpToNext(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+    int j;
+
+    if (p->opcode != OP_JMP) {
+        return FALSE;
+    }
+    for (j = i + 1;
+            j < buffer->numInstrs && buffer->instrs[j].opcode == OP_LABEL;
+            j++) {
+        if (strcmp(buffer->instrs[j].label, p->label) == 0) {
+            p->opcode = OP_DELETED;
+            hit(PATTERN_JUMP_TO_NEXT);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+/*
+ * number of values an instruction pops (*in) and pushes (*out),
+ * FALSE if it does anything else than calculating a value
+ */
+boolean isPureValueInstr(Instr *p, int *in, int *out) {
+    switch (p->opcode) {
+        case OP_PUSHC:
+        case OP_PUSHL:
+        case OP_PUSHG:
+        case OP_PUSHN:
+            *in = 0;
+            *out = 1;
+            return TRUE;
+        case OP_GETF:
+            *in = 1;
+            *out = 1;
+            return TRUE;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_EQ:
+        case OP_NE:
+        case OP_LT:
+        case OP_LE:
+        case OP_GT:
+        case OP_GE:
+            *in = 2;
+            *out = 1;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+
+/*
+ * new 2; .addr C; dup; <value>; putf 1; getf 1 => <value>
+ * the box is only created to be unboxed immediately
+ */
+static boolean matchBoxUnbox(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+    int depth, in, out;
+    int j;
+
+    if (i + 2 >= buffer->numInstrs
+            || p[0].opcode != OP_NEW || p[0].immediate != 2
+            || p[1].opcode != OP_ADDR
+            || p[2].opcode != OP_DUP) {
+        return FALSE;
+    }
+    depth = 0;
+    for (j = i + 3; j + 1 < buffer->numInstrs; j++) {
+        if (depth == 1
+                && buffer->instrs[j].opcode == OP_PUTF
+                && buffer->instrs[j].immediate == 1
+                && buffer->instrs[j + 1].opcode == OP_GETF
+                && buffer->instrs[j + 1].immediate == 1) {
+            p[0].opcode = OP_DELETED;
+            p[1].opcode = OP_DELETED;
+            p[2].opcode = OP_DELETED;
+            buffer->instrs[j].opcode = OP_DELETED;
+            buffer->instrs[j + 1].opcode = OP_DELETED;
+            hit(PATTERN_BOX_UNBOX);
+            return TRUE;
+        }
+        if (!isPureValueInstr(&buffer->instrs[j], &in, &out) || in > depth) {
+            /* the value must not depend on the box */
+            return FALSE;
+        }
+        depth += out - in;
+    }
+    return FALSE;
+}
+
+
+void optimizeInstrs(InstrBuffer *buffer) {
+    boolean changed;
+    int i;
+
+    do {
+        changed = FALSE;
+        for (i = 0; i < buffer->numInstrs; i++) {
+            if (matchStoreLoad(buffer, i)
+                    || matchDeadStore(buffer, i)
+                    || matchPushDrop(buffer, i)
+                    || matchDropZero(buffer, i)
+                    || matchJumpToNext(buffer, i)
+                    || matchBoxUnbox(buffer, i)) {
+                changed = TRUE;
+                removeDeletedInstrs(buffer);
+            }
+        }
+    } while (changed);
+}
+
+
+void showPeepholeStats(FILE *file) {
+    int i;
+
+    fprintf(file, "Peephole optimizer:\n");
+    for (i = 0; i < NUM_PATTERNS; i++) {
+        fprintf(file, "  %-28s %d\n", patternNames[i], patternHits[i]);
+    }
+}
@@ -0,0 +1,12 @@
+/*
+ * peephole.h -- peephole optimizer
+ */
+
+#ifndef PEEPHOLE_H
+#define	PEEPHOLE_H
+
+boolean isPureValueInstr(Instr *p, int *in, int *out);
+void optimizeInstrs(InstrBuffer *buffer);
+void showPeepholeStats(FILE *file);
+
+#endif	/* PEEPHOLE_H */
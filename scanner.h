@@ -25,9 +25,18 @@ typedef struct {
 } StringVal;
 
 
-boolean yyInit(char *srcFileName);
-int yylex(void);
-void showToken(int token);
+/* same as in the scanner generated by flex */
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+
+yyscan_t newScanner(char *srcFileName);
+void freeScanner(yyscan_t scanner);
+int tokenLine(yyscan_t scanner);
+void showTokens(yyscan_t scanner);
+void scanTokens(yyscan_t scanner);
 
 
 #endif /* _SCANNER_H_ */
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "common.h"
 #include "utils.h"
 #include "sym.h"
@@ -9,6 +10,13 @@
 #include "instance.h"
 #include "table.h"
 #include "absyn.h"
+#include "fold.h"
+#include "wellknown.h"
+#include "parallel.h"
+#include "instr.h"
+#include "library.h"
+#include "codegen.h"
+#include "timer.h"
 
 /*
  * Semantic Analysis
@@ -34,20 +42,74 @@
  */
 
 
-/* i had to do this ugly hack because we have no possibility to save the actual
- * function like the actual class. This is not because we are too lazy to implement
- * a new parameter but because we have no 'Type Method' */
-Entry *actMethod;
+/*
+ * The method bodies are checked in parallel (see checkMethodBodies),
+ * so the state of a method being checked lives in a MethodCheck that
+ * belongs to the thread checking it.
+ */
+typedef struct {
+    Absyn *node;		/* the method declaration */
+    Table **fileTable;
+    Class *actClass;
+    Table *classTable;
+    /* i had to do this ugly hack because we have no possibility to save the actual
+     * function like the actual class. This is not because we are too lazy to implement
+     * a new parameter but because we have no 'Type Method' */
+    Entry *actMethod;
+} MethodCheck;
+
+static MethodCheck *methodChecks;
+static int numMethodChecks;
+static int maxMethodChecks;
+static pthread_key_t methodCheckKey;
+static pthread_once_t methodCheckOnce = PTHREAD_ONCE_INIT;
 /* same with localOffset */
 int localOffset;
 /* same with paramOffset */
 int paramOffset;
 /* global index for meta classes */
 int globalIndex = 0;
-/* index of current classes static vars */
-int currStaticVarIndex;
-/* index of current classes instance vars */
-int currInstanceVarIndex;
+/* remember the classes each input file refers to, see useClass */
+boolean collectClassRefs = FALSE;
+static Table **checkedFileTables;
+static Table **classRefTables;
+static pthread_mutex_t classRefMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static MethodCheck *currentCheck(void) {
+    return (MethodCheck *) pthread_getspecific(methodCheckKey);
+}
+
+
+/*
+ * The build cache (see cache.c) rebuilds a file when the interface
+ * of a class it refers to changes. The method bodies are checked in
+ * parallel, so the sets of referenced classes are locked.
+ */
+static void useClass(Table **fileTable, Class *class) {
+    Table *refTable;
+
+    if (!collectClassRefs) {
+        return;
+    }
+    refTable = classRefTables[fileTable - checkedFileTables];
+    pthread_mutex_lock(&classRefMutex);
+    if (lookup(refTable, class->name, ENTRY_KIND_CLASS) == NULL) {
+        enter(refTable, class->name, newClassEntry(class));
+    }
+    pthread_mutex_unlock(&classRefMutex);
+}
+
+
+static Entry *findClass(Table **fileTable, Table *globalTable, Sym *name) {
+    Entry *classEntry;
+
+    classEntry = lookupClass(fileTable, globalTable, name);
+    if (classEntry != NULL) {
+        useClass(fileTable, classEntry->u.classEntry.class);
+    }
+    return classEntry;
+}
 
 
 static void checkNode(
@@ -607,6 +669,31 @@ static void traverseTable(Class *class, char *filename, VMT *vmt) {
 }
 
 
+/* pass 3 only collects the method bodies, see checkMethodBodies */
+static void addMethodCheck(Absyn *node, Table **fileTable,
+        Class *actClass, Table *classTable) {
+    MethodCheck *newChecks;
+    MethodCheck *check;
+
+    if (numMethodChecks == maxMethodChecks) {
+        maxMethodChecks = maxMethodChecks == 0 ? 64 : 2 * maxMethodChecks;
+        newChecks = (MethodCheck *)
+                allocate(maxMethodChecks * sizeof(MethodCheck));
+        if (numMethodChecks > 0) {
+            memcpy(newChecks, methodChecks,
+                    numMethodChecks * sizeof(MethodCheck));
+            release(methodChecks);
+        }
+        methodChecks = newChecks;
+    }
+    check = &methodChecks[numMethodChecks++];
+    check->node = node;
+    check->fileTable = fileTable;
+    check->actClass = actClass;
+    check->classTable = classTable;
+    check->actMethod = NULL;
+}
+
 static void makeVMT(Class *class, char *fileName) {
     VMT *vmt;
 
@@ -701,9 +788,9 @@ static void checkClassDec(
             break;
         case 1:
             /* Lookup current class entry, should never be NULL */
-            classEntry = lookupClass(fileTable, globalTable, node->u.classDec.name);
+            classEntry = findClass(fileTable, globalTable, node->u.classDec.name);
             /* Lookup meta class entry, should never be NULL */
-            metaClassEntry = lookupClass(fileTable, globalTable, metaClassName(node->u.classDec.name));
+            metaClassEntry = findClass(fileTable, globalTable, metaClassName(node->u.classDec.name));
 
             /* special case if class is Object */
             if ( strcmp(classEntry->u.classEntry.class->name->string, "Object") == 0 ) {
@@ -717,9 +804,9 @@ static void checkClassDec(
 
             } else {
                 /* Lookup entry of the supposed superclass */
-                superClassEntry = lookupClass(fileTable, globalTable, node->u.classDec.superClass);
+                superClassEntry = findClass(fileTable, globalTable, node->u.classDec.superClass);
                 /* Lookup entry of the supposed superclass of meta class */
-                metaSuperClassEntry = lookupClass(fileTable, globalTable, metaClassName(node->u.classDec.superClass));
+                metaSuperClassEntry = findClass(fileTable, globalTable, metaClassName(node->u.classDec.superClass));
 
                 /* Did we find the superclass? */
                 if(superClassEntry == NULL) {
@@ -756,12 +843,10 @@ static void checkClassDec(
             break;
         case 2:
             /* Lookup current class entry */
-            classEntry = lookupClass(fileTable, globalTable, node->u.classDec.name);
+            classEntry = findClass(fileTable, globalTable, node->u.classDec.name);
             memberList = node->u.classDec.members;
             /* If memberlist isn't empty */
             if (!memberList->u.mbrList.isEmpty) {
-                currInstanceVarIndex = 0;
-                currStaticVarIndex = 0;
                 for(memberDec = memberList->u.mbrList.head;
                         memberList->u.mbrList.isEmpty == FALSE;
                         memberList = memberList->u.mbrList.tail,
@@ -776,7 +861,7 @@ static void checkClassDec(
             break;
         case 3:
             /* Lookup current class entry */
-            classEntry = lookupClass(fileTable, globalTable, node->u.classDec.name);
+            classEntry = findClass(fileTable, globalTable, node->u.classDec.name);
             memberList = node->u.classDec.members;
             /* If memberlist isn't empty */
             if (!memberList->u.mbrList.isEmpty) {
@@ -785,10 +870,17 @@ static void checkClassDec(
                         memberList = memberList->u.mbrList.tail,
                         memberDec = memberList->u.mbrList.head) {
                     /* Members can be methods or fields */
-                    checkNode(memberDec, fileTable, localTable,
-                            classEntry->u.classEntry.class,             /* Actual class */
-                            classEntry->u.classEntry.class->mbrTable,   /* Member table */
-                            globalTable, breakAllowed, returnType, pass);
+                    if (memberDec->type == ABSYN_METHODDEC) {
+                        /* the bodies are checked later, in parallel */
+                        addMethodCheck(memberDec, fileTable,
+                                classEntry->u.classEntry.class,
+                                classEntry->u.classEntry.class->mbrTable);
+                    } else {
+                        checkNode(memberDec, fileTable, localTable,
+                                classEntry->u.classEntry.class,             /* Actual class */
+                                classEntry->u.classEntry.class->mbrTable,   /* Member table */
+                                globalTable, breakAllowed, returnType, pass);
+                    }
                 }
             }
             break;
@@ -797,7 +889,7 @@ static void checkClassDec(
             /* here will be the creation of the virtual method table */
             /* here will be the evaluation of the instance variable offsets */
             /* Lookup current class entry */
-            classEntry = lookupClass(fileTable, globalTable, node->u.classDec.name);
+            classEntry = findClass(fileTable, globalTable, node->u.classDec.name);
 
             makeVMT(classEntry->u.classEntry.class, node->file);
             makeInstanceVariableOffsets(classEntry->u.classEntry.class, node->file);
@@ -955,8 +1047,15 @@ static void checkMethodDec(
 
             /* Do we have params? */
             if(!paramList->u.parList.isEmpty) {
-                /* set the offset for the params to -3 */
-                paramOffset = -3;
+                /*
+                 * the arguments are pushed in order, the last one
+                 * ends up at -3, right below the return address
+                 */
+                paramOffset = -2;
+                for(paramDec = paramList; !paramDec->u.parList.isEmpty;
+                        paramDec = paramDec->u.parList.tail) {
+                    paramOffset--;
+                }
                 /* Loop over all params in the list */
                 for(numParams = 0, paramDec = paramList->u.parList.head;
                         paramList->u.parList.isEmpty == FALSE;
@@ -1031,7 +1130,7 @@ static void checkMethodDec(
             methodEntry = lookupMember(actClass, node->u.methodDec.name, ENTRY_KIND_METHOD);
 
             /* save a pointer of actual method */
-            actMethod = methodEntry;
+            currentCheck()->actMethod = methodEntry;
 
             /* Does the method already exist in the super class? */
             superClassMethodEntry = lookupMember(actClass->superClass, node->u.methodDec.name, ENTRY_KIND_METHOD);
@@ -1162,7 +1261,7 @@ static void checkParamDec(
             /* Create new variable entry (a param is a local variable after all) */
             variableEntry = newVariableEntry(TRUE, FALSE, FALSE, variableType);
             variableEntry->u.variableEntry.offset = paramOffset;
-            paramOffset--;
+            paramOffset++;
             /* Add the entry to the localTable */
             if(NULL == enter(localTable, node->u.parDec.name, variableEntry)) {
                 /* Multiple definitions of variables are not allowed  */
@@ -1234,7 +1333,7 @@ static void checkSimpleTy(
         int pass) {
 
     Sym *name = node->u.simpleTy.name;
-    Entry *typeEntry = lookupClass(fileTable, globalTable, name);
+    Entry *typeEntry = findClass(fileTable, globalTable, name);
     Type *typeType;
 
     if(typeEntry == NULL) {
@@ -1404,7 +1503,7 @@ static void checkAssignStm(
                         node->line);
             }
 
-            if (actMethod->u.methodEntry.isStatic) {
+            if (currentCheck()->actMethod->u.methodEntry.isStatic) {
                 switch(lhs->type) {
                     case ABSYN_SIMPLEVAR:
                         var = lookup(classTable, lhs->u.simpleVar.name, ENTRY_KIND_VARIABLE);
@@ -1438,8 +1537,8 @@ static void checkAssignStm(
                 }
             }
 
-            free(lhs_t);
-            free(rhs_t);
+            release(lhs_t);
+            release(rhs_t);
             /* ToDo */
             break;
         default:
@@ -1516,7 +1615,7 @@ static void checkSimpleVar(
         /* if it is no local and no member variable
          * check if is a class */
         if ( varEntry == NULL ) {
-            varEntry = lookupClass(fileTable, globalTable, node->u.simpleVar.name);
+            varEntry = findClass(fileTable, globalTable, node->u.simpleVar.name);
 
             /* if it is still not found
              * then it really is not defined at */
@@ -1557,8 +1656,7 @@ static void checkArrayVar(
     Absyn *var = varExp->u.varExp.var;
     int dims;
 
-    Entry *integerEntry = lookupClass(fileTable, globalTable, newSym("Integer"));
-    Type *integerType = newSimpleType(integerEntry->u.classEntry.class);
+    Type *integerType = wellKnown.integerType;
 
 
     checkNode(index, fileTable,localTable, actClass, classTable,
@@ -1594,9 +1692,8 @@ static void checkArrayVar(
         }
     }
     *returnType = *newSimpleType(varEntry->u.variableEntry.type->u.arrayType.base);
-    free(integerType);
-    free(indexType);
-    free(varType);
+    release(indexType);
+    release(varType);
 }
 
 
@@ -1655,7 +1752,7 @@ static void checkMemberVar(
                     node->file,
                     node->line);
         }
-        free(actClassType);
+        release(actClassType);
     }
 
     if ( objectType->kind == TYPE_KIND_ARRAY ) {
@@ -1673,8 +1770,6 @@ static void checkMemberVar(
                     node->file,
                     node->line);
         }
-        varEntry->u.variableEntry.offset = currStaticVarIndex;
-        currStaticVarIndex++;
     } else {
         /* if field is not static 
          * then the objectType must be a non-static type */
@@ -1685,15 +1780,11 @@ static void checkMemberVar(
                 node->file,
                 node->line);
         }
-        
-        varEntry->u.variableEntry.offset = currInstanceVarIndex;
-        currInstanceVarIndex++;
-
     }    
 
     *returnType = *(varEntry->u.variableEntry.type);
 
-    free(objectType);
+    release(objectType);
 }
 
 
@@ -1725,7 +1816,7 @@ static void checkIfStm1(
     checkNode(thenPart, fileTable,localTable, actClass, classTable,
             globalTable, breakAllowed, returnType, pass);
 
-    free(testType);
+    release(testType);
 }
 
 
@@ -1760,7 +1851,7 @@ static void checkIfStm2(
     checkNode(elsePart, fileTable,localTable, actClass, classTable,
             globalTable, breakAllowed, returnType, pass);
 
-    free(testType);
+    release(testType);
 }
 
 
@@ -1791,7 +1882,7 @@ static void checkWhileStm(
     checkNode(body, fileTable,localTable, actClass, classTable,
             globalTable, breakAllowed, returnType, pass);
 
-    free(testType);
+    release(testType);
 }
 
 
@@ -1822,7 +1913,7 @@ static void checkDoStm(
     checkNode(body, fileTable,localTable, actClass, classTable,
             globalTable, breakAllowed, returnType, pass);
 
-    free(testType);
+    release(testType);
 }
 
 
@@ -1855,7 +1946,7 @@ static void checkRetStm(
         Type *returnType,
         int pass){
 
-    if (actMethod->u.methodEntry.retType->kind != TYPE_KIND_VOID) {
+    if (currentCheck()->actMethod->u.methodEntry.retType->kind != TYPE_KIND_VOID) {
         error("return statement must return a value in '%s' on line %d",
                 node->file,
                 node->line);
@@ -1874,14 +1965,14 @@ static void checkRetExpStm(
         Type *returnType,
         int pass){
 
-    Type *actMethodRetType = actMethod->u.methodEntry.retType;
+    Type *actMethodRetType = currentCheck()->actMethod->u.methodEntry.retType;
     Type *retExpStmRetType = allocate(sizeof(Type));
 
     checkNode(node->u.retExpStm.exp, fileTable,localTable, actClass, classTable,
             globalTable, breakAllowed, retExpStmRetType, pass);
 
     
-    if (actMethod->u.methodEntry.retType->kind == TYPE_KIND_VOID) {
+    if (currentCheck()->actMethod->u.methodEntry.retType->kind == TYPE_KIND_VOID) {
         error("return statement must not return a value in '%s' on line %d",
                 node->file,
                 node->line);
@@ -1896,7 +1987,7 @@ static void checkRetExpStm(
                 node->line);
     }
 
-    free(retExpStmRetType);
+    release(retExpStmRetType);
 }
 
 
@@ -1937,7 +2028,7 @@ static void checkCallStm(
                 node->line);
     }
 
-    if ( actMethod->u.methodEntry.isStatic ) {
+    if ( currentCheck()->actMethod->u.methodEntry.isStatic ) {
         if ( rcvrNode->type == ABSYN_SELFEXP ) {
             error("the current receiver 'self' is not available in '%s' on line %d",
                 node->file,
@@ -2005,7 +2096,7 @@ static void checkCallStm(
          * then the method cannot be called */
         if ( rcvrNode->type == ABSYN_VAREXP ) {
             if (rcvrNode->u.varExp.var->type == ABSYN_SIMPLEVAR) {
-                tmpEntry = lookupClass(fileTable,
+                tmpEntry = findClass(fileTable,
                         globalTable,
                         rcvrNode->u.varExp.var->u.simpleVar.name);
 
@@ -2028,7 +2119,7 @@ static void checkCallStm(
          * then the method cannot be called */
         if ( rcvrNode->type == ABSYN_VAREXP ) {
             if (rcvrNode->u.varExp.var->type == ABSYN_SIMPLEVAR) {
-                tmpEntry = lookupClass(fileTable,
+                tmpEntry = findClass(fileTable,
                         globalTable,
                         rcvrNode->u.varExp.var->u.simpleVar.name);
 
@@ -2093,7 +2184,7 @@ static void checkCallStm(
     
     /* NEVER EVER RELEASE THIS HERE */
     /* --> free(rcvrType); <-- */
-    free(argType);
+    release(argType);
 }
 
 
@@ -2108,12 +2199,9 @@ static void checkBinOpExp(
         Type *returnType,
         int pass) {
 
-    Entry *booleanEntry = lookupClass(fileTable, globalTable, newSym("Boolean"));
-    Type *booleanType = newSimpleType(booleanEntry->u.classEntry.class);
-    Entry *integerEntry = lookupClass(fileTable, globalTable, newSym("Integer"));
-    Type *integerType = newSimpleType(integerEntry->u.classEntry.class);
-    Entry *characterEntry = lookupClass(fileTable, globalTable, newSym("Character"));
-    Type *characterType = newSimpleType(characterEntry->u.classEntry.class);
+    Type *booleanType = wellKnown.booleanType;
+    Type *integerType = wellKnown.integerType;
+    Type *characterType = wellKnown.characterType;
 
     int op = node->u.binopExp.op;
     Absyn *left  = node->u.binopExp.left;
@@ -2165,6 +2253,10 @@ static void checkBinOpExp(
 
             *returnType = *booleanType;
             *tmpType = *booleanType;
+            if (optimizationLevel >= 1 && foldBinop(node, tmpType)) {
+                break;
+            }
+            node->u.binopExp.expType = tmpType;
 
             break;
         case ABSYN_BINOP_EQ:
@@ -2220,10 +2312,22 @@ static void checkBinOpExp(
             
             *returnType = *booleanType;
             *tmpType = *booleanType;
-            
+            if (optimizationLevel >= 1 && foldBinop(node, tmpType)) {
+                break;
+            }
+
+            /* with optimization Integer comparisons stay binop nodes
+             * and codegen compares inline instead of calling Integer */
+            if (optimizationLevel >= 1
+                    && leftType->u.simpleType.class == integerType->u.simpleType.class
+                    && rightType->u.simpleType.class == integerType->u.simpleType.class) {
+                node->u.binopExp.expType = tmpType;
+                break;
+            }
+
             switch(op) {
                 case ABSYN_BINOP_EQ:
-                    methodName = newSym("equals");                    
+                    methodName = wellKnown.equalsSym;
                     *node = *newCallExp(
                         node->file, node->line, methodName, 
                         left, newExpList(right, emptyExpList())
@@ -2231,7 +2335,7 @@ static void checkBinOpExp(
                     node->u.callExp.rcvrClass = leftType->u.simpleType.class;
                     break;                
                 case ABSYN_BINOP_NE:
-                    methodName = newSym("equals");
+                    methodName = wellKnown.equalsSym;
                     temp = newCallExp(
                         node->file, node->line, 
                         methodName, left, 
@@ -2245,7 +2349,7 @@ static void checkBinOpExp(
                     node->u.unopExp.expType = tmpType;
                     break;          
                 case ABSYN_BINOP_LT:
-                    methodName = newSym("lessThan");
+                    methodName = wellKnown.lessThanSym;
                     *node = *newCallExp(
                         node->file, node->line, methodName, 
                         left, newExpList(right, emptyExpList())
@@ -2254,7 +2358,7 @@ static void checkBinOpExp(
                     node->u.callExp.expType = tmpType;
                     break;
                 case ABSYN_BINOP_LE:
-                    methodName = newSym("lessEquals");
+                    methodName = wellKnown.lessEqualsSym;
                     *node = *newCallExp(
                         node->file, node->line, methodName, 
                         left, newExpList(right, emptyExpList())
@@ -2263,7 +2367,7 @@ static void checkBinOpExp(
                     node->u.callExp.expType = tmpType;
                     break;
                 case ABSYN_BINOP_GT:
-                    methodName = newSym("greaterThan");
+                    methodName = wellKnown.greaterThanSym;
                     *node = *newCallExp(
                         node->file, node->line, methodName, 
                         left, newExpList(right, emptyExpList())
@@ -2272,7 +2376,7 @@ static void checkBinOpExp(
                     node->u.callExp.expType = tmpType;
                     break;
                 case ABSYN_BINOP_GE:
-                    methodName = newSym("greaterEquals");
+                    methodName = wellKnown.greaterEqualsSym;
                     *node = *newCallExp(
                         node->file, node->line, methodName, 
                         left, newExpList(right, emptyExpList())
@@ -2313,28 +2417,41 @@ static void checkBinOpExp(
                         node->line);
             }
                         
+            *returnType = *integerType;
+            *tmpType = *integerType;
+            if (optimizationLevel >= 1 && foldBinop(node, tmpType)) {
+                break;
+            }
+
+            /* with optimization the operation stays a binop node and
+             * codegen calculates it inline instead of calling Integer */
+            if (optimizationLevel >= 1
+                    && leftType->u.simpleType.class == integerType->u.simpleType.class
+                    && rightType->u.simpleType.class == integerType->u.simpleType.class) {
+                node->u.binopExp.expType = tmpType;
+                break;
+            }
+
             switch(op) {
                 case ABSYN_BINOP_ADD:
-                    methodName = newSym("add");
+                    methodName = wellKnown.addSym;
                     break;
                 case ABSYN_BINOP_SUB:
-                    methodName = newSym("sub");
+                    methodName = wellKnown.subSym;
                     break;
                 case ABSYN_BINOP_MUL:
-                    methodName = newSym("mul");
+                    methodName = wellKnown.mulSym;
                     break;
                 case ABSYN_BINOP_DIV:
-                    methodName = newSym("div");
+                    methodName = wellKnown.divSym;
                     break;
                 case ABSYN_BINOP_MOD:
-                    methodName = newSym("mod");
+                    methodName = wellKnown.modSym;
                     break;
             }
             
             *node = *newCallExp(node->file, node->line, methodName, left, newExpList(right, emptyExpList()));
-            node->u.callExp.rcvrClass = leftType->u.simpleType.class;            
-            *returnType = *integerType;
-            *tmpType = *integerType;
+            node->u.callExp.rcvrClass = leftType->u.simpleType.class;
             node->u.callExp.expType = tmpType;
             break;
         default:
@@ -2342,8 +2459,8 @@ static void checkBinOpExp(
             break;
     }
     
-    free(leftType);
-    free(rightType);
+    release(leftType);
+    release(rightType);
 }
 
 static void checkUnOpExp(
@@ -2357,10 +2474,8 @@ static void checkUnOpExp(
         Type *returnType,
         int pass) {
     
-    Entry *integerEntry = lookupClass(fileTable, globalTable, newSym("Integer"));
-    Type *integerType = newSimpleType(integerEntry->u.classEntry.class);
-    Entry *booleanEntry = lookupClass(fileTable, globalTable, newSym("Boolean"));
-    Type *booleanType = newSimpleType(booleanEntry->u.classEntry.class);
+    Type *integerType = wellKnown.integerType;
+    Type *booleanType = wellKnown.booleanType;
 
     int op = node->u.unopExp.op;
     Absyn *right = node->u.unopExp.right;
@@ -2417,9 +2532,10 @@ static void checkUnOpExp(
             break;
     }
     
-    free(integerType);
-    free(booleanType);
-    free(rightType);
+    release(rightType);
+    if (optimizationLevel >= 1 && foldUnop(node, tmpType)) {
+        return;
+    }
     node->u.unopExp.expType = tmpType;
 }
 
@@ -2434,8 +2550,7 @@ static void checkInstanceOfExp(
         Type *returnType,
         int pass) {
 
-    Entry *booleanEntry = lookupClass(fileTable, globalTable, newSym("Boolean"));
-    Type *booleanType = newSimpleType(booleanEntry->u.classEntry.class);
+    Type *booleanType = wellKnown.booleanType;
 
     Absyn *exp = node->u.instofExp.exp;
     Absyn *type = node->u.instofExp.type;
@@ -2524,8 +2639,7 @@ static void checkIntExp(
         boolean breakAllowed,
         Type *returnType,
         int pass) {
-    Entry *integerEntry = lookupClass(fileTable, globalTable, newSym("Integer"));
-    Type *integerType = newSimpleType(integerEntry->u.classEntry.class);
+    Type *integerType = wellKnown.integerType;
     *returnType = *integerType;
     node->u.intExp.expType = integerType;
 }
@@ -2541,8 +2655,7 @@ static void checkBoolExp(
         boolean breakAllowed,
         Type *returnType,
         int pass) {
-    Entry *booleanEntry = lookupClass(fileTable, globalTable, newSym("Boolean"));
-    Type *booleanType = newSimpleType(booleanEntry->u.classEntry.class);
+    Type *booleanType = wellKnown.booleanType;
     *returnType = *booleanType;
     node->u.boolExp.expType = booleanType;
 }
@@ -2558,8 +2671,7 @@ static void checkCharExp(
         boolean breakAllowed,
         Type *returnType,
         int pass) {
-    Entry *characterEntry = lookupClass(fileTable, globalTable, newSym("Character"));
-    Type *characterType = newSimpleType(characterEntry->u.classEntry.class);
+    Type *characterType = wellKnown.characterType;
     *returnType = *characterType;
     node->u.charExp.expType = characterType;
 }
@@ -2577,7 +2689,7 @@ static void checkSelfExp(
         int pass) {
 
     /* lookup and return type of selfExp */
-    Entry *tmpEntry = lookupClass(fileTable, globalTable, actClass->name);
+    Entry *tmpEntry = findClass(fileTable, globalTable, actClass->name);
     Type *tmpType = newSimpleType(tmpEntry->u.classEntry.class);
     *returnType = *tmpType;
     node->u.selfExp.expType = tmpType;
@@ -2596,7 +2708,7 @@ static void checkSuperExp(
         int pass) {
 
     /* lookup and return type of superExp */
-    Entry *tmpEntry = lookupClass(fileTable, globalTable, actClass->superClass->name);
+    Entry *tmpEntry = findClass(fileTable, globalTable, actClass->superClass->name);
     Type *tmpType = newSimpleType(tmpEntry->u.classEntry.class);
     *returnType = *tmpType;
     node->u.superExp.expType = tmpType;
@@ -2616,7 +2728,7 @@ static void checkNewExp(
     /* ToDo: here could be checks for checking the arguments of the newExp matches
      * the constructor of the class, but I'm to tired right now.
      * so just return the type of the class... */
-    Entry *tmpEntry = lookupClass(fileTable, globalTable, node->u.newExp.type);
+    Entry *tmpEntry = findClass(fileTable, globalTable, node->u.newExp.type);
     Type *tmpType = newSimpleType(tmpEntry->u.classEntry.class);
     *returnType = *tmpType;
     node->u.newExp.expType = tmpType;
@@ -2635,7 +2747,7 @@ static void checkNewArrayExp(
     /* ToDo: here could be checks for checking the arguments of the newExp matches
      * the constructor of the class, but I'm to tired right now.
      * so just return the type of the class... */
-    Entry *tmpEntry = lookupClass(fileTable, globalTable, node->u.newArrayExp.type);
+    Entry *tmpEntry = findClass(fileTable, globalTable, node->u.newArrayExp.type);
     Type *tmpType = newArrayType(tmpEntry->u.classEntry.class, node->u.newArrayExp.dims);
     *returnType = *tmpType;
     node->u.newArrayExp.expType = tmpType;
@@ -2696,23 +2808,47 @@ static void checkAsmStm(
 }
 
 
-Table **check(Absyn *fileTrees[], int numInFiles, boolean showSymbolTables) {
-    /* initialize tables and foobars */
+static void checkMethodBody(int i, void *data) {
+    MethodCheck *check = &methodChecks[i];
+    Table *globalTable = (Table *) data;
+    Type *returnType = allocate(sizeof(Type));
+
+    pthread_setspecific(methodCheckKey, check);
+    checkNode(check->node, check->fileTable, NULL, check->actClass,
+            check->classTable, globalTable, FALSE, returnType, 3);
+    pthread_setspecific(methodCheckKey, NULL);
+}
+
+/* only once, a server checks again and again (see server.c) */
+static void createMethodCheckKey(void) {
+    if (pthread_key_create(&methodCheckKey, NULL) != 0) {
+        error("cannot create key for method checks");
+    }
+}
+
+/*
+ * Once the class tables are complete (passes 0 to 2), the method
+ * bodies only read them, so they are checked in parallel. Each one
+ * writes only to its own syntax tree and MethodCheck.
+ */
+static void checkMethodBodies(Table *globalTable) {
+    pthread_once(&methodCheckOnce, createMethodCheckKey);
+    runParallel(numMethodChecks, checkMethodBody, globalTable);
+    numMethodChecks = 0;
+}
+
+
+/* the global table with the builtin classes */
+Table *newGlobalTable(void) {
     Table *globalTable;
-    Table **fileTables;
     Class *characterClass;
     Class *characterMetaClass;
     Entry *characterEntry;
     Entry *characterMetaEntry;
-    Entry *mainClassEntry;
-    Entry *mainMethodEntry;
-
-    Type *returnType = allocate(sizeof(Type));
-
-    int i;
 
     /* Initialize trivial Classes */
     globalTable = newTable(NULL);
+    initWellKnownSyms();
 
 /*
     booleanMetaClass = newClass(TRUE, newSym("$Boolean"), NULL, NULL, NULL, newTable(globalTable));
@@ -2737,38 +2873,91 @@ Table **check(Absyn *fileTrees[], int numInFiles, boolean showSymbolTables) {
     enter(globalTable, characterMetaClass->name, characterMetaEntry);
     enter(globalTable, characterClass->name, characterEntry);
 
+    return globalTable;
+}
+
+/* the classes the input file refers to, if collectClassRefs is set */
+Table *referencedClasses(int file) {
+    return classRefTables[file];
+}
+
+/*
+ * The global table already holds the classes of the interface files
+ * (see library.c), the classes of the input files are numbered after
+ * them. A library or object file (isLibrary) has no main class.
+ */
+Table **check(Absyn *fileTrees[], int numInFiles, Table *globalTable,
+        boolean showSymbolTables, boolean isLibrary) {
+    /* initialize tables and foobars */
+    Table **fileTables;
+    Entry *mainClassEntry;
+    Entry *mainMethodEntry;
+
+    Type *returnType = allocate(sizeof(Type));
+
+    int i;
+
+    globalIndex = firstClassGlobal() + library.numClasses / 2;
+    /* left over if the last check failed */
+    numMethodChecks = 0;
+    maxMethodChecks = 0;
+
     /* Allocate needed Table pointer space */
     fileTables = (Table **)allocate(numInFiles * sizeof(Table *));
+    checkedFileTables = fileTables;
+    if (collectClassRefs) {
+        classRefTables = (Table **) allocate(numInFiles * sizeof(Table *));
+        for (i = 0; i < numInFiles; i++) {
+            classRefTables[i] = newTable(NULL);
+        }
+    }
 
     /* first pass: collecting classes and other identifiers */
+    startPass(PASS_CLASSES);
     for(i = 0; i < numInFiles; i++) {
         checkNode(fileTrees[i], &(fileTables[i]), NULL, NULL, NULL,
                 globalTable, FALSE, NULL, 0);
     }    
+    endPass(PASS_CLASSES);
+
+    /* the loaded files may refer to the classes of the input files */
+    readLibraryBodies();
+
+    /* all public classes are known now */
+    initWellKnownTypes(globalTable);
 
     /* second pass: build class hierarchy */    
+    startPass(PASS_HIERARCHY);
     for(i = 0; i < numInFiles; i++) {
         checkNode(fileTrees[i], &(fileTables[i]), NULL, NULL, NULL,
                 globalTable, FALSE, NULL, 1);
     }
+    endPass(PASS_HIERARCHY);
 
     /* third pass: stuff */
+    startPass(PASS_MEMBERS);
     for(i = 0; i < numInFiles; i++) {
          checkNode(fileTrees[i], &(fileTables[i]), NULL, NULL, NULL,
                 globalTable, FALSE, NULL, 2);
     }
+    endPass(PASS_MEMBERS);
 
     /* fourth pass: typechecking */
+    startPass(PASS_TYPES);
     for(i = 0; i < numInFiles; i++) {
         checkNode(fileTrees[i], &(fileTables[i]), NULL, NULL, NULL,
                 globalTable, FALSE, returnType, 3);
     }
+    checkMethodBodies(globalTable);
+    endPass(PASS_TYPES);
 
     /* fifth pass: make virtual method tables */
+    startPass(PASS_LAYOUT);
     for(i = 0; i < numInFiles; i++) {
          checkNode(fileTrees[i], &(fileTables[i]), NULL, NULL, NULL,
                 globalTable, FALSE, returnType, 4);
     }
+    endPass(PASS_LAYOUT);
 
     if (showSymbolTables) {
         printf("## Global Symboltable ##\n");
@@ -2782,6 +2971,12 @@ Table **check(Absyn *fileTrees[], int numInFiles, boolean showSymbolTables) {
         exit(0);
     }
 
+    if (isLibrary) {
+        /* a library has no main class */
+        release(returnType);
+        return fileTables;
+    }
+
     mainClassEntry = lookup(globalTable, newSym("Main"), ENTRY_KIND_CLASS);
 
     if ( NULL == mainClassEntry ) {
@@ -2807,7 +3002,7 @@ Table **check(Absyn *fileTrees[], int numInFiles, boolean showSymbolTables) {
         }
     }
 
-    free(returnType);
+    release(returnType);
     return fileTables;
 }
 
@@ -2832,6 +3027,7 @@ static Type *lookupTypeFromAbsyn(Absyn *node, Table **fileTable) {
                         node->line);
             }
 
+            useClass(fileTable, classEntry->u.classEntry.class);
             return newSimpleType(classEntry->u.classEntry.class);
             break;
         case ABSYN_ARRAYTY:
@@ -2853,6 +3049,7 @@ static Type *lookupTypeFromAbsyn(Absyn *node, Table **fileTable) {
                         node->line);
             }
 
+            useClass(fileTable, classEntry->u.classEntry.class);
             return newArrayType(classEntry->u.classEntry.class, node->u.arrayTy.dims);
             break;
 
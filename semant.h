@@ -12,7 +12,12 @@
 extern "C" {
 #endif
 
-Table **check(Absyn *fileTrees[], int numInFiles, boolean showSymbolTables);
+extern boolean collectClassRefs;
+
+Table *newGlobalTable(void);
+Table **check(Absyn *fileTrees[], int numInFiles, Table *globalTable,
+        boolean showSymbolTables, boolean isLibrary);
+Table *referencedClasses(int file);
 
 
 #ifdef	__cplusplus
@@ -0,0 +1,318 @@
+/*
+ * server.c -- compiler server
+ *
+ * With --server <socket> the compiler listens on a Unix domain socket
+ * and answers compile requests one after the other, until it is
+ * killed. The requests are built with the build cache (see cache.c),
+ * so only the files which changed (or depend on changed interfaces)
+ * are scanned, parsed and checked again. The library and the object
+ * files of the cache stay in memory (see library.c), as do the
+ * symbols (see sym.c). The global table is set up again for every
+ * request from these interfaces, since checking the input files
+ * changes the tables of the classes it uses.
+ *
+ * An error ends the request, not the server: error() leaves the
+ * request with a longjmp, and the arenas of the request are released
+ * as after a successful request.
+ *
+ * With --connect <socket> the compiler sends its input files to a
+ * server. A request consists of lines: "dir <working directory>",
+ * optionally "output <file>" and "emit-bin", a line "file <name>"
+ * per input file and finally "end". The answer is either "ok", then
+ * the program follows if no output file was given, or "error" and
+ * the message.
+ */
+
+#define _POSIX_C_SOURCE 200809L	/* open_memstream */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "utils.h"
+#include "sym.h"
+#include "types.h"
+#include "absyn.h"
+#include "table.h"
+#include "semant.h"
+#include "instr.h"
+#include "library.h"
+#include "cache.h"
+#include "server.h"
+
+
+#define MAX_LINE	4096
+#define MAX_MESSAGE	1024
+
+
+/* where error() leaves a request */
+static jmp_buf requestEnv;
+static char requestError[MAX_MESSAGE];
+
+/* the output of the request, closed when the request fails */
+static FILE *requestOutput;
+static char *requestProgram;
+static size_t requestProgramSize;
+
+/* the same for all requests */
+static char *cacheDir;
+static int numLibFiles;
+static char **libFileNames;
+
+
+static void leaveRequest(char *message) {
+    strncpy(requestError, message, MAX_MESSAGE - 1);
+    requestError[MAX_MESSAGE - 1] = '\0';
+    free(message);
+    longjmp(requestEnv, 1);
+}
+
+
+/* an absolute path, the working directory changes with the requests */
+static char *absolutePath(char *name) {
+    char dir[MAX_LINE];
+    char *path;
+
+    if (name[0] == '/') {
+        path = (char *) allocateResident(strlen(name) + 1);
+        strcpy(path, name);
+        return path;
+    }
+    if (getcwd(dir, MAX_LINE) == NULL) {
+        error("cannot get working directory");
+    }
+    path = (char *) allocateResident(strlen(dir) + 1 + strlen(name) + 1);
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+
+static boolean readLine(FILE *in, char *line) {
+    int length;
+
+    if (fgets(line, MAX_LINE, in) == NULL) {
+        return FALSE;
+    }
+    length = strlen(line);
+    if (length == 0 || line[length - 1] != '\n') {
+        return FALSE;
+    }
+    line[length - 1] = '\0';
+    return TRUE;
+}
+
+
+static void answerRequest(FILE *in, FILE *out) {
+    char line[MAX_LINE];
+    char *inFileName[MAX_INFILES];
+    int numInFiles;
+    char *outFileName;
+    boolean emitBinary;
+
+    numInFiles = 0;
+    outFileName = NULL;
+    emitBinary = FALSE;
+    while (1) {
+        if (!readLine(in, line)) {
+            error("incomplete request");
+        }
+        if (strcmp(line, "end") == 0) {
+            break;
+        }
+        if (strncmp(line, "dir ", 4) == 0) {
+            if (chdir(line + 4) != 0) {
+                error("cannot change to directory '%s'", line + 4);
+            }
+        } else if (strncmp(line, "output ", 7) == 0) {
+            outFileName = copyString(line + 7);
+        } else if (strcmp(line, "emit-bin") == 0) {
+            emitBinary = TRUE;
+        } else if (strncmp(line, "file ", 5) == 0) {
+            if (numInFiles == MAX_INFILES) {
+                error("too many input files");
+            }
+            inFileName[numInFiles++] = copyString(line + 5);
+        } else {
+            error("invalid request '%s'", line);
+        }
+    }
+    if (numInFiles == 0) {
+        error("no input file");
+    }
+    if (outFileName != NULL) {
+        requestOutput = fopen(outFileName, emitBinary ? "wb" : "w");
+        if (requestOutput == NULL) {
+            error("cannot open output file '%s'", outFileName);
+        }
+    } else {
+        /* sent after the answer, when it is known to be complete */
+        requestOutput = open_memstream(&requestProgram, &requestProgramSize);
+        if (requestOutput == NULL) {
+            error("out of memory");
+        }
+    }
+    buildWithCache(cacheDir, numInFiles, inFileName, numLibFiles, libFileNames,
+                   requestOutput, emitBinary);
+    if (fclose(requestOutput) != 0) {
+        requestOutput = NULL;
+        error("cannot write output file");
+    }
+    requestOutput = NULL;
+    fprintf(out, "ok\n");
+    if (requestProgram != NULL) {
+        fwrite(requestProgram, 1, requestProgramSize, out);
+    }
+}
+
+
+static void serveConnection(int fd) {
+    FILE *in;
+    FILE *out;
+
+    in = fdopen(fd, "r");
+    out = fdopen(dup(fd), "w");
+    if (in == NULL || out == NULL) {
+        close(fd);
+        return;
+    }
+    requestOutput = NULL;
+    requestProgram = NULL;
+    useArena(ARENA_PARSE);
+    if (setjmp(requestEnv) == 0) {
+        setErrorHook(leaveRequest);
+        answerRequest(in, out);
+    } else {
+        /* the request failed, clean up what it left behind */
+        if (requestOutput != NULL) {
+            fclose(requestOutput);
+            requestOutput = NULL;
+        }
+        resetLibraries();
+        collectClassRefs = FALSE;
+        fprintf(out, "error %s\n", requestError);
+    }
+    setErrorHook(NULL);
+    free(requestProgram);
+    fclose(out);
+    fclose(in);
+    releaseArena(ARENA_CODEGEN);
+    releaseArena(ARENA_SEMANT);
+    releaseArena(ARENA_PARSE);
+}
+
+
+void runServer(char *socketName, char *dir,
+        int numObjFiles, char *objFileNames[]) {
+    struct sockaddr_un address;
+    int listener;
+    int fd;
+    int i;
+
+    if (strlen(socketName) >= sizeof(address.sun_path)) {
+        error("socket name '%s' is too long", socketName);
+    }
+    cacheDir = absolutePath(dir);
+    numLibFiles = numObjFiles;
+    libFileNames = (char **) allocateResident((numObjFiles + 1) * sizeof(char *));
+    for (i = 0; i < numObjFiles; i++) {
+        libFileNames[i] = absolutePath(objFileNames[i]);
+    }
+    keepLibrariesResident();
+    /* a client which goes away must not end the server */
+    signal(SIGPIPE, SIG_IGN);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        error("cannot create socket");
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketName);
+    /* left over from a server which was killed */
+    unlink(socketName);
+    if (bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0
+            || listen(listener, 16) != 0) {
+        error("cannot listen on socket '%s'", socketName);
+    }
+    while (1) {
+        fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error("cannot accept connection on socket '%s'", socketName);
+        }
+        serveConnection(fd);
+    }
+}
+
+
+/* returns the exit code of the compiler */
+int requestCompile(char *socketName, int numInFiles, char *inFileNames[],
+        char *outFileName, boolean emitBinary) {
+    struct sockaddr_un address;
+    char dir[MAX_LINE];
+    char line[MAX_LINE];
+    char buffer[MAX_LINE];
+    FILE *in;
+    FILE *out;
+    size_t n;
+    int fd;
+    int i;
+
+    if (strlen(socketName) >= sizeof(address.sun_path)) {
+        error("socket name '%s' is too long", socketName);
+    }
+    if (getcwd(dir, MAX_LINE) == NULL) {
+        error("cannot get working directory");
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketName);
+    if (fd < 0
+            || connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        error("cannot connect to server on socket '%s'", socketName);
+    }
+    in = fdopen(fd, "r");
+    out = fdopen(dup(fd), "w");
+    if (in == NULL || out == NULL) {
+        error("cannot connect to server on socket '%s'", socketName);
+    }
+    fprintf(out, "dir %s\n", dir);
+    if (outFileName != NULL) {
+        fprintf(out, "output %s\n", outFileName);
+    }
+    if (emitBinary) {
+        fprintf(out, "emit-bin\n");
+    }
+    for (i = 0; i < numInFiles; i++) {
+        fprintf(out, "file %s\n", inFileNames[i]);
+    }
+    fprintf(out, "end\n");
+    fclose(out);
+    if (!readLine(in, line)) {
+        error("no answer from server on socket '%s'", socketName);
+    }
+    if (strncmp(line, "error ", 6) == 0) {
+        fprintf(stderr, "Error: %s\n", line + 6);
+        fclose(in);
+        return 1;
+    }
+    if (strcmp(line, "ok") != 0) {
+        error("invalid answer from server on socket '%s'", socketName);
+    }
+    while ((n = fread(buffer, 1, MAX_LINE, in)) > 0) {
+        fwrite(buffer, 1, n, stdout);
+    }
+    fclose(in);
+    return 0;
+}
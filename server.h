@@ -0,0 +1,13 @@
+/*
+ * server.h -- compiler server
+ */
+
+#ifndef SERVER_H
+#define	SERVER_H
+
+void runServer(char *socketName, char *dir,
+        int numObjFiles, char *objFileNames[]);
+int requestCompile(char *socketName, int numInFiles, char *inFileNames[],
+        char *outFileName, boolean emitBinary);
+
+#endif	/* SERVER_H */
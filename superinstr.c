@@ -0,0 +1,193 @@
+/*
+ * superinstr.c -- superinstructions
+ *
+ * With --superinstr the most frequent sequences of instructions are
+ * replaced by single instructions of njvm (see 'instrs'), each one
+ * saves the dispatch of the others. The sequences were picked with
+ * ngrams/ngrams (see 'make ngrams'). This runs on the whole program
+ * just before it is written, so the code of the library and of the
+ * object files is fused as well. A sequence is only fused if no label
+ * lies within, nothing can jump into the middle of it.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "instr.h"
+#include "peephole.h"
+#include "superinstr.h"
+
+
+#define FUSED_UNBOXL	0
+#define FUSED_BOX	1
+#define FUSED_DROPR	2
+#define FUSED_UNBOXBRF	3
+#define FUSED_LEAVE	4
+#define NUM_FUSED	5
+
+
+static char *fusedNames[NUM_FUSED] = {
+    "unboxl: pushl n; getf 1",
+    "box: new 2; dup; ...; putf 1",
+    "dropr: drop n; pushr",
+    "unboxbrf: getf 1; brf",
+    "leave: rsf; ret",
+};
+
+boolean superInstrs = FALSE;
+
+static int fusedCounts[NUM_FUSED];
+
+
+/* the instruction at i and its successor */
+static boolean isPair(InstrBuffer *buffer, int i, int first, int second) {
+    return i + 1 < buffer->numInstrs
+            && buffer->instrs[i].opcode == first
+            && buffer->instrs[i + 1].opcode == second;
+}
+
+
+/* pushl n; getf 1 => unboxl n */
+static boolean fuseUnboxLocal(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+
+    if (!isPair(buffer, i, OP_PUSHL, OP_GETF) || p[1].immediate != 1) {
+        return FALSE;
+    }
+    p[0].opcode = OP_UNBOXL;
+    p[1].opcode = OP_DELETED;
+    fusedCounts[FUSED_UNBOXL]++;
+    return TRUE;
+}
+
+
+/*
+ * new 2; .addr C; dup; <value>; putf 1 => <value>; box; .addr C
+ * the value is calculated first, it must not depend on the box
+ */
+static boolean fuseBox(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+    Instr addr;
+    int depth, in, out;
+    int j, n;
+
+    if (i + 2 >= buffer->numInstrs
+            || p[0].opcode != OP_NEW || p[0].immediate != 2
+            || p[1].opcode != OP_ADDR
+            || p[2].opcode != OP_DUP) {
+        return FALSE;
+    }
+    depth = 0;
+    for (j = i + 3; j < buffer->numInstrs; j++) {
+        if (depth == 1
+                && buffer->instrs[j].opcode == OP_PUTF
+                && buffer->instrs[j].immediate == 1) {
+            break;
+        }
+        if (!isPureValueInstr(&buffer->instrs[j], &in, &out) || in > depth) {
+            return FALSE;
+        }
+        depth += out - in;
+    }
+    if (j == buffer->numInstrs) {
+        return FALSE;
+    }
+    addr = p[1];
+    n = j - (i + 3);
+    memmove(&p[0], &p[3], n * sizeof(Instr));
+    p[n].opcode = OP_BOX;
+    p[n].immediate = 0;
+    p[n].offset = 0;
+    p[n].label = NULL;
+    p[n + 1] = addr;
+    p[n + 2].opcode = OP_DELETED;
+    p[n + 3].opcode = OP_DELETED;
+    fusedCounts[FUSED_BOX]++;
+    return TRUE;
+}
+
+
+/* drop n; pushr => dropr n, the call itself cannot be fused */
+static boolean fuseDropReturn(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+
+    if (!isPair(buffer, i, OP_DROP, OP_PUSHR)) {
+        return FALSE;
+    }
+    p[0].opcode = OP_DROPR;
+    p[1].opcode = OP_DELETED;
+    fusedCounts[FUSED_DROPR]++;
+    return TRUE;
+}
+
+
+/* getf 1; brf L => unboxbrf L */
+static boolean fuseUnboxBranch(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+
+    if (!isPair(buffer, i, OP_GETF, OP_BRF) || p[0].immediate != 1) {
+        return FALSE;
+    }
+    p[0].opcode = OP_UNBOXBRF;
+    p[0].immediate = 0;
+    p[0].label = p[1].label;
+    p[1].opcode = OP_DELETED;
+    fusedCounts[FUSED_UNBOXBRF]++;
+    return TRUE;
+}
+
+
+/* rsf; ret => leave */
+static boolean fuseLeave(InstrBuffer *buffer, int i) {
+    Instr *p = &buffer->instrs[i];
+
+    if (!isPair(buffer, i, OP_RSF, OP_RET)) {
+        return FALSE;
+    }
+    p[0].opcode = OP_LEAVE;
+    p[1].opcode = OP_DELETED;
+    fusedCounts[FUSED_LEAVE]++;
+    return TRUE;
+}
+
+
+/*
+ * A box is fused first, the value it gets may contain more. The
+ * instructions are fused from left to right, the fused ones are not
+ * looked at again.
+ */
+void fuseSuperInstrs(InstrProgram *program) {
+    InstrBuffer *buffer;
+    int i, j;
+
+    for (i = 0; i < program->numBuffers; i++) {
+        buffer = program->buffers[i];
+        for (j = 0; j < buffer->numInstrs; j++) {
+            fuseBox(buffer, j);
+        }
+        removeDeletedInstrs(buffer);
+        for (j = 0; j < buffer->numInstrs; j++) {
+            if (fuseUnboxLocal(buffer, j)
+                    || fuseDropReturn(buffer, j)
+                    || fuseUnboxBranch(buffer, j)
+                    || fuseLeave(buffer, j)) {
+                j++;
+            }
+        }
+        removeDeletedInstrs(buffer);
+    }
+}
+
+
+void showSuperInstrStats(FILE *file) {
+    int i;
+
+    fprintf(file, "Superinstructions:\n");
+    for (i = 0; i < NUM_FUSED; i++) {
+        fprintf(file, "  %-28s %d\n", fusedNames[i], fusedCounts[i]);
+    }
+}
@@ -0,0 +1,13 @@
+/*
+ * superinstr.h -- superinstructions
+ */
+
+#ifndef SUPERINSTR_H
+#define	SUPERINSTR_H
+
+extern boolean superInstrs;
+
+void fuseSuperInstrs(InstrProgram *program);
+void showSuperInstrStats(FILE *file);
+
+#endif	/* SUPERINSTR_H */
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "common.h"
 #include "utils.h"
@@ -16,7 +17,8 @@ static int hashSize = 0;
 static Sym **buckets;
 static int numEntries;
 
-static unsigned stamp = 314159265;
+/* the parser threads share the symbols */
+static pthread_mutex_t symMutex = PTHREAD_MUTEX_INITIALIZER;
 
 
 static unsigned hash(char *s) {
@@ -65,7 +67,7 @@ static void initTable(void) {
   while (!isPrime(hashSize)) {
     hashSize++;
   }
-  buckets = (Sym **) allocate(hashSize * sizeof(Sym *));
+  buckets = (Sym **) allocateResident(hashSize * sizeof(Sym *));
   for (i = 0; i < hashSize; i++) {
     buckets[i] = NULL;
   }
@@ -85,7 +87,7 @@ static void growTable(void) {
     newHashSize += 2;
   }
   /* init new hash table */
-  newBuckets = (Sym **) allocate(newHashSize * sizeof(Sym *));
+  newBuckets = (Sym **) allocateResident(newHashSize * sizeof(Sym *));
   for (i = 0; i < newHashSize; i++) {
     newBuckets[i] = NULL;
   }
@@ -112,6 +114,8 @@ Sym *newSym(char *string) {
   int n;
   Sym *p;
 
+  hashValue = hash(string);
+  pthread_mutex_lock(&symMutex);
   /* initialize hash table if necessary */
   if (hashSize == 0) {
     initTable();
@@ -120,8 +124,7 @@ Sym *newSym(char *string) {
   if (numEntries == hashSize) {
     growTable();
   }
-  /* compute hash value and bucket number */
-  hashValue = hash(string);
+  /* compute bucket number */
   n = hashValue % hashSize;
   /* search in bucket list */
   p = buckets[n];
@@ -129,21 +132,28 @@ Sym *newSym(char *string) {
     if (p->hashValue == hashValue) {
       if (strcmp(p->string, string) == 0) {
         /* found: return symbol */
+        pthread_mutex_unlock(&symMutex);
         return p;
       }
     }
     p = p->next;
   }
   /* not found: add new symbol to bucket list */
-  p = (Sym *) allocate(sizeof(Sym));
-  p->string = (char *) allocate(strlen(string) + 1);
+  /* a compiler server keeps the symbols from one request to the next */
+  p = (Sym *) allocateResident(sizeof(Sym));
+  p->string = (char *) allocateResident(strlen(string) + 1);
   strcpy(p->string, string);
-  p->stamp = stamp;
-  stamp += 0x9E3779B9;  /* Fibonacci hashing, see Knuth Vol. 3 */
+  /*
+   * The stamp depends on the string only, not on the order in which
+   * the symbols are created, so that the tables (and the layout of
+   * objects and VMTs) don't depend on the order of the parser threads.
+   */
+  p->stamp = hashValue * 0x9E3779B9;  /* Fibonacci hashing, see Knuth Vol. 3 */
   p->hashValue = hashValue;
   p->next = buckets[n];
   buckets[n] = p;
   numEntries++;
+  pthread_mutex_unlock(&symMutex);
   return p;
 }
 
@@ -12,7 +12,7 @@
 
 typedef struct sym {
   char *string;			/* external representation of symbol */
-  unsigned stamp;		/* unique random stamp for external use */
+  unsigned stamp;		/* random stamp for external use */
   unsigned hashValue;		/* hash value of string, internal use */
   struct sym *next;		/* symbol chaining, internal use */
 } Sym;
@@ -14,6 +14,7 @@
 #include "types.h"
 #include "instance.h"
 #include "table.h"
+#include "timer.h"
 
 
 /**************************************************************/
@@ -151,62 +152,135 @@ Table *newTable(Table *outerScope) {
 }
 
 
+static int compareKeys(unsigned key1, Sym *sym1, int kind1,
+                       unsigned key2, Sym *sym2, int kind2) {
+  if (key1 != key2) {
+    return key1 < key2 ? -1 : 1;
+  }
+  if (sym1 != sym2) {
+    /* different names with the same stamp */
+    return strcmp(symToString(sym1), symToString(sym2));
+  }
+  return kind1 - kind2;
+}
+
+
+static boolean isRed(Bintree *bintree) {
+  return bintree != NULL && bintree->isRed;
+}
+
+
+static Bintree *rotateLeft(Bintree *bintree) {
+  Bintree *right;
+
+  right = bintree->right;
+  bintree->right = right->left;
+  right->left = bintree;
+  right->isRed = bintree->isRed;
+  bintree->isRed = TRUE;
+  return right;
+}
+
+
+static Bintree *rotateRight(Bintree *bintree) {
+  Bintree *left;
+
+  left = bintree->left;
+  bintree->left = left->right;
+  left->right = bintree;
+  left->isRed = bintree->isRed;
+  bintree->isRed = TRUE;
+  return left;
+}
+
+
+static void flipColors(Bintree *bintree) {
+  bintree->isRed = TRUE;
+  bintree->left->isRed = FALSE;
+  bintree->right->isRed = FALSE;
+}
+
+
+static Bintree *insertBintree(Bintree *bintree, Bintree *newtree,
+                              boolean *isDuplicate) {
+  int cmp;
+
+  if (bintree == NULL) {
+    return newtree;
+  }
+  cmp = compareKeys(newtree->key, newtree->sym, newtree->entry->kind,
+                    bintree->key, bintree->sym, bintree->entry->kind);
+  if (cmp == 0) {
+    /* symbol already in table */
+    *isDuplicate = TRUE;
+    return bintree;
+  }
+  if (cmp < 0) {
+    bintree->left = insertBintree(bintree->left, newtree, isDuplicate);
+  } else {
+    bintree->right = insertBintree(bintree->right, newtree, isDuplicate);
+  }
+  /* restore balance on the way up */
+  if (isRed(bintree->right) && !isRed(bintree->left)) {
+    bintree = rotateLeft(bintree);
+  }
+  if (isRed(bintree->left) && isRed(bintree->left->left)) {
+    bintree = rotateRight(bintree);
+  }
+  if (isRed(bintree->left) && isRed(bintree->right)) {
+    flipColors(bintree);
+  }
+  return bintree;
+}
+
+
 Entry *enter(Table *table, Sym *sym, Entry *entry) {
-  unsigned key;
   Bintree *newtree;
-  Bintree *current;
-  Bintree *previous;
+  boolean isDuplicate;
 
-  key = symToStamp(sym);
   newtree = (Bintree *) allocate(sizeof(Bintree));
   newtree->sym = sym;
-  newtree->key = key;
+  newtree->key = symToStamp(sym);
   newtree->entry = entry;
+  newtree->isRed = TRUE;
   newtree->left = NULL;
   newtree->right = NULL;
-  if (table->bintree == NULL) {
-    table->numEntries = 1;
-    table->bintree = newtree;
-  } else {
-    current = table->bintree;
-    while (1) {
-      if (current->key == key && current->entry->kind == entry->kind) {
-        /* symbol already in table */
-        return NULL;
-      }
-      previous = current;
-      if (current->key > key) {
-        current = current->left;
-      } else {
-        current = current->right;
-      }
-      if (current == NULL) {
-        table->numEntries++;
-        if (previous->key > key) {
-          previous->left = newtree;
-        } else {
-          previous->right = newtree;
-        }
-        break;
-      }
-    }
+  isDuplicate = FALSE;
+  table->bintree = insertBintree(table->bintree, newtree, &isDuplicate);
+  table->bintree->isRed = FALSE;
+  if (isDuplicate) {
+    release(newtree);
+    return NULL;
   }
+  table->numEntries++;
   return entry;
 }
 
 
-static Entry *lookupBintree(Bintree *bintree, unsigned key, int kind) {
+static Entry *lookupBintree(Bintree *bintree, unsigned key, Sym *sym,
+                            int kind) {
+  int cmp;
+  int depth;
+
+  depth = 0;
   while (bintree != NULL) {
-    if (bintree->key == key && bintree->entry->kind == kind) {
-      return bintree->entry;
+    depth++;
+    cmp = compareKeys(key, sym, kind,
+                      bintree->key, bintree->sym, bintree->entry->kind);
+    if (cmp == 0) {
+      break;
     }
-    if (bintree->key > key) {
+    if (cmp < 0) {
       bintree = bintree->left;
     } else {
       bintree = bintree->right;
     }
   }
-  return NULL;
+  if (timePasses) {
+    addCount(COUNT_LOOKUPS, 1);
+    addCount(COUNT_LOOKUP_DEPTH, depth);
+  }
+  return bintree == NULL ? NULL : bintree->entry;
 }
 
 
@@ -226,7 +300,7 @@ Entry *lookup(Table *table, Sym *sym, int kind) {
 
   key = symToStamp(sym);
   while (table != NULL) {
-    entry = lookupBintree(table->bintree, key, kind);
+    entry = lookupBintree(table->bintree, key, sym, kind);
     if (entry != NULL) {
       return entry;
     }
@@ -246,7 +320,7 @@ Entry *lookupMember(Class *class, Sym *sym, int kind) {
 
     while(tmpClass != NULL) {
         table = tmpClass->mbrTable;
-        entry = lookupBintree(table->bintree, key, kind);
+        entry = lookupBintree(table->bintree, key, sym, kind);
         if(entry != NULL) {
             return entry;
         }
@@ -258,7 +332,7 @@ Entry *lookupMember(Class *class, Sym *sym, int kind) {
 
     while(tmpClass != NULL) {
         table = tmpClass->mbrTable;
-        entry = lookupBintree(table->bintree, key, kind);
+        entry = lookupBintree(table->bintree, key, sym, kind);
         if(entry != NULL) {
             entry = copyEntry(entry);
             switch(entry->kind) {
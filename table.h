@@ -51,10 +51,16 @@ Entry *copyEntry(Entry *entry);
 void showEntry(Entry *entry);
 
 
+/*
+ * The entries of a table are kept in a left-leaning red-black tree,
+ * ordered by the stamp of the symbol (by its name if two stamps are
+ * equal) and then by the kind of entry.
+ */
 typedef struct bintree {
   Sym *sym;
   unsigned key;
   Entry *entry;
+  boolean isRed;		/* color of the link from the parent */
   struct bintree *left;
   struct bintree *right;
 } Bintree;
@@ -0,0 +1,213 @@
+/*
+ * timer.c -- time and memory used by the compiler passes
+ *
+ * With --time-passes every pass measures the wall clock time, the
+ * processor time (of all threads) and the memory it allocates from
+ * the arenas. A pass which runs several times, e.g. once per round of
+ * the build cache, adds up. The counters show how hard the symbol
+ * tables and the virtual method tables are worked. They are bumped on
+ * every lookup, by several threads at once, so each thread counts on
+ * its own and the counts are added up when the thread ends or a pass
+ * of the main thread is over.
+ */
+
+#define _POSIX_C_SOURCE 200112L	/* clock_gettime, getrusage */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "common.h"
+#include "utils.h"
+#include "timer.h"
+
+
+typedef struct {
+    char *name;
+    int runs;
+    double wallStart;
+    clock_t cpuStart;
+    unsigned long sizeStart;
+    unsigned long allocsStart;
+    double wallTime;		/* seconds */
+    double cpuTime;		/* seconds */
+    unsigned long size;		/* bytes allocated */
+    unsigned long allocs;	/* calls of allocate() */
+    unsigned long peakSize;	/* bytes in all arenas at the end */
+} Pass;
+
+static Pass passes[NUM_PASSES] = {
+    { "scan" },
+    { "parse (with scanning)" },
+    { "load library" },
+    { "semant 1: classes" },
+    { "semant 2: class hierarchy" },
+    { "semant 3: members" },
+    { "semant 4: types" },
+    { "semant 5: VMTs and layout" },
+    { "optimize" },
+    { "codegen" },
+    { "emit" },
+};
+
+boolean timePasses = FALSE;
+
+typedef struct {
+    unsigned long counts[NUM_COUNTS];
+} ThreadCounts;
+
+/* the counts of all threads, as far as they are added up */
+static unsigned long counts[NUM_COUNTS];
+static pthread_mutex_t countMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t countsKey;
+static pthread_once_t countsOnce = PTHREAD_ONCE_INIT;
+
+
+static double wallClock(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+static void addUpCounts(ThreadCounts *own) {
+    int i;
+
+    pthread_mutex_lock(&countMutex);
+    for (i = 0; i < NUM_COUNTS; i++) {
+        counts[i] += own->counts[i];
+        own->counts[i] = 0;
+    }
+    pthread_mutex_unlock(&countMutex);
+}
+
+
+/* a worker thread runs this when it exits, i.e. before it is joined */
+static void endThreadCounts(void *own) {
+    addUpCounts((ThreadCounts *) own);
+    free(own);
+}
+
+
+static void createCountsKey(void) {
+    if (pthread_key_create(&countsKey, endThreadCounts) != 0) {
+        error("cannot create key for counters");
+    }
+}
+
+
+static void addUpOwnCounts(void) {
+    ThreadCounts *own;
+
+    pthread_once(&countsOnce, createCountsKey);
+    own = (ThreadCounts *) pthread_getspecific(countsKey);
+    if (own != NULL) {
+        addUpCounts(own);
+    }
+}
+
+
+void startPass(int pass) {
+    Pass *p = &passes[pass];
+
+    if (!timePasses) {
+        return;
+    }
+    getArenaUsage(&p->sizeStart, &p->allocsStart);
+    p->cpuStart = clock();
+    p->wallStart = wallClock();
+}
+
+
+void endPass(int pass) {
+    Pass *p = &passes[pass];
+    unsigned long size;
+    unsigned long allocs;
+
+    if (!timePasses) {
+        return;
+    }
+    p->wallTime += wallClock() - p->wallStart;
+    p->cpuTime += (double) (clock() - p->cpuStart) / CLOCKS_PER_SEC;
+    getArenaUsage(&size, &allocs);
+    /* an arena released during the pass only lowers the size */
+    if (size > p->sizeStart) {
+        p->size += size - p->sizeStart;
+    }
+    p->allocs += allocs - p->allocsStart;
+    if (size > p->peakSize) {
+        p->peakSize = size;
+    }
+    p->runs++;
+    /* the workers of the pass have added theirs already */
+    addUpOwnCounts();
+}
+
+
+void addCount(int count, unsigned long n) {
+    ThreadCounts *own;
+
+    pthread_once(&countsOnce, createCountsKey);
+    own = (ThreadCounts *) pthread_getspecific(countsKey);
+    if (own == NULL) {
+        own = (ThreadCounts *) calloc(1, sizeof(ThreadCounts));
+        if (own == NULL) {
+            error("out of memory for counters");
+        }
+        pthread_setspecific(countsKey, own);
+    }
+    own->counts[count] += n;
+}
+
+
+static double average(unsigned long sum, unsigned long n) {
+    return n == 0 ? 0.0 : (double) sum / n;
+}
+
+
+void showPassTimes(FILE *file) {
+    struct rusage usage;
+    double wallTotal;
+    double cpuTotal;
+    int i;
+
+    addUpOwnCounts();
+    wallTotal = 0.0;
+    cpuTotal = 0.0;
+    fprintf(file, "Passes (wall ms, cpu ms, allocated KB, allocations, "
+                  "arenas KB):\n");
+    for (i = 0; i < NUM_PASSES; i++) {
+        if (passes[i].runs == 0) {
+            continue;
+        }
+        fprintf(file, "  %-28s %9.2f %9.2f %9lu %9lu %9lu\n",
+                passes[i].name,
+                passes[i].wallTime * 1000.0, passes[i].cpuTime * 1000.0,
+                passes[i].size / 1024, passes[i].allocs,
+                passes[i].peakSize / 1024);
+        wallTotal += passes[i].wallTime;
+        cpuTotal += passes[i].cpuTime;
+    }
+    fprintf(file, "  %-28s %9.2f %9.2f\n", "total",
+            wallTotal * 1000.0, cpuTotal * 1000.0);
+    fprintf(file, "Counters:\n");
+    if (counts[COUNT_TOKENS] != 0) {
+        fprintf(file, "  %-28s %lu\n", "tokens", counts[COUNT_TOKENS]);
+    }
+    fprintf(file, "  %-28s %lu\n", "table lookups",
+            counts[COUNT_LOOKUPS]);
+    fprintf(file, "  %-28s %.2f\n", "average lookup depth",
+            average(counts[COUNT_LOOKUP_DEPTH], counts[COUNT_LOOKUPS]));
+    fprintf(file, "  %-28s %lu\n", "VMT lookups",
+            counts[COUNT_VMT_LOOKUPS]);
+    fprintf(file, "  %-28s %.2f\n", "average VMT comparisons",
+            average(counts[COUNT_VMT_PROBES], counts[COUNT_VMT_LOOKUPS]));
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        fprintf(file, "  %-28s %ld KB\n", "maximum resident size",
+                usage.ru_maxrss);
+    }
+}
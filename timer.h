@@ -0,0 +1,35 @@
+/*
+ * timer.h -- time and memory used by the compiler passes
+ */
+
+#ifndef TIMER_H
+#define	TIMER_H
+
+#define PASS_SCAN		0
+#define PASS_PARSE		1
+#define PASS_LOAD		2
+#define PASS_CLASSES		3
+#define PASS_HIERARCHY		4
+#define PASS_MEMBERS		5
+#define PASS_TYPES		6
+#define PASS_LAYOUT		7
+#define PASS_OPTIMIZE		8
+#define PASS_CODEGEN		9
+#define PASS_EMIT		10
+#define NUM_PASSES		11
+
+#define COUNT_LOOKUPS		0	/* calls of lookupBintree */
+#define COUNT_LOOKUP_DEPTH	1	/* nodes visited by them */
+#define COUNT_VMT_LOOKUPS	2	/* calls of lookupVMT */
+#define COUNT_VMT_PROBES	3	/* buckets compared by them */
+#define COUNT_TOKENS		4	/* tokens of the scan pass */
+#define NUM_COUNTS		5
+
+extern boolean timePasses;
+
+void startPass(int pass);
+void endPass(int pass);
+void addCount(int count, unsigned long n);
+void showPassTimes(FILE *file);
+
+#endif	/* TIMER_H */
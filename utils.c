@@ -2,18 +2,54 @@
  * utils.c -- utility functions
  */
 
+#define _XOPEN_SOURCE 600	/* vsnprintf */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 #include "common.h"
 #include "utils.h"
 
+/* only the first of several failing threads reports its error */
+static pthread_mutex_t errorMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ErrorHook errorHook = NULL;
+
+/*
+ * The hook gets the message of every error before it is reported.
+ * If it does not return (e.g. longjmp's out of a worker thread or
+ * back to the request loop of the server), the compiler goes on and
+ * the message belongs to the hook. Returns the hook set before.
+ */
+ErrorHook setErrorHook(ErrorHook hook) {
+    ErrorHook previous = errorHook;
+
+    errorHook = hook;
+    return previous;
+}
+
 void error(char *fmt, ...) {
     va_list ap;
+    char *message;
+    int length;
 
+    if (errorHook != NULL) {
+        va_start(ap, fmt);
+        length = vsnprintf(NULL, 0, fmt, ap);
+        va_end(ap);
+        message = (char *) malloc(length + 1);
+        if (message != NULL) {
+            va_start(ap, fmt);
+            vsnprintf(message, length + 1, fmt, ap);
+            va_end(ap);
+            (*errorHook)(message);
+            free(message);
+        }
+    }
+    pthread_mutex_lock(&errorMutex);
     va_start(ap, fmt);
     fprintf(stderr, "Error: ");
     vfprintf(stderr, fmt, ap);
@@ -22,13 +58,211 @@ void error(char *fmt, ...) {
     exit(1);
 }
 
-void *allocate(unsigned size) {
+/*
+ * Memory is allocated from the arena of the current compiler phase.
+ * An arena is a list of large chunks which are filled from the start;
+ * single objects are never freed, the whole arena is released at once.
+ */
+
+#define CHUNK_SIZE	(256 * 1024)
+
+/* every object is aligned like the most restrictive of these */
+typedef union {
+    long l;
+    double d;
     void *p;
+} Align;
 
-    p = malloc(size);
-    if (p == NULL) {
+#define ALIGNED(n)	(((n) + sizeof(Align) - 1) / sizeof(Align) * sizeof(Align))
+
+typedef struct chunk {
+    struct chunk *next;
+    unsigned long size;		/* usable bytes */
+    unsigned long used;		/* allocated bytes */
+} Chunk;
+
+#define CHUNK_HEADER	ALIGNED(sizeof(Chunk))
+
+typedef struct arena {
+    char *name;
+    Chunk *chunks;		/* the first one is being filled */
+    unsigned long size;		/* allocated bytes */
+    unsigned long peakSize;	/* maximum of size */
+    unsigned long numAllocs;	/* number of allocations */
+    struct arena *parent;	/* worker arenas: arena of the phase */
+} Arena;
+
+static Arena arenas[NUM_ARENAS] = {
+    { "parse",   NULL, 0, 0, 0, NULL },
+    { "semant",  NULL, 0, 0, 0, NULL },
+    { "codegen", NULL, 0, 0, 0, NULL },
+    { "resident", NULL, 0, 0, 0, NULL },
+};
+
+static Arena *currentArena = &arenas[ARENA_PARSE];
+
+void useArena(int arena) {
+    currentArena = &arenas[arena];
+}
+
+/*
+ * A worker thread allocates from an arena of its own, so that
+ * allocate() needs no lock. When the worker is done, its chunks
+ * are handed over to the arena of the current phase.
+ */
+
+static pthread_key_t workerArenaKey;
+static boolean haveWorkerArenas = FALSE;
+static pthread_mutex_t arenaMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void initWorkerArenas(void) {
+    if (haveWorkerArenas) {
+        return;
+    }
+    if (pthread_key_create(&workerArenaKey, NULL) != 0) {
+        error("cannot create worker arenas");
+    }
+    haveWorkerArenas = TRUE;
+}
+
+void enterWorkerArena(void) {
+    Arena *arena;
+
+    arena = (Arena *) malloc(sizeof(Arena));
+    if (arena == NULL) {
         error("out of memory");
     }
+    arena->name = currentArena->name;
+    arena->chunks = NULL;
+    arena->size = 0;
+    arena->peakSize = 0;
+    arena->numAllocs = 0;
+    arena->parent = currentArena;
+    pthread_setspecific(workerArenaKey, arena);
+}
+
+void leaveWorkerArena(void) {
+    Arena *arena;
+    Arena *parent;
+    Chunk *last;
+
+    arena = (Arena *) pthread_getspecific(workerArenaKey);
+    pthread_setspecific(workerArenaKey, NULL);
+    parent = arena->parent;
+    pthread_mutex_lock(&arenaMutex);
+    if (arena->chunks != NULL) {
+        /* keep on filling the first chunk of the phase */
+        last = arena->chunks;
+        while (last->next != NULL) {
+            last = last->next;
+        }
+        if (parent->chunks == NULL) {
+            parent->chunks = arena->chunks;
+        } else {
+            last->next = parent->chunks->next;
+            parent->chunks->next = arena->chunks;
+        }
+    }
+    parent->size += arena->size;
+    if (parent->size > parent->peakSize) {
+        parent->peakSize = parent->size;
+    }
+    parent->numAllocs += arena->numAllocs;
+    pthread_mutex_unlock(&arenaMutex);
+    free(arena);
+}
+
+void releaseArena(int arena) {
+    Chunk *chunk;
+
+    while (arenas[arena].chunks != NULL) {
+        chunk = arenas[arena].chunks;
+        arenas[arena].chunks = chunk->next;
+        free(chunk);
+    }
+    arenas[arena].size = 0;
+}
+
+void showArenaStats(FILE *file) {
+    int i;
+
+    fprintf(file, "Memory arenas (peak size, allocations):\n");
+    for (i = 0; i < NUM_ARENAS; i++) {
+        fprintf(file, "  %-28s %lu bytes, %lu\n",
+                arenas[i].name, arenas[i].peakSize, arenas[i].numAllocs);
+    }
+}
+
+/* bytes in all arenas and allocations so far, see timer.c */
+void getArenaUsage(unsigned long *size, unsigned long *numAllocs) {
+    int i;
+
+    *size = 0;
+    *numAllocs = 0;
+    pthread_mutex_lock(&arenaMutex);
+    for (i = 0; i < NUM_ARENAS; i++) {
+        *size += arenas[i].size;
+        *numAllocs += arenas[i].numAllocs;
+    }
+    pthread_mutex_unlock(&arenaMutex);
+}
+
+static void *allocateFrom(Arena *arena, unsigned size) {
+    Chunk *chunk;
+    unsigned long n;
+    char *p;
+
+    n = size == 0 ? sizeof(Align) : ALIGNED(size);
+    chunk = arena->chunks;
+    if (chunk == NULL || chunk->used + n > chunk->size) {
+        chunk = (Chunk *) malloc(CHUNK_HEADER + (n > CHUNK_SIZE ? n : CHUNK_SIZE));
+        if (chunk == NULL) {
+            error("out of memory");
+        }
+        chunk->size = n > CHUNK_SIZE ? n : CHUNK_SIZE;
+        chunk->used = 0;
+        if (arena->chunks != NULL && n > CHUNK_SIZE) {
+            /* a large object, keep on filling the current chunk */
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        } else {
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+        }
+    }
+    p = (char *) chunk + CHUNK_HEADER + chunk->used;
+    chunk->used += n;
+    arena->size += n;
+    if (arena->size > arena->peakSize) {
+        arena->peakSize = arena->size;
+    }
+    arena->numAllocs++;
+    return p;
+}
+
+void *allocate(unsigned size) {
+    Arena *arena = currentArena;
+    Arena *workerArena;
+
+    if (haveWorkerArenas) {
+        workerArena = (Arena *) pthread_getspecific(workerArenaKey);
+        if (workerArena != NULL) {
+            arena = workerArena;
+        }
+    }
+    return allocateFrom(arena, size);
+}
+
+/*
+ * Memory for data which outlives the phases, e.g. the symbols, which
+ * a compiler server keeps from one request to the next.
+ */
+void *allocateResident(unsigned size) {
+    void *p;
+
+    pthread_mutex_lock(&arenaMutex);
+    p = allocateFrom(&arenas[ARENA_RESIDENT], size);
+    pthread_mutex_unlock(&arenaMutex);
     return p;
 }
 
@@ -36,7 +270,7 @@ void release(void *p) {
     if (p == NULL) {
         error("NULL pointer detected in release");
     }
-    free(p);
+    /* the memory is reused when its arena is released */
 }
 
 unsigned long djb2(char *str) {
@@ -61,3 +295,11 @@ char *appendString(char *string1, char *string2) {
 
     return newString;
 }
+
+char *copyString(char *string) {
+    char *copy;
+
+    copy = (char *) allocate(strlen(string) + 1);
+    strcpy(copy, string);
+    return copy;
+}
@@ -7,9 +7,28 @@
 #define _UTILS_H_
 
 
+#define ARENA_PARSE	0
+#define ARENA_SEMANT	1
+#define ARENA_CODEGEN	2
+#define ARENA_RESIDENT	3	/* never released, see allocateResident */
+#define NUM_ARENAS	4
+
+
+typedef void (*ErrorHook)(char *message);
+
 void error(char *fmt, ...);
+ErrorHook setErrorHook(ErrorHook hook);
+void useArena(int arena);
+void initWorkerArenas(void);
+void enterWorkerArena(void);
+void leaveWorkerArena(void);
+void releaseArena(int arena);
+void showArenaStats(FILE *file);
+void getArenaUsage(unsigned long *size, unsigned long *numAllocs);
 void *allocate(unsigned size);
+void *allocateResident(unsigned size);
 void release(void *p);
 unsigned long djb2(char* str);
 char *appendString(char *string1, char *string2);
+char *copyString(char *string);
 #endif /* _UTILS_H_ */
@@ -9,82 +9,125 @@
 #include "types.h"
 #include "instance.h"
 #include "absyn.h"
+#include "timer.h"
 
 
-VMT *newVMT(Sym* name, VMT *next, char *className, char *fileName, int offset) {
-    VMT* vmt;
+#define INITIAL_ENTRIES     8
+#define INITIAL_BUCKETS     16
 
-    vmt = (VMT *) allocate(sizeof (VMT));
-    vmt->isEmpty = FALSE;
-    vmt->name = name;
-    vmt->next = next;
-    vmt->className = className;
-    vmt->fileName = fileName;
-    vmt->offset = offset;
 
-    return vmt;
+static int *newBuckets(int numBuckets) {
+    int *buckets;
+
+    buckets = (int *) allocate(numBuckets * sizeof(int));
+    memset(buckets, 0, numBuckets * sizeof(int));
+
+    return buckets;
 }
 
 VMT *newEmptyVMT() {
-    VMT * vmt;
+    VMT *vmt;
 
-    vmt = newVMT(NULL, NULL, NULL, NULL, -1);
-    vmt->isEmpty = TRUE;
+    vmt = (VMT *) allocate(sizeof (VMT));
+    vmt->numEntries = 0;
+    vmt->maxEntries = INITIAL_ENTRIES;
+    vmt->entries = (VMTEntry *) allocate(INITIAL_ENTRIES * sizeof (VMTEntry));
+    vmt->numBuckets = INITIAL_BUCKETS;
+    vmt->buckets = newBuckets(INITIAL_BUCKETS);
 
     return vmt;
 }
 
 VMT *copyVMT(VMT *src) {
     VMT *vmt;
-    if ( src->isEmpty )
-        vmt = newEmptyVMT();
-    else {
-        vmt = newVMT(src->name,
-                copyVMT(src->next),
-                src->className,
-                src->fileName,
-                src->offset
-                );
-    }
+
+    vmt = (VMT *) allocate(sizeof (VMT));
+    vmt->numEntries = src->numEntries;
+    vmt->maxEntries = src->maxEntries;
+    vmt->entries = (VMTEntry *) allocate(src->maxEntries * sizeof (VMTEntry));
+    memcpy(vmt->entries, src->entries, src->numEntries * sizeof (VMTEntry));
+    vmt->numBuckets = src->numBuckets;
+    vmt->buckets = (int *) allocate(src->numBuckets * sizeof(int));
+    memcpy(vmt->buckets, src->buckets, src->numBuckets * sizeof(int));
+
     return vmt;
 }
 
+/* the bucket of a method name, or the free bucket where it belongs */
+static int findBucket(VMT *src, Sym *name, int *probes) {
+    int mask = src->numBuckets - 1;
+    int i;
+
+    /* symbols are unique, the stamp is a good hash value */
+    i = symToStamp(name) & mask;
+    *probes = 1;
+    while (src->buckets[i] != 0
+            && src->entries[src->buckets[i] - 1].name != name) {
+        i = (i + 1) & mask;
+        (*probes)++;
+    }
+    return i;
+}
+
 int findVMT(VMT* src, Sym *name) {
-    while ( ! src->isEmpty ) {
-        if ( strcmp(symToString(src->name), symToString(name)) == 0 ) {
-            return src->offset;
-        }
-        src = src->next;
+    VMTEntry *entry;
+
+    entry = lookupVMT(src, name);
+    return entry == NULL ? -1 : entry->offset;
+}
+
+VMTEntry *lookupVMT(VMT* src, Sym *name) {
+    int bucket;
+    int probes;
+
+    bucket = src->buckets[findBucket(src, name, &probes)];
+    if (timePasses) {
+        addCount(COUNT_VMT_LOOKUPS, 1);
+        addCount(COUNT_VMT_PROBES, probes);
     }
-    return -1;
+    return bucket == 0 ? NULL : &src->entries[bucket - 1];
 }
 
 void replaceVMT(VMT* src, Sym *name, char *className, char *fileName, int offset) {
-    while( ! src->isEmpty ) {
-        if ( src->offset == offset ) {
-            src->name = name;
-            src->className = className;
-            src->fileName = fileName;
-            return;
+    /* the name stays the same, see findVMT */
+    src->entries[offset].className = className;
+    src->entries[offset].fileName = fileName;
+}
+
+static void growVMT(VMT *src) {
+    VMTEntry *entries;
+    int probes;
+    int i;
+
+    if (src->numEntries == src->maxEntries) {
+        entries = (VMTEntry *) allocate(2 * src->maxEntries * sizeof (VMTEntry));
+        memcpy(entries, src->entries, src->numEntries * sizeof (VMTEntry));
+        release(src->entries);
+        src->entries = entries;
+        src->maxEntries *= 2;
+    }
+    if (2 * (src->numEntries + 1) > src->numBuckets) {
+        /* keep the hash table at most half full */
+        release(src->buckets);
+        src->numBuckets *= 2;
+        src->buckets = newBuckets(src->numBuckets);
+        for (i = 0; i < src->numEntries; i++) {
+            src->buckets[findBucket(src, src->entries[i].name, &probes)] = i + 1;
         }
-        src = src->next;
     }
 }
 
 void appendVMT(VMT* src, Sym *name, char *className, char *fileName) {
-    if ( src->isEmpty ) {
-        src->isEmpty = FALSE;
-        src->name = name;
-        src->className = className;
-        src->fileName = fileName;
-        src->offset = 0;
-        src->next = newEmptyVMT();
-        return;
-    }
-    while ( ! src->next->isEmpty ) {
-        src = src->next;
-    }
-    src->next = newVMT(name, src->next, className, fileName, src->offset + 1);
+    VMTEntry *entry;
+    int probes;
+
+    growVMT(src);
+    entry = &src->entries[src->numEntries];
+    entry->name = name;
+    entry->className = className;
+    entry->fileName = fileName;
+    entry->offset = src->numEntries;
+    src->buckets[findBucket(src, name, &probes)] = ++src->numEntries;
 }
 
 static void printIndent(int indent) {
@@ -94,30 +137,17 @@ static void printIndent(int indent) {
 }
 
 void showVMT(VMT* src, int indent) {
-    printIndent(indent);
-    if ( src->isEmpty ) {
-        printf("===== END =====\n");
-        return;
-    }
-    printf("%d:\t%s_%s\n", src->offset, src->className, symToString(src->name));
-    showVMT(src->next, indent);
-}
+    int i;
 
-void printVMT(FILE* file, VMT* vmt) {
-    while(!vmt->isEmpty) {
-        fprintf(file, ".addr\t%s_%s_%lx\n", vmt->className, symToString(vmt->name), djb2(vmt->fileName));
-        vmt = vmt->next;
+    for (i = 0; i < src->numEntries; i++) {
+        printIndent(indent);
+        printf("%d:\t%s_%s\n", src->entries[i].offset,
+                src->entries[i].className, symToString(src->entries[i].name));
     }
-    fprintf(file, "\n");
+    printIndent(indent);
+    printf("===== END =====\n");
 }
 
 int countMethods(VMT *vmt) {
-    int count = 0;
-
-    while(!vmt->isEmpty) {
-        count++;
-        vmt = vmt->next;
-    }
-
-    return count;
+    return vmt->numEntries;
 }
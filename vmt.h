@@ -8,25 +8,30 @@
 #ifndef VMT_H
 #define	VMT_H
 
-typedef struct vmt {
-    boolean isEmpty;        /* determines whether the end of vmt is reached or not */
-    struct vmt *next;       /* pointer to next VMT */
+typedef struct {
     struct sym *name;       /* pointer to method name symbol */
     char *className;
     char *fileName;
     int offset;             /* offset of the virtual method */
+} VMTEntry;
+
+typedef struct vmt {
+    int numEntries;         /* number of methods */
+    int maxEntries;
+    VMTEntry *entries;      /* the methods, indexed by offset */
+    int numBuckets;         /* size of hash table, a power of 2 */
+    int *buckets;           /* offset + 1 of the method, 0 if free */
 } VMT;
 
-VMT *newVMT(Sym* name, VMT *next, char *className, char *fileName, int offset);
 VMT *newEmptyVMT(void);
 VMT *copyVMT(VMT *src);
 
 int findVMT(VMT* src, Sym *name);
+VMTEntry *lookupVMT(VMT* src, Sym *name);
 void replaceVMT(VMT* src, Sym *name, char *className, char *fileName, int offset);
 void appendVMT(VMT* src, Sym *name, char *className, char *fileName);
 
 void showVMT(VMT* src, int indent);
-void printVMT(FILE* file, VMT* vmt);
 
 int countMethods(VMT *vmt);
 
@@ -0,0 +1,64 @@
+/*
+ * wellknown.c -- well-known symbols, classes and types
+ *
+ * Literals and operators refer to the classes Integer, Boolean and
+ * Character. Their symbols are interned and the classes and types
+ * are resolved once, when all classes have been entered into the
+ * global table, instead of on every expression.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "utils.h"
+#include "sym.h"
+#include "types.h"
+#include "table.h"
+#include "wellknown.h"
+
+
+WellKnown wellKnown;
+
+
+void initWellKnownSyms(void) {
+    wellKnown.integerSym = newSym("Integer");
+    wellKnown.booleanSym = newSym("Boolean");
+    wellKnown.characterSym = newSym("Character");
+    wellKnown.equalsSym = newSym("equals");
+    wellKnown.lessThanSym = newSym("lessThan");
+    wellKnown.lessEqualsSym = newSym("lessEquals");
+    wellKnown.greaterThanSym = newSym("greaterThan");
+    wellKnown.greaterEqualsSym = newSym("greaterEquals");
+    wellKnown.addSym = newSym("add");
+    wellKnown.subSym = newSym("sub");
+    wellKnown.mulSym = newSym("mul");
+    wellKnown.divSym = newSym("div");
+    wellKnown.modSym = newSym("mod");
+}
+
+
+static Class *lookupWellKnownClass(Table *globalTable, Sym *name, Type **type) {
+    Entry *entry;
+
+    entry = lookup(globalTable, name, ENTRY_KIND_CLASS);
+    if (entry == NULL) {
+        /* the library is not part of the program */
+        *type = NULL;
+        return NULL;
+    }
+    *type = newSimpleType(entry->u.classEntry.class);
+    return entry->u.classEntry.class;
+}
+
+
+void initWellKnownTypes(Table *globalTable) {
+    wellKnown.integerClass = lookupWellKnownClass(globalTable,
+            wellKnown.integerSym, &wellKnown.integerType);
+    wellKnown.booleanClass = lookupWellKnownClass(globalTable,
+            wellKnown.booleanSym, &wellKnown.booleanType);
+    wellKnown.characterClass = lookupWellKnownClass(globalTable,
+            wellKnown.characterSym, &wellKnown.characterType);
+}
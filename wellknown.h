@@ -0,0 +1,39 @@
+/*
+ * wellknown.h -- well-known symbols, classes and types
+ */
+
+#ifndef WELLKNOWN_H
+#define	WELLKNOWN_H
+
+typedef struct {
+    /* class names */
+    Sym *integerSym;
+    Sym *booleanSym;
+    Sym *characterSym;
+    /* methods which implement operators at -O0 */
+    Sym *equalsSym;
+    Sym *lessThanSym;
+    Sym *lessEqualsSym;
+    Sym *greaterThanSym;
+    Sym *greaterEqualsSym;
+    Sym *addSym;
+    Sym *subSym;
+    Sym *mulSym;
+    Sym *divSym;
+    Sym *modSym;
+    /* builtin classes, NULL if not declared */
+    Class *integerClass;
+    Class *booleanClass;
+    Class *characterClass;
+    /* shared types of the builtin classes, must not be modified */
+    Type *integerType;
+    Type *booleanType;
+    Type *characterType;
+} WellKnown;
+
+extern WellKnown wellKnown;
+
+void initWellKnownSyms(void);
+void initWellKnownTypes(Table *globalTable);
+
+#endif	/* WELLKNOWN_H */